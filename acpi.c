@@ -0,0 +1,173 @@
+/**
+ * acpi.c - ACPI table discovery
+ *
+ * Only what the kernel needs to find the MADT: the RSDP is searched in
+ * the first KB of the EBDA and in the BIOS ROM area, then the RSDT is
+ * walked to find tables by signature. Tables are read in place, through
+ * the direct map or, above it, a vmap mapping. vmap space is never
+ * given back, so acpi_init maps each table once and keeps the pointers;
+ * headers above the direct map are read through one reused window.
+ */
+
+#include "acpi.h"
+#include "paging.h"
+
+/* Root System Description Pointer (ACPI 1.0 part) */
+struct acpi_rsdp {
+    char signature[8];
+    unsigned char checksum;
+    char oem_id[6];
+    unsigned char revision;
+    unsigned int rsdt_address;
+} __attribute__((packed));
+
+/* Tables of the RSDT kept by acpi_init */
+#define ACPI_MAX_TABLES     32
+
+static struct acpi_sdt_header *rsdt = 0;
+static struct acpi_sdt_header *tables[ACPI_MAX_TABLES];
+static unsigned int table_count = 0;
+
+/* Two pages, as a header may cross a page boundary */
+static unsigned int probe_window = 0;
+
+/** acpi_table_length:
+ *  Reads the length from the header of the table at a physical address
+ *
+ *  @return The length, or 0 if the header couldn't be mapped
+ */
+static unsigned int acpi_table_length(unsigned int phys)
+{
+    unsigned int page = phys & ~PAGE_FLAGS_MASK;
+    struct acpi_sdt_header *header;
+
+    if (phys < PAGING_DIRECT_MAP_SIZE &&
+        sizeof(*header) <= PAGING_DIRECT_MAP_SIZE - phys) {
+        header = phys_to_virt(phys);
+        return header->length;
+    }
+
+    if (probe_window == 0) {
+        probe_window = paging_vmap_reserve(2 * PAGE_SIZE);
+        if (probe_window == 0) {
+            return 0;
+        }
+    }
+    if (paging_map_page(paging_kernel_directory(), probe_window, page, 0) < 0 ||
+        paging_map_page(paging_kernel_directory(), probe_window + PAGE_SIZE,
+                        page + PAGE_SIZE, 0) < 0) {
+        return 0;
+    }
+    header = (struct acpi_sdt_header *)(probe_window + (phys & PAGE_FLAGS_MASK));
+    return header->length;
+}
+
+/** acpi_map_table:
+ *  Gets a kernel pointer to the table at a physical address, mapping it
+ *  if it lies above the direct map
+ */
+static struct acpi_sdt_header *acpi_map_table(unsigned int phys)
+{
+    unsigned int length = acpi_table_length(phys);
+
+    if (length < sizeof(struct acpi_sdt_header)) {
+        return 0;
+    }
+    if (phys < PAGING_DIRECT_MAP_SIZE && length <= PAGING_DIRECT_MAP_SIZE - phys) {
+        return phys_to_virt(phys);
+    }
+    return paging_vmap(phys, length, 0);
+}
+
+/** acpi_checksum_ok:
+ *  ACPI structures are valid when all their bytes sum to zero
+ */
+static int acpi_checksum_ok(const void *data, unsigned int length)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned char sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/** acpi_scan_rsdp:
+ *  Searches physical [start, end) on 16 byte boundaries for the RSDP
+ */
+static struct acpi_rsdp *acpi_scan_rsdp(unsigned int start, unsigned int end)
+{
+    static const char signature[8] = {'R', 'S', 'D', ' ', 'P', 'T', 'R', ' '};
+    unsigned int addr;
+
+    for (addr = start; addr + sizeof(struct acpi_rsdp) <= end; addr += 16) {
+        const char *p = (const char *)phys_to_virt(addr);
+        int i;
+
+        for (i = 0; i < 8 && p[i] == signature[i]; i++);
+
+        if (i == 8 && acpi_checksum_ok(p, sizeof(struct acpi_rsdp))) {
+            return (struct acpi_rsdp *)p;
+        }
+    }
+    return 0;
+}
+
+/** acpi_init */
+int acpi_init(void)
+{
+    struct acpi_rsdp *rsdp;
+    unsigned int *entries;
+    unsigned int count;
+    unsigned int i;
+    unsigned int ebda = (unsigned int)(*(volatile unsigned short *)phys_to_virt(0x40E)) << 4;
+
+    rsdp = 0;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+    }
+    if (rsdp == 0) {
+        rsdp = acpi_scan_rsdp(0xE0000, 0x100000);
+    }
+    if (rsdp == 0) {
+        return -1;
+    }
+
+    rsdt = acpi_map_table(rsdp->rsdt_address);
+    if (rsdt == 0 || !acpi_checksum_ok(rsdt, rsdt->length)) {
+        rsdt = 0;
+        return -1;
+    }
+
+    entries = (unsigned int *)((char *)rsdt + sizeof(struct acpi_sdt_header));
+    count = (rsdt->length - sizeof(struct acpi_sdt_header)) / 4;
+    table_count = 0;
+    for (i = 0; i < count && table_count < ACPI_MAX_TABLES; i++) {
+        struct acpi_sdt_header *table = acpi_map_table(entries[i]);
+
+        if (table != 0 && acpi_checksum_ok(table, table->length)) {
+            tables[table_count++] = table;
+        }
+    }
+    return 0;
+}
+
+/** acpi_find_table */
+struct acpi_sdt_header *acpi_find_table(const char *signature)
+{
+    unsigned int i;
+
+    for (i = 0; i < table_count; i++) {
+        struct acpi_sdt_header *table = tables[i];
+
+        if (table->signature[0] == signature[0] &&
+            table->signature[1] == signature[1] &&
+            table->signature[2] == signature[2] &&
+            table->signature[3] == signature[3]) {
+            return table;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_ACPI_H
+#define INCLUDE_ACPI_H
+
+/* Common header of all ACPI system description tables */
+struct acpi_sdt_header {
+    char signature[4];
+    unsigned int length;
+    unsigned char revision;
+    unsigned char checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    unsigned int oem_revision;
+    unsigned int creator_id;
+    unsigned int creator_revision;
+} __attribute__((packed));
+
+/** acpi_init:
+ *  Locates the RSDP in the EBDA or the BIOS area, validates the RSDT and
+ *  maps the valid tables it lists
+ *
+ *  @return  0 if ACPI tables were found, -1 if not
+ */
+int acpi_init(void);
+
+/** acpi_find_table:
+ *  Looks up a system description table by signature among those
+ *  acpi_init mapped
+ *
+ *  @param signature  The 4 character signature, e.g. "APIC" for the MADT
+ *  @return           The table, or 0 if not present or corrupt
+ */
+struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+#endif /* INCLUDE_ACPI_H */
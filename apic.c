@@ -0,0 +1,402 @@
+/**
+ * apic.c - Local APIC and I/O APIC interrupt delivery
+ *
+ * Replaces the 8259 PIC when the machine has an APIC: the legacy ISA IRQs
+ * are routed through the I/O APIC to vectors 32-47, so drivers keep their
+ * vectors, and an interrupt is acknowledged with a single store to the
+ * local APIC EOI register instead of port I/O.
+ */
+
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "io.h"
+#include "hardware.h"
+#include "paging.h"
+#include "spinlock.h"
+
+/* CPUID.1:EDX */
+#define CPUID_FEATURE_APIC      (1 << 9)
+
+/* IA32_APIC_BASE MSR */
+#define MSR_APIC_BASE           0x1B
+#define MSR_APIC_BASE_ENABLE    (1 << 11)
+
+/* Local APIC registers (offsets from the base) */
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_LINT0         0x350
+#define LAPIC_LVT_LINT1         0x360
+#define LAPIC_LVT_ERROR         0x370
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_LVT_NMI           0x400
+#define LAPIC_ICR_PENDING       0x1000
+
+/* I/O APIC registers */
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WINDOW           0x10
+#define IOAPIC_REG_VERSION      0x01
+#define IOAPIC_REG_REDTBL       0x10
+
+#define IOAPIC_ACTIVE_LOW       (1 << 13)
+#define IOAPIC_LEVEL_TRIGGERED  (1 << 15)
+#define IOAPIC_MASKED           (1 << 16)
+
+/* MADT entry types */
+#define MADT_LAPIC              0
+#define MADT_IOAPIC             1
+#define MADT_OVERRIDE           2
+#define MADT_LAPIC_OVERRIDE     5
+
+/* Multiple APIC Description Table */
+struct madt {
+    struct acpi_sdt_header header;
+    unsigned int lapic_address;
+    unsigned int flags;
+} __attribute__((packed));
+
+struct madt_entry {
+    unsigned char type;
+    unsigned char length;
+} __attribute__((packed));
+
+struct madt_lapic {
+    struct madt_entry entry;
+    unsigned char processor_id;
+    unsigned char apic_id;
+    unsigned int flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry entry;
+    unsigned char id;
+    unsigned char reserved;
+    unsigned int address;
+    unsigned int gsi_base;
+} __attribute__((packed));
+
+struct madt_override {
+    struct madt_entry entry;
+    unsigned char bus;
+    unsigned char source;
+    unsigned int gsi;
+    unsigned short flags;
+} __attribute__((packed));
+
+struct madt_lapic_override {
+    struct madt_entry entry;
+    unsigned short reserved;
+    unsigned int address_low;
+    unsigned int address_high;
+} __attribute__((packed));
+
+/* How one ISA IRQ is wired to the I/O APIC */
+struct isa_route {
+    unsigned int gsi;
+    unsigned int flags;     /* IOAPIC_ACTIVE_LOW / IOAPIC_LEVEL_TRIGGERED */
+};
+
+static volatile unsigned int *lapic = 0;
+static volatile unsigned int *ioapic = 0;
+static unsigned int lapic_phys = 0;
+static unsigned int ioapic_phys = 0;
+static unsigned int ioapic_gsi_base = 0;
+static int apic_enabled = 0;
+
+static struct isa_route isa_routes[16];
+static unsigned int cpu_apic_ids[APIC_MAX_CPUS];
+static unsigned int cpu_count = 0;
+
+/* The ICR is two registers: one sender at a time per local APIC, and
+ * one lock keeps it simple
+ */
+static struct spinlock ipi_lock;
+
+/** rdmsr / wrmsr:
+ *  Read and write a model specific register
+ */
+static unsigned long long rdmsr(unsigned int msr)
+{
+    unsigned int low, high;
+    __asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((unsigned long long)high << 32) | low;
+}
+
+static void wrmsr(unsigned int msr, unsigned long long value)
+{
+    __asm__ volatile("wrmsr"
+                     : : "c"(msr), "a"((unsigned int)value),
+                         "d"((unsigned int)(value >> 32)));
+}
+
+static unsigned int lapic_read(unsigned int reg)
+{
+    return lapic[reg / 4];
+}
+
+static void lapic_write(unsigned int reg, unsigned int value)
+{
+    lapic[reg / 4] = value;
+}
+
+static unsigned int ioapic_read(unsigned int reg)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    return ioapic[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(unsigned int reg, unsigned int value)
+{
+    ioapic[IOAPIC_REGSEL / 4] = reg;
+    ioapic[IOAPIC_WINDOW / 4] = value;
+}
+
+/** madt_parse:
+ *  Collects the local APIC address, the first I/O APIC, the processors
+ *  and the ISA interrupt source overrides
+ */
+static int madt_parse(struct madt *madt)
+{
+    unsigned char *p = (unsigned char *)madt + sizeof(struct madt);
+    unsigned char *end = (unsigned char *)madt + madt->header.length;
+    unsigned int irq;
+
+    for (irq = 0; irq < 16; irq++) {
+        isa_routes[irq].gsi = irq;
+        isa_routes[irq].flags = 0;      /* ISA: edge triggered, active high */
+    }
+
+    lapic_phys = madt->lapic_address;
+
+    while (p + sizeof(struct madt_entry) <= end) {
+        struct madt_entry *entry = (struct madt_entry *)p;
+
+        if (entry->length < sizeof(struct madt_entry)) {
+            break;
+        }
+
+        if (entry->type == MADT_LAPIC) {
+            struct madt_lapic *cpu = (struct madt_lapic *)entry;
+            if ((cpu->flags & 1) && cpu_count < APIC_MAX_CPUS) {
+                cpu_apic_ids[cpu_count++] = cpu->apic_id;
+            }
+        } else if (entry->type == MADT_IOAPIC) {
+            struct madt_ioapic *io = (struct madt_ioapic *)entry;
+            if (ioapic_phys == 0) {
+                ioapic_phys = io->address;
+                ioapic_gsi_base = io->gsi_base;
+            }
+        } else if (entry->type == MADT_OVERRIDE) {
+            struct madt_override *iso = (struct madt_override *)entry;
+            if (iso->bus == 0 && iso->source < 16) {
+                unsigned int flags = 0;
+                if ((iso->flags & 0x3) == 0x3) {
+                    flags |= IOAPIC_ACTIVE_LOW;
+                }
+                if (((iso->flags >> 2) & 0x3) == 0x3) {
+                    flags |= IOAPIC_LEVEL_TRIGGERED;
+                }
+                isa_routes[iso->source].gsi = iso->gsi;
+                isa_routes[iso->source].flags = flags;
+            }
+        } else if (entry->type == MADT_LAPIC_OVERRIDE) {
+            struct madt_lapic_override *lo = (struct madt_lapic_override *)entry;
+            if (lo->address_high == 0) {
+                lapic_phys = lo->address_low;
+            }
+        }
+
+        p += entry->length;
+    }
+
+    return (lapic_phys != 0 && ioapic_phys != 0) ? 0 : -1;
+}
+
+/** pic_disable:
+ *  Masks every line of both 8259s. They stay remapped to 32-47, so a
+ *  spurious PIC interrupt can't be mistaken for a CPU exception.
+ */
+static void pic_disable(void)
+{
+    outb(0xA1, 0xFF);
+    outb(0x21, 0xFF);
+
+    /* Systems with an IMCR power up in PIC mode: switch it to APIC mode */
+    outb(0x22, 0x70);
+    outb(0x23, 0x01);
+}
+
+/** lapic_enable:
+ *  Enables the local APIC of the calling processor
+ */
+static void lapic_enable(void)
+{
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | MSR_APIC_BASE_ENABLE);
+
+    /* Accept all priorities, mask the local interrupt pins except NMI */
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    /* Discard anything the PIC era left in service */
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/** ioapic_route_isa:
+ *  Routes ISA IRQs 0-15 (except the cascade) to vectors 32-47 on the
+ *  calling processor, masks every other input
+ */
+static void ioapic_route_isa(void)
+{
+    unsigned int max_entry = (ioapic_read(IOAPIC_REG_VERSION) >> 16) & 0xFF;
+    unsigned int dest = apic_get_id();
+    unsigned int i;
+
+    for (i = 0; i <= max_entry; i++) {
+        ioapic_write(IOAPIC_REG_REDTBL + i * 2, IOAPIC_MASKED);
+        ioapic_write(IOAPIC_REG_REDTBL + i * 2 + 1, 0);
+    }
+
+    for (i = 0; i < 16; i++) {
+        unsigned int pin;
+
+        if (i == 2) {
+            continue;
+        }
+        pin = isa_routes[i].gsi - ioapic_gsi_base;
+        if (isa_routes[i].gsi < ioapic_gsi_base || pin > max_entry) {
+            continue;
+        }
+
+        ioapic_write(IOAPIC_REG_REDTBL + pin * 2 + 1, dest << 24);
+        ioapic_write(IOAPIC_REG_REDTBL + pin * 2,
+                     (IRQ_BASE_VECTOR + i) | isa_routes[i].flags);
+    }
+}
+
+/** apic_spurious:
+ *  Spurious interrupts need no acknowledge
+ */
+static void apic_spurious(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+}
+
+/** apic_init */
+int apic_init(void)
+{
+    unsigned int feat_edx, feat_ecx;
+    struct madt *madt;
+
+    cpu_count = 0;
+    hw_get_cpu_features(&feat_edx, &feat_ecx);
+    if (!(feat_edx & CPUID_FEATURE_APIC)) {
+        return 0;
+    }
+
+    if (acpi_init() != 0) {
+        return 0;
+    }
+    madt = (struct madt *)acpi_find_table("APIC");
+    if (madt == 0 || madt_parse(madt) != 0) {
+        lapic_phys = 0;
+        ioapic_phys = 0;
+        cpu_count = 0;
+        return 0;
+    }
+
+    /* Both register blocks sit above the direct map: map them uncached */
+    lapic = paging_vmap(lapic_phys, PAGE_SIZE, PAGE_MMIO);
+    ioapic = paging_vmap(ioapic_phys, PAGE_SIZE, PAGE_MMIO);
+    if (lapic == 0 || ioapic == 0) {
+        lapic = 0;
+        ioapic = 0;
+        cpu_count = 0;
+        return 0;
+    }
+
+    irq_register(APIC_SPURIOUS_VECTOR, apic_spurious, 0);
+
+    pic_disable();
+    lapic_enable();
+    ioapic_route_isa();
+
+    apic_enabled = 1;
+    return 1;
+}
+
+/** apic_init_cpu */
+void apic_init_cpu(void)
+{
+    lapic_enable();
+}
+
+/** apic_send_ipi */
+void apic_send_ipi(unsigned int apic_id, unsigned int command)
+{
+    unsigned int flags = spin_lock_irqsave(&ipi_lock);
+
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+    spin_unlock_irqrestore(&ipi_lock, flags);
+}
+
+/** apic_is_enabled */
+int apic_is_enabled(void)
+{
+    return apic_enabled;
+}
+
+/** apic_eoi */
+void apic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/** apic_get_id */
+unsigned int apic_get_id(void)
+{
+    if (lapic == 0) {
+        return 0;
+    }
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/** apic_get_cpu_count */
+unsigned int apic_get_cpu_count(void)
+{
+    return cpu_count > 0 ? cpu_count : 1;
+}
+
+/** apic_get_cpu_apic_id */
+unsigned int apic_get_cpu_apic_id(unsigned int index)
+{
+    if (index >= cpu_count) {
+        return apic_get_id();
+    }
+    return cpu_apic_ids[index];
+}
+
+/** apic_get_lapic_base */
+unsigned int apic_get_lapic_base(void)
+{
+    return lapic_phys;
+}
+
+/** apic_get_ioapic_base */
+unsigned int apic_get_ioapic_base(void)
+{
+    return ioapic_phys;
+}
@@ -0,0 +1,89 @@
+#ifndef INCLUDE_APIC_H
+#define INCLUDE_APIC_H
+
+/* Vector of the local APIC spurious interrupt (low nibble must be 0xF) */
+#define APIC_SPURIOUS_VECTOR    255
+
+/* Maximum number of processors recorded from the MADT */
+#define APIC_MAX_CPUS           16
+
+/* Inter-processor interrupt commands for apic_send_ipi */
+#define APIC_IPI_FIXED          0x4000  /* | vector */
+#define APIC_IPI_INIT           0x4500
+#define APIC_IPI_STARTUP        0x4600  /* | physical page of the entry */
+
+/** apic_init:
+ *  Detects the local APIC (CPUID) and the I/O APIC (ACPI MADT). When both
+ *  are present, masks the 8259 PIC, enables the local APIC and routes the
+ *  legacy IRQs through the I/O APIC to the same vectors (32-47) the PIC
+ *  used. Otherwise leaves the PIC in charge.
+ *
+ *  @return  1 if interrupts are now delivered by the APIC, 0 if the PIC
+ *           is still used
+ */
+int apic_init(void);
+
+/** apic_init_cpu:
+ *  Enables the local APIC of an application processor the same way
+ *  apic_init did the boot processor's
+ */
+void apic_init_cpu(void);
+
+/** apic_send_ipi:
+ *  Sends an inter-processor interrupt and waits until the local APIC has
+ *  delivered it
+ *
+ *  @param apic_id  The local APIC ID of the target
+ *  @param command  An APIC_IPI_* command
+ */
+void apic_send_ipi(unsigned int apic_id, unsigned int command);
+
+/** apic_is_enabled:
+ *  Checks whether apic_init switched interrupt delivery to the APIC
+ *
+ *  @return  1 if the APIC is in use, 0 if the PIC is
+ */
+int apic_is_enabled(void);
+
+/** apic_eoi:
+ *  Signals end of interrupt to the local APIC (one MMIO store)
+ */
+void apic_eoi(void);
+
+/** apic_get_id:
+ *  Gets the local APIC ID of the calling processor
+ *
+ *  @return  The APIC ID
+ */
+unsigned int apic_get_id(void);
+
+/** apic_get_cpu_count:
+ *  Gets the number of enabled processors listed in the MADT
+ *
+ *  @return  The processor count, 1 when there is no MADT
+ */
+unsigned int apic_get_cpu_count(void);
+
+/** apic_get_cpu_apic_id:
+ *  Gets the local APIC ID of a processor listed in the MADT
+ *
+ *  @param index  Index of the processor, below apic_get_cpu_count()
+ *  @return       The APIC ID
+ */
+unsigned int apic_get_cpu_apic_id(unsigned int index);
+
+/** apic_get_lapic_base:
+ *  Gets the physical address of the local APIC registers
+ *
+ *  @return  The address, 0 if no local APIC was found
+ */
+unsigned int apic_get_lapic_base(void);
+
+/** apic_get_ioapic_base:
+ *  Gets the physical address of the I/O APIC registers
+ *
+ *  @return  The address, 0 if no I/O APIC was found
+ */
+unsigned int apic_get_ioapic_base(void);
+
+#endif /* INCLUDE_APIC_H */
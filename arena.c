@@ -0,0 +1,101 @@
+/**
+ * arena.c - Bump-pointer arenas
+ *
+ * An arena is a list of chunks, each one or more frames with a small
+ * header. Allocation bumps an offset in the current chunk and moves on
+ * to the next one when it is full. Reset just points back at the first
+ * chunk, so chunks stay allocated and are reused from then on.
+ */
+
+#include "arena.h"
+#include "pmm.h"
+#include "paging.h"
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    unsigned int size;              /* Bytes after the header */
+};
+
+#define ARENA_HEADER_SIZE   ((sizeof(struct arena_chunk) + 7) & ~7u)
+#define ARENA_ALIGN(n)      (((n) + 7) & ~7u)
+
+static char *chunk_data(struct arena_chunk *chunk)
+{
+    return (char *)chunk + ARENA_HEADER_SIZE;
+}
+
+/** arena_new_chunk:
+ *  Takes a chunk big enough for size bytes from the PMM and links it in
+ *  after the current one
+ */
+static struct arena_chunk *arena_new_chunk(struct arena *arena, unsigned int size)
+{
+    unsigned int frames = (size + ARENA_HEADER_SIZE + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    unsigned int phys;
+    struct arena_chunk *chunk;
+
+    if (frames < ARENA_CHUNK_FRAMES) {
+        frames = ARENA_CHUNK_FRAMES;
+    }
+
+    phys = pmm_alloc_frames(frames);
+    if (phys == 0) {
+        return 0;
+    }
+
+    chunk = phys_to_virt(phys);
+    chunk->size = frames * PMM_FRAME_SIZE - ARENA_HEADER_SIZE;
+    if (arena->current) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = arena->first;
+        arena->first = chunk;
+    }
+    return chunk;
+}
+
+/** arena_init */
+void arena_init(struct arena *arena)
+{
+    arena->first = 0;
+    arena->current = 0;
+    arena->used = 0;
+}
+
+/** arena_alloc */
+void *arena_alloc(struct arena *arena, unsigned int size)
+{
+    struct arena_chunk *chunk = arena->current;
+    void *ptr;
+
+    if (size > 0xFFFFFFFF - PMM_FRAME_SIZE) {
+        return 0;
+    }
+    size = ARENA_ALIGN(size);
+
+    if (!chunk || arena->used + size > chunk->size) {
+        /* Reuse the next chunk from before the last reset if it fits */
+        if (chunk && chunk->next && size <= chunk->next->size) {
+            chunk = chunk->next;
+        } else {
+            chunk = arena_new_chunk(arena, size);
+            if (!chunk) {
+                return 0;
+            }
+        }
+        arena->current = chunk;
+        arena->used = 0;
+    }
+
+    ptr = chunk_data(chunk) + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+/** arena_reset */
+void arena_reset(struct arena *arena)
+{
+    arena->current = arena->first;
+    arena->used = 0;
+}
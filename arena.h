@@ -0,0 +1,42 @@
+#ifndef INCLUDE_ARENA_H
+#define INCLUDE_ARENA_H
+
+/* Frames per chunk unless a single allocation needs more */
+#define ARENA_CHUNK_FRAMES  1
+
+struct arena_chunk;
+
+/** A bump allocator: memory is only given back all at once */
+struct arena {
+    struct arena_chunk *first;
+    struct arena_chunk *current;    /* Chunk being allocated from */
+    unsigned int used;              /* Bytes used in current */
+};
+
+/** arena_init:
+ *  Sets up an empty arena. Chunks are taken from the PMM on first use.
+ *
+ *  @param arena  The arena
+ */
+void arena_init(struct arena *arena);
+
+/** arena_alloc:
+ *  Allocates memory that lives until the next arena_reset. Any size
+ *  works; a request bigger than a chunk gets a chunk of its own.
+ *
+ *  @param arena  The arena
+ *  @param size   The number of bytes
+ *  @return       8-byte aligned memory (not zeroed), or 0 if memory
+ *                is exhausted
+ */
+void *arena_alloc(struct arena *arena, unsigned int size);
+
+/** arena_reset:
+ *  Frees everything allocated from the arena in O(1). The chunks are
+ *  kept and reused by later allocations.
+ *
+ *  @param arena  The arena
+ */
+void arena_reset(struct arena *arena);
+
+#endif /* INCLUDE_ARENA_H */
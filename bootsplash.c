@@ -1,16 +1,6 @@
 #include "bootsplash.h"
 #include "fb.h"
-
-/** Simple delay function */
-static void delay(unsigned int milliseconds)
-{
-    volatile unsigned int i, j;
-    for (i = 0; i < milliseconds; i++) {
-        for (j = 0; j < 10000; j++) {
-            /* Busy wait */
-        }
-    }
-}
+#include "timer.h"
 
 /** bootsplash_show */
 void bootsplash_show(void)
@@ -57,12 +47,12 @@ void bootsplash_show(void)
     /* Animate through stages */
     for (i = 0; stages[i] != 0; i++) {
         fb_puts((char *)stages[i]);
-        delay(800);  /* ~800ms per stage = ~4.8 seconds total */
+        timer_sleep(800);  /* 800ms per stage = 4.8 seconds total */
     }
     
     /* Show completion message */
     fb_puts("\n\n              Boot complete!\n");
-    delay(500);
+    timer_sleep(500);
     
     /* Clear screen for OS */
     fb_clear();
@@ -0,0 +1,334 @@
+/**
+ * exception.c - CPU exception reporting
+ *
+ * Every exception vector lands in exception_handler, which prints what
+ * is needed to diagnose the fault (error code, registers, CR2, backtrace)
+ * to the screen, mirrored to COM1, then halts. Debug traps return.
+ */
+
+#include "exception.h"
+#include "idt.h"
+#include "fb.h"
+#include "serial.h"
+#include "ksyms.h"
+#include "gdt.h"
+#include "kstack.h"
+#include "paging.h"
+
+#define EXC_DEBUG           1
+#define EXC_NMI             2
+#define EXC_BREAKPOINT      3
+#define EXC_DOUBLE_FAULT    8
+#define EXC_INVALID_TSS     10
+#define EXC_SEGMENT         11
+#define EXC_STACK           12
+#define EXC_GENERAL         13
+#define EXC_PAGE_FAULT      14
+
+#define BACKTRACE_DEPTH     16
+
+/* A double fault with ESP this close to a stack's base is an overflow */
+#define OVERFLOW_MARGIN     256
+
+/* Set while a report is being printed, to catch faults in the reporter */
+static volatile int reporting = 0;
+
+/** put_hex:
+ *  Prints a value as 0x%08X
+ */
+static void put_hex(unsigned int value)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char hex[11];
+    int i;
+
+    hex[0] = '0';
+    hex[1] = 'x';
+    for (i = 0; i < 8; i++) {
+        hex[2 + i] = digits[(value >> (28 - i * 4)) & 0xF];
+    }
+    hex[10] = '\0';
+    fb_puts(hex);
+}
+
+/** put_reg:
+ *  Prints "NAME=0x%08X "
+ */
+static void put_reg(char *name, unsigned int value)
+{
+    fb_puts(name);
+    fb_putc('=');
+    put_hex(value);
+    fb_putc(' ');
+}
+
+/** put_symbol:
+ *  Prints " <function+0xoffset>" for a code address when it is known
+ */
+static void put_symbol(unsigned int address)
+{
+    unsigned int offset;
+    const char *name = ksyms_lookup(address, &offset);
+
+    if (name == 0) {
+        return;
+    }
+    fb_puts(" <");
+    fb_puts((char *)name);
+    fb_puts("+");
+    put_hex(offset);
+    fb_puts(">");
+}
+
+/** read_cr0 / read_cr2 / read_cr3 / read_cr4 */
+static unsigned int read_cr0(void)
+{
+    unsigned int value;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static unsigned int read_cr2(void)
+{
+    unsigned int value;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static unsigned int read_cr3(void)
+{
+    unsigned int value;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static unsigned int read_cr4(void)
+{
+    unsigned int value;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+/** decode_error_code:
+ *  Explains the error code of #PF and of the selector faults
+ */
+static void decode_error_code(unsigned int vector, unsigned int err)
+{
+    if (vector == EXC_PAGE_FAULT) {
+        fb_puts((err & 0x01) ? "protection violation" : "page not present");
+        fb_puts((err & 0x02) ? ", write" : ", read");
+        fb_puts((err & 0x04) ? ", user" : ", kernel");
+        if (err & 0x08) fb_puts(", reserved bit set");
+        if (err & 0x10) fb_puts(", instruction fetch");
+        fb_puts(", address ");
+        put_hex(read_cr2());
+    } else if (vector == EXC_INVALID_TSS || vector == EXC_SEGMENT ||
+               vector == EXC_STACK || vector == EXC_GENERAL) {
+        if (err == 0) {
+            fb_puts("no selector");
+            return;
+        }
+        fb_puts((err & 0x02) ? "IDT" : ((err & 0x04) ? "LDT" : "GDT"));
+        fb_puts(" index ");
+        put_hex((err >> 3) & 0x1FFF);
+        if (err & 0x01) fb_puts(", external event");
+    } else {
+        fb_puts("none");
+    }
+}
+
+/** exception_backtrace */
+void exception_backtrace(unsigned int eip, unsigned int ebp)
+{
+    int depth = 0;
+
+    fb_puts("Backtrace:\n");
+    fb_puts("  #0 ");
+    put_hex(eip);
+    put_symbol(eip);
+    fb_putc('\n');
+
+    /* Each frame: [ebp] = caller's ebp, [ebp + 4] = return address.
+     * loader.s clears ebp before kmain, which ends the chain.
+     */
+    while (ebp != 0 && (ebp & 3) == 0 && depth < BACKTRACE_DEPTH - 1) {
+        unsigned int *frame = (unsigned int *)ebp;
+        unsigned int ret = frame[1];
+
+        if (ret == 0) {
+            break;
+        }
+
+        depth++;
+        fb_puts("  #");
+        if (depth >= 10) {
+            fb_putc('0' + depth / 10);
+        }
+        fb_putc('0' + depth % 10);
+        fb_putc(' ');
+        put_hex(ret);
+        put_symbol(ret);
+        fb_putc('\n');
+
+        /* Frames only move towards the base of the stack */
+        if (frame[0] <= ebp) {
+            break;
+        }
+        ebp = frame[0];
+    }
+}
+
+/** exception_handler */
+void exception_handler(unsigned int *regs, void *ctx)
+{
+    struct exception_frame *frame = (struct exception_frame *)regs;
+    unsigned int vector = frame->int_no;
+    int fatal;
+
+    (void)ctx;
+
+    if (reporting) {
+        /* Faulted while reporting: the screen code may be the culprit */
+        serial_write("\r\nDOUBLE FAULT IN EXCEPTION REPORT, HALTING\r\n", 45);
+        __asm__ volatile("cli");
+        while (1) {
+            __asm__ volatile("hlt");
+        }
+    }
+    reporting = 1;
+
+    fatal = !(vector == EXC_DEBUG || vector == EXC_NMI ||
+              vector == EXC_BREAKPOINT);
+
+    fb_puts(fatal ? "\n=============== KERNEL PANIC ===============\n"
+                  : "\n=============== KERNEL TRAP ================\n");
+    fb_puts("Exception ");
+    put_hex(vector);
+    fb_putc(' ');
+    fb_puts((char *)irq_get_name(vector));
+    fb_puts("\nError code ");
+    put_hex(frame->err_code);
+    fb_puts(": ");
+    decode_error_code(vector, frame->err_code);
+    fb_putc('\n');
+
+    put_reg("EIP", frame->eip);
+    put_symbol(frame->eip);
+    fb_putc('\n');
+    put_reg("CS", frame->cs);
+    put_reg("EFLAGS", frame->eflags);
+    fb_putc('\n');
+    put_reg("EAX", frame->eax);
+    put_reg("EBX", frame->ebx);
+    put_reg("ECX", frame->ecx);
+    put_reg("EDX", frame->edx);
+    fb_putc('\n');
+    put_reg("ESI", frame->esi);
+    put_reg("EDI", frame->edi);
+    put_reg("EBP", frame->ebp);
+    /* Same privilege level: the CPU pushed no ESP, it was right above */
+    put_reg("ESP", (unsigned int)(&frame->eflags + 1));
+    fb_putc('\n');
+    put_reg("DS", frame->ds);
+    put_reg("ES", frame->es);
+    put_reg("FS", frame->fs);
+    put_reg("GS", frame->gs);
+    fb_putc('\n');
+    put_reg("CR0", read_cr0());
+    put_reg("CR2", read_cr2());
+    put_reg("CR3", read_cr3());
+    put_reg("CR4", read_cr4());
+    fb_putc('\n');
+
+    exception_backtrace(frame->eip, frame->ebp);
+
+    if (!fatal) {
+        fb_puts("Continuing.\n");
+        fb_flush();
+        reporting = 0;
+        return;
+    }
+
+    fb_puts("System halted.\n");
+    fb_flush();
+    serial_drain();
+    __asm__ volatile("cli");
+    while (1) {
+        __asm__ volatile("hlt");
+    }
+}
+
+/** exception_double_fault:
+ *  Runs as its own task on its own stack, so it works even when the
+ *  fault came from a stack overflow. The faulting state was saved in the
+ *  kernel TSS by the task switch.
+ */
+static void exception_double_fault(void)
+{
+    const struct tss *tss = gdt_get_kernel_tss();
+    const struct kstack *stack = kstack_find(tss->esp);
+
+    reporting = 1;
+    serial_write("\r\nDOUBLE FAULT\r\n", 16);
+
+    fb_puts("\n=============== KERNEL PANIC ===============\n");
+    fb_puts("Exception ");
+    put_hex(EXC_DOUBLE_FAULT);
+    fb_putc(' ');
+    fb_puts((char *)irq_get_name(EXC_DOUBLE_FAULT));
+    fb_putc('\n');
+
+    if (stack && tss->esp < stack->base + OVERFLOW_MARGIN) {
+        fb_puts("Kernel stack overflow: '");
+        fb_puts((char *)stack->name);
+        fb_puts("' stack, ");
+        put_hex(stack->size);
+        fb_puts(" bytes\n");
+    }
+
+    put_reg("EIP", tss->eip);
+    put_symbol(tss->eip);
+    fb_putc('\n');
+    put_reg("ESP", tss->esp);
+    put_reg("EBP", tss->ebp);
+    put_reg("CR2", read_cr2());
+    fb_putc('\n');
+
+    exception_backtrace(tss->eip, tss->ebp);
+
+    fb_puts("System halted.\n");
+    fb_flush();
+    serial_drain();
+    while (1) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+/** exception_init */
+void exception_init(void)
+{
+    unsigned int vector;
+
+    for (vector = 0; vector < IRQ_BASE_VECTOR; vector++) {
+        irq_register(vector, exception_handler, 0);
+    }
+
+    /* The gate selects the TSS in whichever GDT the faulting processor has */
+    if (exception_init_cpu() == 0) {
+        idt_set_task_gate(EXC_DOUBLE_FAULT, GDT_DOUBLE_FAULT_TSS);
+    }
+}
+
+/** exception_init_cpu */
+int exception_init_cpu(void)
+{
+    /* Double faults switch to a task with a known-good stack */
+    struct kstack *stack = kstack_create("double-fault", KSTACK_DOUBLE_FAULT_SIZE);
+
+    if (!stack) {
+        return -1;
+    }
+    gdt_set_double_fault_task(exception_double_fault, kstack_top(stack),
+                              virt_to_phys(paging_kernel_directory()));
+    return 0;
+}
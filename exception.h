@@ -0,0 +1,45 @@
+#ifndef INCLUDE_EXCEPTION_H
+#define INCLUDE_EXCEPTION_H
+
+/* Register frame built by the common interrupt stub (idt_asm.s) */
+struct exception_frame {
+    unsigned int gs, fs, es, ds;
+    unsigned int edi, esi, ebp, esp_dummy, ebx, edx, ecx, eax;
+    unsigned int int_no, err_code;
+    unsigned int eip, cs, eflags;
+};
+
+/** exception_init:
+ *  Registers the CPU exception handler for vectors 0-31 and routes
+ *  double faults to a task with its own stack. Needs kstack_init and
+ *  gdt_install.
+ */
+void exception_init(void);
+
+/** exception_init_cpu:
+ *  Gives the calling processor its own double fault task and stack.
+ *  exception_init does it for the boot processor.
+ *
+ *  @return 0 on success, -1 if memory is exhausted
+ */
+int exception_init_cpu(void);
+
+/** exception_handler:
+ *  Reports a CPU exception on the screen and COM1: decoded error code,
+ *  saved registers, control registers and a symbolized backtrace. Returns
+ *  for debug traps (#DB, NMI, #BP), halts the system for faults.
+ *
+ *  @param regs  The register frame (see struct exception_frame)
+ *  @param ctx   The handler context (unused)
+ */
+void exception_handler(unsigned int *regs, void *ctx);
+
+/** exception_backtrace:
+ *  Prints the chain of return addresses found by walking EBP frames
+ *
+ *  @param eip  Address of the innermost frame
+ *  @param ebp  Frame pointer of the innermost frame
+ */
+void exception_backtrace(unsigned int eip, unsigned int ebp);
+
+#endif /* INCLUDE_EXCEPTION_H */
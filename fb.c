@@ -1,29 +1,179 @@
 #include "io.h"
 #include "fb.h"
+#include "serial.h"
+#include "memory.h"
+#include "kstring.h"
+#include "paging.h"
 
-/* The framebuffer address */
-char *fb = (char *) 0x000B8000;
+/* The framebuffer address, through the direct map */
+char *fb = (char *) phys_to_virt(0x000B8000);
 
 /* Screen dimensions */
 #define FB_WIDTH 80
 #define FB_HEIGHT 25
 
-/* Cursor position */
-unsigned short cursor_pos = 0;
+/* Default attribute: white on black */
+#define FB_DEFAULT_ATTR ((FB_BLACK << 4) | FB_WHITE)
+
+/* A blank cell in the default colors */
+#define FB_BLANK_CELL   ((unsigned short)((FB_DEFAULT_ATTR << 8) | ' '))
+
+/* Escape sequence parser states */
+#define ANSI_NORMAL     0
+#define ANSI_ESCAPE     1   /* Got ESC */
+#define ANSI_CSI        2   /* Got ESC [ */
+
+#define ANSI_MAX_PARAMS 4
+
+/* VGA text memory is 32 KB: a plane of 204 rows. The visible screen is
+ * a 25 row window into it, selected by the CRTC start address, so
+ * scrolling moves the window instead of the text. Only when the window
+ * reaches the end of the plane is the screen copied back to the top.
+ */
+#define FB_PLANE_ROWS       (0x8000 / (FB_WIDTH * 2))
+
+/* CRTC start address registers */
+#define FB_START_HIGH_COMMAND   12
+#define FB_START_LOW_COMMAND    13
+
+/* A virtual console: a ring of lines holding the screen and the
+ * scrollback above it. Line n lives in lines[n % FB_SCROLLBACK_LINES];
+ * screen row 0 is line top.
+ */
+struct console {
+    unsigned short lines[FB_SCROLLBACK_LINES][FB_WIDTH];
+    unsigned int top;               /* Line shown at screen row 0 */
+    unsigned short cursor_pos;      /* Cursor, in cells from row 0 */
+    unsigned short saved_pos;       /* Cursor saved by ESC [ s */
+    unsigned char attr;             /* Colors for new text */
+    unsigned char bold;             /* SGR 1: bright foreground */
+    unsigned char ansi_state;       /* ANSI_NORMAL, ANSI_ESCAPE, ANSI_CSI */
+    unsigned char num_params;       /* CSI parameters seen so far */
+    unsigned int params[ANSI_MAX_PARAMS];
+};
+
+/* ANSI color number to VGA color */
+static const unsigned char ansi_colors[8] = {
+    FB_BLACK, FB_RED, FB_GREEN, FB_BROWN,
+    FB_BLUE, FB_MAGENTA, FB_CYAN, FB_LIGHT_GREY
+};
+
+static struct console consoles[FB_NUM_CONSOLES];
+
+/* Console receiving output, and the one on screen */
+static struct console *out = &consoles[0];
+static unsigned int visible = 0;
+
+/* How many lines the visible console is scrolled back into history */
+static unsigned int view_back = 0;
+
+/* Position last written to the CRTC, 0xFFFF if unknown */
+static unsigned short hw_cursor_pos = 0xFFFF;
+
+/* Plane row shown at the top of the screen, and the value last written
+ * to the CRTC start address (0xFFFF if unknown)
+ */
+static unsigned short plane_top = 0;
+static unsigned short hw_plane_top = 0xFFFF;
+
+/* Screen rows of the visible console that differ from VGA memory. All
+ * drawing goes to the console buffers; fb_flush copies these rows to
+ * VGA memory, which is slow to write. Only touched from the foreground,
+ * never from interrupt handlers.
+ */
+static unsigned int dirty_rows = 0;
+
+#define FB_ALL_ROWS_DIRTY   ((1u << FB_HEIGHT) - 1)
+
+/** console_line:
+ *  Gets a line of a console by screen row, counting from its top
+ */
+static unsigned short *console_line(struct console *con, unsigned int y)
+{
+    return con->lines[(con->top + y) & (FB_SCROLLBACK_LINES - 1)];
+}
+
+/** fill_cells:
+ *  Fills cells [from, to) of a line with blanks in the given colors
+ */
+static void fill_cells(unsigned short *line, unsigned int from,
+                       unsigned int to, unsigned char attr)
+{
+    unsigned short blank = (unsigned short)((attr << 8) | ' ');
+
+    while (from < to) {
+        line[from++] = blank;
+    }
+}
+
+/** fill_blank:
+ *  Fills a line with blanks
+ */
+static void fill_blank(unsigned short *line)
+{
+    unsigned int *dst = (unsigned int *)line;
+    unsigned int pair = ((unsigned int)FB_BLANK_CELL << 16) | FB_BLANK_CELL;
+    unsigned int i;
+
+    for (i = 0; i < FB_WIDTH / 2; i++) {
+        dst[i] = pair;
+    }
+}
+
+/** show_live:
+ *  Called before changing the output console's screen: if it is on
+ *  screen but scrolled back, jump back to the live screen
+ */
+static void show_live(void)
+{
+    if (out == &consoles[visible] && view_back != 0) {
+        view_back = 0;
+        dirty_rows = FB_ALL_ROWS_DIRTY;
+    }
+}
+
+/** mark_dirty:
+ *  Marks screen rows of the output console as needing a flush, if it is
+ *  the one on screen
+ */
+static void mark_dirty(unsigned int rows)
+{
+    if (out == &consoles[visible]) {
+        dirty_rows |= rows;
+    }
+}
 
 /** fb_move_cursor:
  *  Moves the cursor of the framebuffer to the given position
  *
- *  @param pos The new position of the cursor
+ *  @param pos The new position of the cursor, in cells from the start of
+ *             VGA text memory
  */
 void fb_move_cursor(unsigned short pos)
 {
+    hw_cursor_pos = pos;
     outb(FB_COMMAND_PORT, FB_HIGH_BYTE_COMMAND);
     outb(FB_DATA_PORT, ((pos >> 8) & 0x00FF));
     outb(FB_COMMAND_PORT, FB_LOW_BYTE_COMMAND);
     outb(FB_DATA_PORT, pos & 0x00FF);
 }
 
+/** fb_set_start:
+ *  Sets the plane row displayed at the top of the screen
+ *
+ *  @param row The plane row
+ */
+static void fb_set_start(unsigned short row)
+{
+    unsigned short offset = row * FB_WIDTH;
+
+    hw_plane_top = row;
+    outb(FB_COMMAND_PORT, FB_START_HIGH_COMMAND);
+    outb(FB_DATA_PORT, (offset >> 8) & 0x00FF);
+    outb(FB_COMMAND_PORT, FB_START_LOW_COMMAND);
+    outb(FB_DATA_PORT, offset & 0x00FF);
+}
+
 /** fb_write_cell:
  *  Writes a character with the given foreground and background to position i
  *  in the framebuffer.
@@ -35,41 +185,369 @@ void fb_move_cursor(unsigned short pos)
  */
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg)
 {
-    fb[i] = c;
-    fb[i + 1] = ((bg & 0x0F) << 4) | (fg & 0x0F);  // ← CORRECT
+    unsigned char attr = ((bg & 0x0F) << 4) | (fg & 0x0F);
+    unsigned int cell = i / 2;
+    unsigned int y = cell / FB_WIDTH;
+
+    show_live();
+    console_line(out, y)[cell % FB_WIDTH] =
+        (unsigned short)((attr << 8) | (unsigned char)c);
+    mark_dirty(1u << y);
+}
+
+/** fb_put_cell */
+void fb_put_cell(unsigned int x, unsigned int y, char c,
+                 unsigned char fg, unsigned char bg)
+{
+    if (x >= FB_WIDTH || y >= FB_HEIGHT) {
+        return;
+    }
+    fb_write_cell((y * FB_WIDTH + x) * 2, c, fg, bg);
 }
+
+/** fb_flush */
+void fb_flush(void)
+{
+    struct console *con = &consoles[visible];
+    unsigned int first = con->top - view_back;
+    unsigned int rows = dirty_rows;
+    unsigned int y;
+    unsigned short pos;
+
+    dirty_rows = 0;
+
+    for (y = 0; y < FB_HEIGHT && rows != 0; y++, rows >>= 1) {
+        if (rows & 1) {
+            /* Wide stores: VGA memory is slow per access, not per byte */
+            memcpy(fb + (plane_top + y) * FB_WIDTH * 2,
+                   con->lines[(first + y) & (FB_SCROLLBACK_LINES - 1)],
+                   FB_WIDTH * 2);
+        }
+    }
+
+    /* Port writes are VM exits when virtualised: only on change */
+    if (plane_top != hw_plane_top) {
+        fb_set_start(plane_top);
+    }
+
+    /* Scrolled back far enough, the cursor goes just below the window */
+    pos = con->cursor_pos + view_back * FB_WIDTH;
+    if (pos > FB_WIDTH * FB_HEIGHT) {
+        pos = FB_WIDTH * FB_HEIGHT;
+    }
+    pos += plane_top * FB_WIDTH;
+    if (pos != hw_cursor_pos) {
+        fb_move_cursor(pos);
+    }
+
+    serial_flush();
+}
+
+/** fb_init */
+void fb_init(void)
+{
+    unsigned int n, y;
+
+    for (n = 0; n < FB_NUM_CONSOLES; n++) {
+        consoles[n].top = 0;
+        consoles[n].cursor_pos = 0;
+        consoles[n].saved_pos = 0;
+        consoles[n].attr = FB_DEFAULT_ATTR;
+        consoles[n].bold = 0;
+        consoles[n].ansi_state = ANSI_NORMAL;
+        for (y = 0; y < FB_HEIGHT; y++) {
+            fill_blank(console_line(&consoles[n], y));
+        }
+    }
+    out = &consoles[0];
+    visible = 0;
+    view_back = 0;
+    dirty_rows = FB_ALL_ROWS_DIRTY;
+}
+
+/** fb_console_show */
+void fb_console_show(unsigned int n)
+{
+    if (n >= FB_NUM_CONSOLES || n == visible) {
+        return;
+    }
+    /* Switching is one full-screen copy at the next flush */
+    visible = n;
+    view_back = 0;
+    dirty_rows = FB_ALL_ROWS_DIRTY;
+}
+
+/** fb_console_select */
+void fb_console_select(unsigned int n)
+{
+    if (n >= FB_NUM_CONSOLES) {
+        return;
+    }
+    out = &consoles[n];
+    fb_console_show(n);
+}
+
+/** fb_console_get */
+unsigned int fb_console_get(void)
+{
+    return out - consoles;
+}
+
+/** fb_scroll_view */
+void fb_scroll_view(int lines)
+{
+    struct console *con = &consoles[visible];
+    unsigned int history = con->top;
+    int back = (int)view_back + lines;
+
+    if (history > FB_SCROLLBACK_LINES - FB_HEIGHT) {
+        history = FB_SCROLLBACK_LINES - FB_HEIGHT;
+    }
+    if (back < 0) {
+        back = 0;
+    }
+    if ((unsigned int)back > history) {
+        back = history;
+    }
+    if ((unsigned int)back != view_back) {
+        view_back = back;
+        dirty_rows = FB_ALL_ROWS_DIRTY;
+    }
+}
+
 /** fb_clear:
  *  Clears the screen.
  */
 void fb_clear(void)
 {
-    unsigned int i;
-    for (i = 0; i < FB_WIDTH * FB_HEIGHT; i++) {
-        fb_write_cell(i * 2, ' ', FB_WHITE, FB_BLACK);
+    unsigned int y;
+
+    show_live();
+    for (y = 0; y < FB_HEIGHT; y++) {
+        fill_blank(console_line(out, y));
     }
-    cursor_pos = 0;
-    fb_move_cursor(cursor_pos);
+    mark_dirty(FB_ALL_ROWS_DIRTY);
+    out->cursor_pos = 0;
 }
 
 /** fb_scroll:
  *  Scrolls the screen up by one line.
  */
 void fb_scroll(void)
+{
+    show_live();
+
+    /* The old top row stays behind as scrollback */
+    out->top++;
+    fill_blank(console_line(out, FB_HEIGHT - 1));
+    out->cursor_pos = (FB_HEIGHT - 1) * FB_WIDTH;
+
+    if (out != &consoles[visible]) {
+        return;
+    }
+
+    /* Every row on screen moved up, and so did its dirty bit */
+    dirty_rows = (dirty_rows >> 1) | (1u << (FB_HEIGHT - 1));
+
+    if (plane_top + FB_HEIGHT < FB_PLANE_ROWS) {
+        /* Rows already in VGA memory stay put; the window moves down */
+        plane_top++;
+    } else {
+        /* End of the plane: start over at the top, rewriting every row */
+        plane_top = 0;
+        dirty_rows = FB_ALL_ROWS_DIRTY;
+    }
+}
+
+/** ansi_param:
+ *  Gets CSI parameter i, or def if it is missing or 0
+ */
+static unsigned int ansi_param(unsigned int i, unsigned int def)
+{
+    if (i >= out->num_params || out->params[i] == 0) {
+        return def;
+    }
+    return out->params[i];
+}
+
+/** ansi_sgr:
+ *  Select Graphic Rendition (ESC [ ... m): colors and brightness
+ */
+static void ansi_sgr(void)
 {
     unsigned int i;
-    
-    /* Move all lines up by one */
-    for (i = 0; i < (FB_HEIGHT - 1) * FB_WIDTH; i++) {
-        fb[i * 2] = fb[(i + FB_WIDTH) * 2];
-        fb[i * 2 + 1] = fb[(i + FB_WIDTH) * 2 + 1];
+    unsigned char fg = out->attr & 0x0F;
+    unsigned char bg = (out->attr >> 4) & 0x0F;
+
+    /* ESC [ m is a reset */
+    if (out->num_params == 0) {
+        out->num_params = 1;
+        out->params[0] = 0;
     }
-    
-    /* Clear the last line */
-    for (i = (FB_HEIGHT - 1) * FB_WIDTH; i < FB_HEIGHT * FB_WIDTH; i++) {
-        fb_write_cell(i * 2, ' ', FB_WHITE, FB_BLACK);
+
+    for (i = 0; i < out->num_params; i++) {
+        unsigned int p = out->params[i];
+
+        if (p == 0) {
+            fg = FB_DEFAULT_ATTR & 0x0F;
+            bg = FB_DEFAULT_ATTR >> 4;
+            out->bold = 0;
+        } else if (p == 1) {
+            out->bold = 1;
+            fg |= 0x08;
+        } else if (p == 22) {
+            out->bold = 0;
+            fg &= 0x07;
+        } else if (p >= 30 && p <= 37) {
+            fg = ansi_colors[p - 30] | (out->bold ? 0x08 : 0);
+        } else if (p == 39) {
+            fg = FB_DEFAULT_ATTR & 0x0F;
+        } else if (p >= 40 && p <= 47) {
+            bg = ansi_colors[p - 40];
+        } else if (p == 49) {
+            bg = FB_DEFAULT_ATTR >> 4;
+        } else if (p >= 90 && p <= 97) {
+            fg = ansi_colors[p - 90] | 0x08;
+        } else if (p >= 100 && p <= 107) {
+            /* Bit 3 of the background is blink on VGA: no bright ones */
+            bg = ansi_colors[p - 100];
+        }
     }
-    
-    cursor_pos = (FB_HEIGHT - 1) * FB_WIDTH;
+
+    out->attr = (unsigned char)((bg << 4) | fg);
+}
+
+/** ansi_erase:
+ *  Blanks screen cells [from, to) in the current background color
+ */
+static void ansi_erase(unsigned int from, unsigned int to)
+{
+    unsigned int y;
+
+    show_live();
+    for (y = from / FB_WIDTH; y < FB_HEIGHT && y * FB_WIDTH < to; y++) {
+        unsigned int start = y * FB_WIDTH;
+        unsigned int x0 = from > start ? from - start : 0;
+        unsigned int x1 = to < start + FB_WIDTH ? to - start : FB_WIDTH;
+
+        fill_cells(console_line(out, y), x0, x1, out->attr & 0xF0);
+        mark_dirty(1u << y);
+    }
+}
+
+/** ansi_execute:
+ *  Runs a complete CSI sequence ending in final
+ */
+static void ansi_execute(char final)
+{
+    unsigned int row = out->cursor_pos / FB_WIDTH;
+    unsigned int col = out->cursor_pos % FB_WIDTH;
+    unsigned int n = ansi_param(0, 1);
+
+    switch (final) {
+    case 'm':
+        ansi_sgr();
+        return;
+    case 'H':
+    case 'f':
+        row = ansi_param(0, 1) - 1;
+        col = ansi_param(1, 1) - 1;
+        break;
+    case 'A':
+        row = n > row ? 0 : row - n;
+        break;
+    case 'B':
+        row += n;
+        break;
+    case 'C':
+        col += n;
+        break;
+    case 'D':
+        col = n > col ? 0 : col - n;
+        break;
+    case 'J':
+        n = ansi_param(0, 0);
+        if (n == 0) {
+            ansi_erase(out->cursor_pos, FB_WIDTH * FB_HEIGHT);
+        } else if (n == 1) {
+            ansi_erase(0, out->cursor_pos + 1);
+        } else {
+            ansi_erase(0, FB_WIDTH * FB_HEIGHT);
+        }
+        return;
+    case 'K':
+        n = ansi_param(0, 0);
+        if (n == 0) {
+            ansi_erase(out->cursor_pos, (row + 1) * FB_WIDTH);
+        } else if (n == 1) {
+            ansi_erase(row * FB_WIDTH, out->cursor_pos + 1);
+        } else {
+            ansi_erase(row * FB_WIDTH, (row + 1) * FB_WIDTH);
+        }
+        return;
+    case 's':
+        out->saved_pos = out->cursor_pos;
+        return;
+    case 'u':
+        out->cursor_pos = out->saved_pos;
+        return;
+    default:
+        /* Unsupported sequences are swallowed */
+        return;
+    }
+
+    if (row >= FB_HEIGHT) {
+        row = FB_HEIGHT - 1;
+    }
+    if (col >= FB_WIDTH) {
+        col = FB_WIDTH - 1;
+    }
+    out->cursor_pos = row * FB_WIDTH + col;
+}
+
+/** ansi_feed:
+ *  Feeds one character of an escape sequence to the parser
+ */
+static void ansi_feed(char c)
+{
+    if (out->ansi_state == ANSI_ESCAPE) {
+        if (c == '[') {
+            unsigned int i;
+            for (i = 0; i < ANSI_MAX_PARAMS; i++) {
+                out->params[i] = 0;
+            }
+            out->num_params = 0;
+            out->ansi_state = ANSI_CSI;
+        } else {
+            out->ansi_state = ANSI_NORMAL;
+        }
+        return;
+    }
+
+    /* ANSI_CSI */
+    if (c >= '0' && c <= '9') {
+        if (out->num_params == 0) {
+            out->num_params = 1;
+        }
+        if (out->num_params <= ANSI_MAX_PARAMS) {
+            unsigned int *p = &out->params[out->num_params - 1];
+            *p = *p * 10 + (c - '0');
+        }
+    } else if (c == ';') {
+        if (out->num_params == 0) {
+            out->num_params = 1;
+        }
+        if (out->num_params <= ANSI_MAX_PARAMS) {
+            out->num_params++;
+        }
+    } else if (c >= 0x40 && c <= 0x7E) {
+        if (out->num_params > ANSI_MAX_PARAMS) {
+            out->num_params = ANSI_MAX_PARAMS;
+        }
+        out->ansi_state = ANSI_NORMAL;
+        ansi_execute(c);
+    }
+    /* Anything else (such as '?') is ignored */
 }
 
 /** fb_putc:
@@ -79,30 +557,87 @@ void fb_scroll(void)
  */
 void fb_putc(char c)
 {
-    if (c == '\n') {
+    /* Mirror console output to COM1 for headless use; sent on fb_flush */
+    serial_write_char(c);
+    
+    if (out->ansi_state != ANSI_NORMAL) {
+        ansi_feed(c);
+        return;
+    }
+    
+    if (c == '\033') {
+        /* Start of an escape sequence */
+        out->ansi_state = ANSI_ESCAPE;
+    } else if (c == '\n') {
         /* Move to next line */
-        cursor_pos = (cursor_pos / FB_WIDTH + 1) * FB_WIDTH;
+        out->cursor_pos = (out->cursor_pos / FB_WIDTH + 1) * FB_WIDTH;
+    } else if (c == '\r') {
+        /* Back to the start of the line */
+        out->cursor_pos -= out->cursor_pos % FB_WIDTH;
     } else if (c == '\b') {
         /* Backspace */
-        if (cursor_pos > 0) {
-            cursor_pos--;
-            fb_write_cell(cursor_pos * 2, ' ', FB_WHITE, FB_BLACK);
+        if (out->cursor_pos > 0) {
+            out->cursor_pos--;
+            fb_write_cell(out->cursor_pos * 2, ' ',
+                          out->attr & 0x0F, out->attr >> 4);
         }
     } else if (c == '\t') {
         /* Tab - move to next multiple of 8 */
-        cursor_pos = (cursor_pos + 8) & ~7;
+        out->cursor_pos = (out->cursor_pos + 8) & ~7;
     } else {
         /* Regular character */
-        fb_write_cell(cursor_pos * 2, c, FB_WHITE, FB_BLACK);
-        cursor_pos++;
+        fb_write_cell(out->cursor_pos * 2, c, out->attr & 0x0F, out->attr >> 4);
+        out->cursor_pos++;
     }
     
     /* Scroll if needed */
-    if (cursor_pos >= FB_WIDTH * FB_HEIGHT) {
+    if (out->cursor_pos >= FB_WIDTH * FB_HEIGHT) {
         fb_scroll();
     }
-    
-    fb_move_cursor(cursor_pos);
+}
+
+/** put_number:
+ *  Writes a decimal number through fb_putc
+ */
+static void put_number(unsigned int num)
+{
+    char digits[12];
+
+    uint_to_str(num, digits);
+    fb_puts(digits);
+}
+
+/** fb_goto */
+void fb_goto(unsigned int x, unsigned int y)
+{
+    fb_puts("\033[");
+    put_number(y + 1);
+    fb_putc(';');
+    put_number(x + 1);
+    fb_putc('H');
+}
+
+/** fb_set_color */
+void fb_set_color(unsigned char fg, unsigned char bg)
+{
+    /* VGA to ANSI is the same table read backwards */
+    unsigned int ansi_fg = 0, ansi_bg = 0;
+    unsigned int i;
+
+    for (i = 0; i < 8; i++) {
+        if (ansi_colors[i] == (fg & 0x07)) {
+            ansi_fg = i;
+        }
+        if (ansi_colors[i] == (bg & 0x07)) {
+            ansi_bg = i;
+        }
+    }
+
+    fb_puts("\033[");
+    put_number((fg & 0x08) ? 90 + ansi_fg : 30 + ansi_fg);
+    fb_putc(';');
+    put_number(40 + ansi_bg);
+    fb_putc('m');
 }
 
 /** fb_puts:
@@ -9,6 +9,12 @@
 #define FB_HIGH_BYTE_COMMAND    14
 #define FB_LOW_BYTE_COMMAND     15
 
+/* Virtual consoles, each with this many lines of screen plus scrollback
+ * (a power of two)
+ */
+#define FB_NUM_CONSOLES         4
+#define FB_SCROLLBACK_LINES     2048
+
 /* Colors */
 #define FB_BLACK        0
 #define FB_BLUE         1
@@ -49,7 +55,12 @@ void fb_write_char(char c);
 void fb_clear(void);
 
 /** fb_putc:
- *  Writes a character to the screen with newline handling.
+ *  Writes a character to the screen with newline handling. The character
+ *  is mirrored to the serial console.
+ *
+ *  ANSI CSI escape sequences are interpreted: colors and brightness
+ *  (ESC [ ... m), cursor position (H, f) and moves (A, B, C, D), screen
+ *  and line erase (J, K), and cursor save / restore (s, u).
  *
  *  @param c  The character to write
  */
@@ -62,4 +73,77 @@ void fb_putc(char c);
  */
 void fb_puts(char *str);
 
+/** fb_put_cell:
+ *  Writes a character with the given colors at a screen position,
+ *  without moving the cursor.
+ *
+ *  @param x   The column
+ *  @param y   The row
+ *  @param c   The character
+ *  @param fg  The foreground color
+ *  @param bg  The background color
+ */
+void fb_put_cell(unsigned int x, unsigned int y, char c,
+                 unsigned char fg, unsigned char bg);
+
+/** fb_goto:
+ *  Moves the cursor, by writing an ESC [ y;x H sequence
+ *
+ *  @param x  The column, from 0
+ *  @param y  The row, from 0
+ */
+void fb_goto(unsigned int x, unsigned int y);
+
+/** fb_set_color:
+ *  Sets the colors of the text written next, by writing an SGR sequence
+ *
+ *  @param fg  The foreground color, FB_BLACK to FB_WHITE
+ *  @param bg  The background color, FB_BLACK to FB_LIGHT_GREY
+ */
+void fb_set_color(unsigned char fg, unsigned char bg);
+
+/** fb_flush:
+ *  Copies the rows changed since the last flush to VGA memory and moves
+ *  the hardware cursor. Output is drawn into a RAM copy of the screen
+ *  and only becomes visible here. Also starts sending the COM1 mirror of
+ *  the output (serial_flush).
+ */
+void fb_flush(void);
+
+/** fb_init:
+ *  Blanks the virtual consoles and shows console 0
+ */
+void fb_init(void);
+
+/** fb_console_select:
+ *  Sends all further output to a virtual console and shows it. Programs
+ *  with their own screen use this instead of drawing over the shell.
+ *
+ *  @param n  The console number
+ */
+void fb_console_select(unsigned int n);
+
+/** fb_console_show:
+ *  Shows a virtual console without redirecting output (Alt+Fn)
+ *
+ *  @param n  The console number
+ */
+void fb_console_show(unsigned int n);
+
+/** fb_console_get:
+ *  Gets the console receiving output
+ *
+ *  @return The console number
+ */
+unsigned int fb_console_get(void);
+
+/** fb_scroll_view:
+ *  Scrolls the visible console through its scrollback. Output to that
+ *  console jumps back to the live screen.
+ *
+ *  @param lines  Lines to move back into history, negative to move
+ *                towards the live screen
+ */
+void fb_scroll_view(int lines);
+
 #endif /* INCLUDE_FB_H */
\ No newline at end of file
@@ -5,44 +5,89 @@
 #include "filemanager.h"
 #include "filesystem.h"
 #include "fb.h"
+#include "shell.h"
+#include "kstring.h"
 
-/** Helper: Build full path from current directory and argument */
-static void build_full_path(const char *current_dir, const char *arg, char *result)
+/** Helper: Build full path, printing an error if memory ran out */
+static char *full_path(char *cmd, const char *current_dir, const char *arg)
 {
-    int i = 0;
+    char *path = shell_build_path(current_dir, arg);
     
-    if (arg[0] == '/') {
-        /* Absolute path */
-        while (arg[i] && i < 255) {
-            result[i] = arg[i];
-            i++;
-        }
-        result[i] = '\0';
-    } else {
-        /* Relative path */
-        const char *dir = current_dir;
-        while (*dir && i < 200) {
-            result[i++] = *dir++;
-        }
-        
-        /* Add slash if not root */
-        if (i > 0 && result[i-1] != '/') {
-            result[i++] = '/';
-        }
-        
-        /* Add argument */
-        int j = 0;
-        while (arg[j] && i < 255) {
-            result[i++] = arg[j++];
-        }
-        result[i] = '\0';
+    if (!path) {
+        fb_puts(cmd);
+        fb_puts(": out of memory\n");
     }
+    return path;
+}
+
+/** Helper: Split "<source> <destination>" into two strings
+ *  Returns 0 when both are present
+ */
+static int split_two_args(char *cmd, const char *args, char **source, char **dest)
+{
+    int len = strlen(args);
+    int i = 0, j;
+    
+    *source = shell_alloc(len + 1);
+    *dest = shell_alloc(len + 1);
+    if (!*source || !*dest) {
+        fb_puts(cmd);
+        fb_puts(": out of memory\n");
+        return -1;
+    }
+    
+    /* Skip leading spaces */
+    while (args[i] == ' ') i++;
+    
+    /* Get source */
+    j = 0;
+    while (args[i] && args[i] != ' ') {
+        (*source)[j++] = args[i++];
+    }
+    (*source)[j] = '\0';
+    
+    /* Skip spaces */
+    while (args[i] == ' ') i++;
+    
+    /* Get destination */
+    j = 0;
+    while (args[i]) {
+        (*dest)[j++] = args[i++];
+    }
+    (*dest)[j] = '\0';
+    
+    if ((*source)[0] == '\0' || (*dest)[0] == '\0') {
+        fb_puts("Usage: ");
+        fb_puts(cmd);
+        fb_puts(" <source> <destination>\n");
+        return -1;
+    }
+    return 0;
+}
+
+/** Helper: Read a whole file into shell memory
+ *  Returns the number of bytes, -1 on error
+ */
+static int read_whole_file(const char *path, char **content)
+{
+    int size = fs_get_size(path);
+    
+    if (size < 0) {
+        return -1;
+    }
+    
+    /* At least one byte so an empty file still gets a buffer */
+    *content = shell_alloc(size + 1);
+    if (!*content) {
+        return -1;
+    }
+    return fs_read(path, *content, size);
 }
 
 /** mkdir_command */
 void mkdir_command(char *args, const char *current_dir)
 {
-    char fullpath[256];
+    char *fullpath;
     
     if (args[0] == '\0') {
         fb_puts("Usage: mkdir <directory>\n");
@@ -51,7 +96,10 @@ void mkdir_command(char *args, const char *current_dir)
     }
     
     /* Build full path */
-    build_full_path(current_dir, args, fullpath);
+    fullpath = full_path("mkdir", current_dir, args);
+    if (!fullpath) {
+        return;
+    }
     
     /* Check if already exists */
     if (fs_exists(fullpath)) {
@@ -76,7 +124,7 @@ void mkdir_command(char *args, const char *current_dir)
 /** rmdir_command */
 void rmdir_command(char *args, const char *current_dir)
 {
-    char fullpath[256];
+    char *fullpath;
     
     if (args[0] == '\0') {
         fb_puts("Usage: rmdir <directory>\n");
@@ -85,7 +133,10 @@ void rmdir_command(char *args, const char *current_dir)
     }
     
     /* Build full path */
-    build_full_path(current_dir, args, fullpath);
+    fullpath = full_path("rmdir", current_dir, args);
+    if (!fullpath) {
+        return;
+    }
     
     /* Check if exists and is directory */
     if (!fs_exists(fullpath)) {
@@ -117,7 +168,7 @@ void rmdir_command(char *args, const char *current_dir)
 /** rm_command */
 void rm_command(char *args, const char *current_dir)
 {
-    char fullpath[256];
+    char *fullpath;
     
     if (args[0] == '\0') {
         fb_puts("Usage: rm <file>\n");
@@ -126,7 +177,10 @@ void rm_command(char *args, const char *current_dir)
     }
     
     /* Build full path */
-    build_full_path(current_dir, args, fullpath);
+    fullpath = full_path("rm", current_dir, args);
+    if (!fullpath) {
+        return;
+    }
     
     /* Check if exists */
     if (!fs_exists(fullpath)) {
@@ -159,10 +213,10 @@ void rm_command(char *args, const char *current_dir)
 /** mv_command */
 void mv_command(char *args, const char *current_dir)
 {
-    char source[256], dest[256];
-    char content[2048];
+    char *source, *dest;
+    char *source_path, *dest_path;
+    char *content;
     int bytes_read;
-    int i = 0, j = 0;
     
     if (args[0] == '\0') {
         fb_puts("Usage: mv <source> <destination>\n");
@@ -170,36 +224,16 @@ void mv_command(char *args, const char *current_dir)
         return;
     }
     
-    /* Parse source and destination */
-    /* Skip leading spaces */
-    while (args[i] == ' ') i++;
-    
-    /* Get source */
-    j = 0;
-    while (args[i] && args[i] != ' ' && j < 200) {
-        source[j++] = args[i++];
-    }
-    source[j] = '\0';
-    
-    /* Skip spaces */
-    while (args[i] == ' ') i++;
-    
-    /* Get destination */
-    j = 0;
-    while (args[i] && j < 200) {
-        dest[j++] = args[i++];
-    }
-    dest[j] = '\0';
-    
-    if (source[0] == '\0' || dest[0] == '\0') {
-        fb_puts("Usage: mv <source> <destination>\n");
+    if (split_two_args("mv", args, &source, &dest) != 0) {
         return;
     }
     
     /* Build full paths */
-    char source_path[256], dest_path[256];
-    build_full_path(current_dir, source, source_path);
-    build_full_path(current_dir, dest, dest_path);
+    source_path = full_path("mv", current_dir, source);
+    dest_path = full_path("mv", current_dir, dest);
+    if (!source_path || !dest_path) {
+        return;
+    }
     
     /* Check if source exists */
     if (!fs_exists(source_path)) {
@@ -235,7 +269,7 @@ void mv_command(char *args, const char *current_dir)
     }
     
     /* For files: read, write to new location, delete old */
-    bytes_read = fs_read(source_path, content, sizeof(content));
+    bytes_read = read_whole_file(source_path, &content);
     
     if (bytes_read < 0) {
         fb_puts("mv: failed to read '");
@@ -265,10 +299,10 @@ void mv_command(char *args, const char *current_dir)
 /** cp_command */
 void cp_command(char *args, const char *current_dir)
 {
-    char source[256], dest[256];
-    char content[2048];
+    char *source, *dest;
+    char *source_path, *dest_path;
+    char *content;
     int bytes_read;
-    int i = 0, j = 0;
     
     if (args[0] == '\0') {
         fb_puts("Usage: cp <source> <destination>\n");
@@ -276,32 +310,16 @@ void cp_command(char *args, const char *current_dir)
         return;
     }
     
-    /* Parse source and destination */
-    while (args[i] == ' ') i++;
-    
-    j = 0;
-    while (args[i] && args[i] != ' ' && j < 200) {
-        source[j++] = args[i++];
-    }
-    source[j] = '\0';
-    
-    while (args[i] == ' ') i++;
-    
-    j = 0;
-    while (args[i] && j < 200) {
-        dest[j++] = args[i++];
-    }
-    dest[j] = '\0';
-    
-    if (source[0] == '\0' || dest[0] == '\0') {
-        fb_puts("Usage: cp <source> <destination>\n");
+    if (split_two_args("cp", args, &source, &dest) != 0) {
         return;
     }
     
     /* Build full paths */
-    char source_path[256], dest_path[256];
-    build_full_path(current_dir, source, source_path);
-    build_full_path(current_dir, dest, dest_path);
+    source_path = full_path("cp", current_dir, source);
+    dest_path = full_path("cp", current_dir, dest);
+    if (!source_path || !dest_path) {
+        return;
+    }
     
     /* Check if source exists */
     if (!fs_exists(source_path)) {
@@ -320,7 +338,7 @@ void cp_command(char *args, const char *current_dir)
     }
     
     /* Read source file */
-    bytes_read = fs_read(source_path, content, sizeof(content));
+    bytes_read = read_whole_file(source_path, &content);
     
     if (bytes_read < 0) {
         fb_puts("cp: failed to read '");
@@ -347,7 +365,7 @@ void cp_command(char *args, const char *current_dir)
 /** touch_command */
 void touch_command(char *args, const char *current_dir)
 {
-    char fullpath[256];
+    char *fullpath;
     
     if (args[0] == '\0') {
         fb_puts("Usage: touch <filename>\n");
@@ -356,7 +374,10 @@ void touch_command(char *args, const char *current_dir)
     }
     
     /* Build full path */
-    build_full_path(current_dir, args, fullpath);
+    fullpath = full_path("touch", current_dir, args);
+    if (!fullpath) {
+        return;
+    }
     
     /* Check if already exists */
     if (fs_exists(fullpath)) {
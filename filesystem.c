@@ -1,44 +1,65 @@
 #include "filesystem.h"
+#include "memory.h"
+#include "kstring.h"
+#include "slab.h"
+#include "pmm.h"
+#include "paging.h"
+#include "thread.h"
+#include "spinlock.h"
 
-/* Global file table */
-static struct file file_table[MAX_FILES];
+/** A file mapped by fs_mmap */
+struct fs_mapping {
+    struct file *file;
+    unsigned int *dir;
+    unsigned int addr;
+    unsigned int pages;
+    int flags;
+    struct fs_mapping *next;
+};
 
-/** Helper: string comparison */
-static int fs_strcmp(const char *s1, const char *s2)
-{
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char *)s1 - *(unsigned char *)s2;
-}
+/* All files and directories, in creation order */
+static struct file *file_list = 0;
+
+/* Entries come from their own slab cache, contents from kmalloc until
+ * the file is first mapped, then from whole frames
+ */
+static struct kmem_cache file_cache;
+
+static struct fs_mapping *mapping_list = 0;
+
+/* Unmapped windows of the vmap area, reused by size */
+static struct fs_mapping *free_windows = 0;
 
-/** Helper: string copy */
-static void fs_strcpy(char *dest, const char *src, int max_len)
+/* Totals over all entries, for fs_get_usage */
+static unsigned int file_count = 0;
+static unsigned int data_bytes = 0;
+static unsigned int alloc_bytes = 0;
+
+static struct spinlock fs_spinlock;
+
+/** Helper: keep other threads out of the file list. The public
+ *  functions hold it throughout; the static helpers assume it is held.
+ *  The holder isn't preempted, so threads on other processors only
+ *  spin for as long as one operation takes.
+ */
+static void fs_lock(void)
 {
-    int i = 0;
-    while (src[i] != '\0' && i < max_len - 1) {
-        dest[i] = src[i];
-        i++;
-    }
-    dest[i] = '\0';
+    preempt_disable();
+    spin_lock(&fs_spinlock);
 }
 
-/** Helper: string length */
-static int fs_strlen(const char *str)
+/** Helper: release fs_lock */
+static void fs_unlock(void)
 {
-    int len = 0;
-    while (str[len] != '\0') {
-        len++;
-    }
-    return len;
+    spin_unlock(&fs_spinlock);
+    preempt_enable();
 }
 
 /** Helper: extract directory and filename from path */
 static void fs_split_path(const char *filepath, char *directory, char *filename)
 {
     int i, last_slash = -1;
-    int len = fs_strlen(filepath);
+    int len = strlen(filepath);
     
     /* Find last slash */
     for (i = len - 1; i >= 0; i--) {
@@ -50,36 +71,133 @@ static void fs_split_path(const char *filepath, char *directory, char *filename)
     
     if (last_slash == -1) {
         /* No directory, just filename */
-        fs_strcpy(directory, "/", MAX_FILENAME);
-        fs_strcpy(filename, filepath, MAX_FILENAME);
+        strlcpy(directory, "/", MAX_FILENAME);
+        strlcpy(filename, filepath, MAX_FILENAME);
     } else if (last_slash == 0) {
         /* Root directory */
-        fs_strcpy(directory, "/", MAX_FILENAME);
-        fs_strcpy(filename, filepath + 1, MAX_FILENAME);
+        strlcpy(directory, "/", MAX_FILENAME);
+        strlcpy(filename, filepath + 1, MAX_FILENAME);
     } else {
         /* Copy directory part */
-        int j;
-        for (j = 0; j < last_slash && j < MAX_FILENAME - 1; j++) {
-            directory[j] = filepath[j];
-        }
-        directory[j] = '\0';
+        int dir_len = last_slash < MAX_FILENAME - 1 ? last_slash : MAX_FILENAME - 1;
+        memcpy(directory, filepath, dir_len);
+        directory[dir_len] = '\0';
         
         /* Copy filename part */
-        fs_strcpy(filename, filepath + last_slash + 1, MAX_FILENAME);
+        strlcpy(filename, filepath + last_slash + 1, MAX_FILENAME);
+    }
+}
+
+/** Helper: find an entry by its split path */
+static struct file *fs_find(const char *directory, const char *filename)
+{
+    struct file *f;
+    
+    for (f = file_list; f; f = f->next) {
+        if (strcmp(f->filename, filename) == 0 &&
+            strcmp(f->directory, directory) == 0) {
+            return f;
+        }
+    }
+    
+    return 0;
+}
+
+/** Helper: allocate an empty, unlinked entry */
+static struct file *fs_new_entry(const char *directory, const char *filename)
+{
+    struct file *f = kmem_cache_alloc(&file_cache);
+    
+    if (!f) {
+        return 0;
     }
+    
+    strlcpy(f->filename, filename, MAX_FILENAME);
+    strlcpy(f->directory, directory, MAX_FILENAME);
+    f->content = 0;
+    f->size = 0;
+    f->frames = 0;
+    f->map_count = 0;
+    f->is_directory = 0;
+    f->next = 0;
+    return f;
+}
+
+/** Helper: append an entry to the list so listings keep creation order */
+static void fs_link(struct file *f)
+{
+    struct file **link = &file_list;
+    
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = f;
+}
+
+/** Helper: the memory backing an entry's content */
+static unsigned int fs_content_alloc(struct file *f)
+{
+    return f->frames ? f->frames * PAGE_SIZE : ksize(f->content);
+}
+
+/** Helper: free an entry's content */
+static void fs_free_content(struct file *f)
+{
+    data_bytes -= f->size;
+    alloc_bytes -= fs_content_alloc(f);
+    if (f->frames) {
+        pmm_free_frames(virt_to_phys(f->content), f->frames);
+    } else {
+        kfree(f->content);
+    }
+    f->content = 0;
+    f->size = 0;
+    f->frames = 0;
+}
+
+/** Helper: replace an entry's content with a copy of the given bytes */
+static int fs_set_content(struct file *f, const char *content, int size)
+{
+    int copy_size = size < MAX_FILE_CONTENT ? size : MAX_FILE_CONTENT;
+    char *data = 0;
+    
+    if (copy_size < 0) {
+        copy_size = 0;
+    }
+    
+    /* Page-backed content is rewritten in place so mappings see it */
+    if (f->frames && (unsigned int)copy_size <= f->frames * PAGE_SIZE) {
+        memmove(f->content, content, copy_size);
+        memset(f->content + copy_size, 0, f->frames * PAGE_SIZE - copy_size);
+        data_bytes += copy_size - f->size;
+        f->size = copy_size;
+        return 0;
+    }
+    if (f->map_count) {
+        return -1;
+    }
+    
+    if (copy_size > 0) {
+        data = kmalloc(copy_size);
+        if (!data) {
+            return -1;
+        }
+        memcpy(data, content, copy_size);
+    }
+    
+    fs_free_content(f);
+    f->content = data;
+    f->size = copy_size;
+    data_bytes += copy_size;
+    alloc_bytes += ksize(data);
+    return 0;
 }
 
 /** fs_init */
 void fs_init(void)
 {
-    int i;
-    for (i = 0; i < MAX_FILES; i++) {
-        file_table[i].in_use = 0;
-        file_table[i].filename[0] = '\0';
-        file_table[i].directory[0] = '\0';
-        file_table[i].size = 0;
-        file_table[i].is_directory = 0;
-    }
+    file_list = 0;
+    kmem_cache_init(&file_cache, "file", sizeof(struct file));
 }
 
 /** fs_create */
@@ -87,49 +205,37 @@ int fs_create(const char *filepath, const char *content, int size)
 {
     char directory[MAX_FILENAME];
     char filename[MAX_FILENAME];
-    int i;
+    struct file *f;
     
     /* Split path */
     fs_split_path(filepath, directory, filename);
     
-    /* Check if file already exists - if so, update it */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, filename) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            /* Update existing file */
-            int copy_size = size < MAX_FILE_CONTENT ? size : MAX_FILE_CONTENT;
-            int j;
-            for (j = 0; j < copy_size; j++) {
-                file_table[i].content[j] = content[j];
-            }
-            file_table[i].size = copy_size;
-            return 0;
-        }
+    fs_lock();
+    
+    /* Update the file if it already exists */
+    f = fs_find(directory, filename);
+    if (f) {
+        int ret = fs_set_content(f, content, size);
+        fs_unlock();
+        return ret;
     }
     
-    /* Find empty slot */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (!file_table[i].in_use) {
-            file_table[i].in_use = 1;
-            fs_strcpy(file_table[i].filename, filename, MAX_FILENAME);
-            fs_strcpy(file_table[i].directory, directory, MAX_FILENAME);
-            
-            /* Copy content */
-            int copy_size = size < MAX_FILE_CONTENT ? size : MAX_FILE_CONTENT;
-            int j;
-            for (j = 0; j < copy_size; j++) {
-                file_table[i].content[j] = content[j];
-            }
-            file_table[i].size = copy_size;
-            
-            return 0;
-        }
+    f = fs_new_entry(directory, filename);
+    if (!f) {
+        fs_unlock();
+        return -1;
     }
     
-    /* No space */
-    return -1;
+    if (fs_set_content(f, content, size) < 0) {
+        kmem_cache_free(&file_cache, f);
+        fs_unlock();
+        return -1;
+    }
+    
+    fs_link(f);
+    file_count++;
+    fs_unlock();
+    return 0;
 }
 
 /** fs_read */
@@ -137,31 +243,42 @@ int fs_read(const char *filepath, char *buffer, int max_size)
 {
     char directory[MAX_FILENAME];
     char filename[MAX_FILENAME];
-    int i;
+    struct file *f;
     
     /* Split path */
     fs_split_path(filepath, directory, filename);
     
-    /* Find file */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, filename) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            /* Copy content */
-            int copy_size = file_table[i].size < max_size ? 
-                           file_table[i].size : max_size;
-            int j;
-            for (j = 0; j < copy_size; j++) {
-                buffer[j] = file_table[i].content[j];
-            }
-            
-            return copy_size;
-        }
+    fs_lock();
+    f = fs_find(directory, filename);
+    if (!f) {
+        fs_unlock();
+        return -1;
     }
     
-    /* File not found */
-    return -1;
+    /* Copy content */
+    int copy_size = f->size < max_size ? f->size : max_size;
+    memcpy(buffer, f->content, copy_size);
+    
+    fs_unlock();
+    return copy_size;
+}
+
+/** fs_get_size */
+int fs_get_size(const char *filepath)
+{
+    char directory[MAX_FILENAME];
+    char filename[MAX_FILENAME];
+    struct file *f;
+    int size;
+    
+    /* Split path */
+    fs_split_path(filepath, directory, filename);
+    
+    fs_lock();
+    f = fs_find(directory, filename);
+    size = f ? f->size : -1;
+    fs_unlock();
+    return size;
 }
 
 /** fs_delete */
@@ -169,23 +286,36 @@ int fs_delete(const char *filepath)
 {
     char directory[MAX_FILENAME];
     char filename[MAX_FILENAME];
-    int i;
+    struct file **link;
     
     /* Split path */
     fs_split_path(filepath, directory, filename);
     
-    /* Find and delete file */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, filename) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            file_table[i].in_use = 0;
+    fs_lock();
+    
+    /* Find, unlink and free the entry */
+    for (link = &file_list; *link; link = &(*link)->next) {
+        struct file *f = *link;
+        
+        if (strcmp(f->filename, filename) == 0 &&
+            strcmp(f->directory, directory) == 0) {
+            if (f->map_count) {
+                fs_unlock();
+                return -1;  /* Still mapped */
+            }
+            *link = f->next;
+            if (!f->is_directory) {
+                file_count--;
+            }
+            fs_free_content(f);
+            kmem_cache_free(&file_cache, f);
+            fs_unlock();
             return 0;
         }
     }
     
     /* File not found */
+    fs_unlock();
     return -1;
 }
 
@@ -194,38 +324,33 @@ int fs_exists(const char *filepath)
 {
     char directory[MAX_FILENAME];
     char filename[MAX_FILENAME];
-    int i;
+    int exists;
     
     /* Split path */
     fs_split_path(filepath, directory, filename);
     
-    /* Find file */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, filename) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            return 1;
-        }
-    }
-    
-    return 0;
+    fs_lock();
+    exists = fs_find(directory, filename) != 0;
+    fs_unlock();
+    return exists;
 }
 
 /** fs_list_directory */
 void fs_list_directory(const char *directory, void (*callback)(const char *filename))
 {
-    int i;
-    
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            if (callback) {
-                callback(file_table[i].filename);
-            }
+    struct file *f;
+    
+    if (!callback) {
+        return;
+    }
+    
+    fs_lock();
+    for (f = file_list; f; f = f->next) {
+        if (strcmp(f->directory, directory) == 0) {
+            callback(f->filename);
         }
     }
+    fs_unlock();
 }
 
 /** fs_mkdir */
@@ -233,33 +358,29 @@ int fs_mkdir(const char *dirpath)
 {
     char directory[MAX_FILENAME];
     char dirname[MAX_FILENAME];
-    int i;
+    struct file *f;
     
     /* Split path */
     fs_split_path(dirpath, directory, dirname);
     
+    fs_lock();
+    
     /* Check if already exists */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, dirname) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            return 0;  /* Already exists */
-        }
+    if (fs_find(directory, dirname)) {
+        fs_unlock();
+        return 0;
     }
     
-    /* Find empty slot */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (!file_table[i].in_use) {
-            file_table[i].in_use = 1;
-            file_table[i].is_directory = 1;
-            fs_strcpy(file_table[i].filename, dirname, MAX_FILENAME);
-            fs_strcpy(file_table[i].directory, directory, MAX_FILENAME);
-            file_table[i].size = 0;
-            return 0;
-        }
+    f = fs_new_entry(directory, dirname);
+    if (!f) {
+        fs_unlock();
+        return -1;  /* Out of memory */
     }
+    f->is_directory = 1;
+    fs_link(f);
     
-    return -1;  /* No space */
+    fs_unlock();
+    return 0;
 }
 
 /** fs_is_directory */
@@ -267,22 +388,285 @@ int fs_is_directory(const char *filepath)
 {
     char directory[MAX_FILENAME];
     char filename[MAX_FILENAME];
-    int i;
+    struct file *f;
+    int is_directory;
     
     /* Split path */
     fs_split_path(filepath, directory, filename);
     
-    /* Find entry */
-    for (i = 0; i < MAX_FILES; i++) {
-        if (file_table[i].in_use &&
-            fs_strcmp(file_table[i].filename, filename) == 0 &&
-            fs_strcmp(file_table[i].directory, directory) == 0) {
-            
-            return file_table[i].is_directory;
-        }
+    fs_lock();
+    f = fs_find(directory, filename);
+    is_directory = f ? f->is_directory : 0;
+    fs_unlock();
+    return is_directory;
+}
+
+/** fs_get_usage */
+void fs_get_usage(unsigned int *files, unsigned int *bytes, unsigned int *allocated)
+{
+    *files = file_count;
+    *bytes = data_bytes;
+    *allocated = alloc_bytes;
+}
+
+/** fs_truncate */
+int fs_truncate(const char *filepath, int size)
+{
+    char directory[MAX_FILENAME];
+    char filename[MAX_FILENAME];
+    struct file *f;
+    char *data;
+    int ret;
+    
+    /* Split path */
+    fs_split_path(filepath, directory, filename);
+    
+    fs_lock();
+    f = fs_find(directory, filename);
+    if (!f || f->is_directory || size < 0 || size > MAX_FILE_CONTENT) {
+        fs_unlock();
+        return -1;
+    }
+    
+    /* Frames past the end are kept zeroed, so growing needs no copy */
+    if (f->frames) {
+        memset(f->content + size, 0, f->frames * PAGE_SIZE - size);
+        data_bytes += size - f->size;
+        f->size = size;
+        fs_unlock();
+        return 0;
+    }
+    
+    data = kmalloc(size > 0 ? size : 1);
+    if (!data) {
+        fs_unlock();
+        return -1;
+    }
+    memset(data, 0, size);
+    memcpy(data, f->content, f->size < size ? f->size : size);
+    ret = fs_set_content(f, data, size);
+    kfree(data);
+    fs_unlock();
+    return ret;
+}
+
+/** Helper: move an entry's content to whole, zero-padded frames */
+static int fs_make_paged(struct file *f)
+{
+    unsigned int frames = (f->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned int phys;
+    char *data;
+    int size = f->size;
+    
+    if (f->frames) {
+        return 0;
+    }
+    if (frames == 0) {
+        frames = 1;
+    }
+    
+    phys = pmm_alloc_frames(frames);
+    if (phys == 0) {
+        return -1;
     }
+    data = phys_to_virt(phys);
+    memset(data, 0, frames * PAGE_SIZE);
+    memcpy(data, f->content, size);
     
+    fs_free_content(f);
+    f->content = data;
+    f->size = size;
+    f->frames = frames;
+    data_bytes += size;
+    alloc_bytes += frames * PAGE_SIZE;
     return 0;
 }
 
-/** fs_delete */
\ No newline at end of file
+/** Helper: find the mapping starting at an address */
+static struct fs_mapping **fs_find_mapping(unsigned int addr)
+{
+    struct fs_mapping **link;
+    
+    for (link = &mapping_list; *link; link = &(*link)->next) {
+        if ((*link)->addr == addr) {
+            return link;
+        }
+    }
+    return 0;
+}
+
+/** Helper: remove the page table entries of a mapping */
+static void fs_unmap_pages(struct fs_mapping *m, unsigned int pages)
+{
+    unsigned int i;
+    
+    for (i = 0; i < pages; i++) {
+        paging_unmap_page(m->dir, m->addr + i * PAGE_SIZE);
+    }
+}
+
+/** Helper: release a mapping record, keeping kernel windows for reuse */
+static void fs_release_mapping(struct fs_mapping *m)
+{
+    if (m->addr >= KERNEL_VIRTUAL_BASE) {
+        m->next = free_windows;
+        free_windows = m;
+    } else {
+        kfree(m);
+    }
+}
+
+/** Helper: the body of fs_mmap, for the entry found */
+static void *fs_map(struct file *f, unsigned int *dir, unsigned int addr, int flags)
+{
+    struct fs_mapping *m = 0;
+    struct fs_mapping **link;
+    unsigned int page_flags = 0;
+    unsigned int phys;
+    unsigned int i;
+    
+    if (!f || f->is_directory || fs_make_paged(f) < 0) {
+        return 0;
+    }
+    
+    if (addr == 0) {
+        /* A window in the shared kernel half */
+        if (dir != paging_kernel_directory()) {
+            return 0;
+        }
+        for (link = &free_windows; *link; link = &(*link)->next) {
+            if ((*link)->pages == f->frames) {
+                m = *link;
+                *link = m->next;
+                break;
+            }
+        }
+        if (!m) {
+            addr = paging_vmap_reserve(f->frames * PAGE_SIZE);
+            if (addr == 0) {
+                return 0;
+            }
+        }
+    } else if ((addr & (PAGE_SIZE - 1)) ||
+               addr + f->frames * PAGE_SIZE > KERNEL_VIRTUAL_BASE) {
+        return 0;
+    } else {
+        page_flags |= PAGE_USER;
+    }
+    
+    if (!m) {
+        m = kmalloc(sizeof(*m));
+        if (!m) {
+            return 0;
+        }
+        m->addr = addr;
+        m->pages = f->frames;
+    }
+    m->file = f;
+    m->dir = dir;
+    m->flags = flags;
+    
+    if (flags & FS_MAP_SHARED) {
+        page_flags |= PAGE_WRITE;
+    }
+    
+    phys = virt_to_phys(f->content);
+    for (i = 0; i < m->pages; i++) {
+        if (paging_map_page(dir, m->addr + i * PAGE_SIZE,
+                            phys + i * PAGE_SIZE, page_flags) < 0) {
+            fs_unmap_pages(m, i);
+            paging_shootdown(dir, m->addr, i);
+            fs_release_mapping(m);
+            return 0;
+        }
+    }
+    
+    f->map_count++;
+    m->next = mapping_list;
+    mapping_list = m;
+    return (void *)m->addr;
+}
+
+/** fs_mmap */
+void *fs_mmap(unsigned int *dir, unsigned int addr, const char *filepath, int flags)
+{
+    char directory[MAX_FILENAME];
+    char filename[MAX_FILENAME];
+    void *mapped;
+    
+    /* Split path */
+    fs_split_path(filepath, directory, filename);
+    
+    fs_lock();
+    mapped = fs_map(fs_find(directory, filename), dir, addr, flags);
+    fs_unlock();
+    return mapped;
+}
+
+/** Helper: count and clear the pages of a mapping written since the last sync */
+static int fs_sync_mapping(struct fs_mapping *m)
+{
+    unsigned int i;
+    int dirty = 0;
+    
+    for (i = 0; i < m->pages; i++) {
+        dirty += paging_test_and_clear_dirty(m->dir, m->addr + i * PAGE_SIZE);
+    }
+    return dirty;
+}
+
+/** fs_msync */
+int fs_msync(void *addr)
+{
+    struct fs_mapping **link;
+    unsigned int *dir;
+    unsigned int pages;
+    int dirty;
+    
+    fs_lock();
+    link = fs_find_mapping((unsigned int)addr);
+    if (!link) {
+        fs_unlock();
+        return -1;
+    }
+    
+    dirty = fs_sync_mapping(*link);
+    dir = (*link)->dir;
+    pages = (*link)->pages;
+    fs_unlock();
+    
+    /* One shootdown for the whole mapping, without holding fs_lock */
+    paging_shootdown(dir, (unsigned int)addr, pages);
+    return dirty;
+}
+
+/** fs_munmap */
+int fs_munmap(void *addr)
+{
+    struct fs_mapping **link;
+    struct fs_mapping *m;
+    int dirty;
+    
+    fs_lock();
+    link = fs_find_mapping((unsigned int)addr);
+    if (!link) {
+        fs_unlock();
+        return -1;
+    }
+    
+    m = *link;
+    dirty = fs_sync_mapping(m);
+    *link = m->next;
+    fs_unmap_pages(m, m->pages);
+    fs_unlock();
+    
+    /* Until the other processors drop the pages, the window can't be
+     * reused and the file's frames can't be freed */
+    paging_shootdown(m->dir, m->addr, m->pages);
+    
+    fs_lock();
+    m->file->map_count--;
+    fs_release_mapping(m);
+    fs_unlock();
+    return dirty;
+}
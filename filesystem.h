@@ -1,22 +1,27 @@
 #ifndef INCLUDE_FILESYSTEM_H
 #define INCLUDE_FILESYSTEM_H
 
-#define MAX_FILES 50
 #define MAX_FILENAME 64
 #define MAX_FILE_CONTENT 2048
 
+/* fs_mmap flags */
+#define FS_MAP_READ     0   /* Read-only */
+#define FS_MAP_SHARED   1   /* Writable; writes go straight to the file */
+
 /** File structure */
 struct file {
     char filename[MAX_FILENAME];
     char directory[MAX_FILENAME];
-    char content[MAX_FILE_CONTENT];
+    char *content;     /* kmalloc'd, 0 when empty; whole frames once mapped */
     int size;
-    int in_use;
+    unsigned int frames;     /* Frames backing content, 0 if kmalloc'd */
+    unsigned int map_count;  /* Live fs_mmap mappings */
     int is_directory;  /* 1 if directory, 0 if file */
+    struct file *next;
 };
 
 /** fs_init:
- *  Initialize the filesystem
+ *  Initialize the filesystem. Needs slab_init first.
  */
 void fs_init(void);
 
@@ -40,6 +45,14 @@ int fs_create(const char *filepath, const char *content, int size);
  */
 int fs_read(const char *filepath, char *buffer, int max_size);
 
+/** fs_get_size:
+ *  Get the size of a file's content
+ *
+ *  @param filepath  Full path to file
+ *  @return          Size in bytes, -1 if not found
+ */
+int fs_get_size(const char *filepath);
+
 /** fs_delete:
  *  Delete a file
  *
@@ -88,4 +101,57 @@ int fs_is_directory(const char *filepath);
  */
 int fs_delete(const char *filepath);
 
+/** fs_truncate:
+ *  Set the size of a file, cutting it or padding it with zeros. Mapped
+ *  files keep their pages, so mappings stay valid.
+ *
+ *  @param filepath  Full path of an existing file
+ *  @param size      New size, at most MAX_FILE_CONTENT
+ *  @return          0 on success, -1 on error
+ */
+int fs_truncate(const char *filepath, int size);
+
+/** fs_mmap:
+ *  Map a file's data into an address space without copying. The first
+ *  mapping moves the content to whole frames; the bytes past the end of
+ *  the file read as zero and aren't part of it. Mapped files can't be
+ *  deleted or grown past their pages.
+ *
+ *  @param dir       The page directory
+ *  @param addr      Page aligned user address, or 0 for a kernel address
+ *                   chosen in the vmap area (dir must be the kernel's)
+ *  @param filepath  Full path of the file
+ *  @param flags     FS_MAP_READ or FS_MAP_SHARED
+ *  @return          The mapped address, or 0 on error
+ */
+void *fs_mmap(unsigned int *dir, unsigned int addr, const char *filepath, int flags);
+
+/** fs_msync:
+ *  Collect the pages written through a mapping since it was made or
+ *  last synced. The data is already in the file; this clears the dirty
+ *  bits and reports them.
+ *
+ *  @param addr  The address fs_mmap returned
+ *  @return      The number of dirty pages, or -1 if addr isn't a mapping
+ */
+int fs_msync(void *addr);
+
+/** fs_munmap:
+ *  Remove a mapping made by fs_mmap
+ *
+ *  @param addr  The address fs_mmap returned
+ *  @return      The number of pages dirtied since the last fs_msync, or
+ *               -1 if addr isn't a mapping
+ */
+int fs_munmap(void *addr);
+
+/** fs_get_usage:
+ *  Get the memory held by file contents
+ *
+ *  @param files      Set to the number of files (not directories)
+ *  @param bytes      Set to the total size of their contents
+ *  @param allocated  Set to the heap memory backing the contents
+ */
+void fs_get_usage(unsigned int *files, unsigned int *bytes, unsigned int *allocated);
+
 #endif /* INCLUDE_FILESYSTEM_H */
\ No newline at end of file
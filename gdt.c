@@ -1,4 +1,5 @@
 #include "gdt.h"
+#include "smp.h"
 
 /* GDT entry structure */
 struct gdt_entry
@@ -18,43 +19,97 @@ struct gdt_ptr
     unsigned int base;
 }__attribute__((packed));
 
-/* Our GDT, with 3 entries */
-struct gdt_entry gdt[3];
-struct gdt_ptr gp;
+/* Our GDT: null, code, data, kernel TSS, double fault TSS and per-CPU
+ * data. Each processor has its own copy, since a TSS is marked busy
+ * while loaded and the per-CPU segment base differs.
+ */
+#define GDT_ENTRIES 6
+
+struct gdt_entry gdt[SMP_MAX_CPUS][GDT_ENTRIES];
+struct gdt_ptr gp[SMP_MAX_CPUS];
+
+/* TSS descriptor access byte: present, ring 0, 32-bit available TSS */
+#define GDT_ACCESS_TSS 0x89
+
+static struct tss kernel_tss[SMP_MAX_CPUS];
+static struct tss double_fault_tss[SMP_MAX_CPUS];
 
 /** gdt_set_gate:
  *  Sets a GDT gate
  *
+ *  @param table        The GDT
  *  @param num          Index of the GDT entry
  *  @param base         Base address
  *  @param limit        Limit
  *  @param access       Access flags
  *  @param granularity  Granularity
  */
-void gdt_set_gate(int num, unsigned int base, unsigned int limit, unsigned char access, unsigned char granularity)
+void gdt_set_gate(struct gdt_entry *table, int num, unsigned int base, unsigned int limit, unsigned char access, unsigned char granularity)
 {
-    gdt[num].base_low = (base & 0xFFFF);
-    gdt[num].base_middle = (base >> 16) & 0xFF;
-    gdt[num].base_high = (base >> 24) & 0xFF;
+    table[num].base_low = (base & 0xFFFF);
+    table[num].base_middle = (base >> 16) & 0xFF;
+    table[num].base_high = (base >> 24) & 0xFF;
 
-    gdt[num].limit_low = (limit & 0xFFFF);
-    gdt[num].granularity = ((limit >> 16) & 0x0F);
+    table[num].limit_low = (limit & 0xFFFF);
+    table[num].granularity = ((limit >> 16) & 0x0F);
 
-    gdt[num].granularity |= (granularity & 0xF0);
-    gdt[num].access = access;
+    table[num].granularity |= (granularity & 0xF0);
+    table[num].access = access;
 }
 
-/** gdt_install:
- *  Sets up the GDT
- */
-void gdt_install(void)
+/** gdt_install */
+void gdt_install(struct cpu *cpu)
 {
-    gp.limit = (sizeof(struct gdt_entry) * 3) - 1;
-    gp.base = (unsigned int)&gdt;
+    unsigned int n = cpu->id;
+    struct gdt_entry *table = gdt[n];
+
+    gp[n].limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    gp[n].base = (unsigned int)table;
+
+    gdt_set_gate(table, 0, 0, 0, 0, 0);                /* NULL descriptor */
+    gdt_set_gate(table, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Code segment */
+    gdt_set_gate(table, 2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Data segment */
+
+    /* No I/O permission bitmap: the base points past the limit */
+    kernel_tss[n].ss0 = GDT_KERNEL_DATA;
+    kernel_tss[n].iomap_base = sizeof(struct tss);
+    double_fault_tss[n].iomap_base = sizeof(struct tss);
+    gdt_set_gate(table, 3, (unsigned int)&kernel_tss[n], sizeof(struct tss) - 1,
+                 GDT_ACCESS_TSS, 0x00);
+    gdt_set_gate(table, 4, (unsigned int)&double_fault_tss[n], sizeof(struct tss) - 1,
+                 GDT_ACCESS_TSS, 0x00);
+
+    /* Byte-granular data segment over the struct cpu */
+    cpu->self = cpu;
+    gdt_set_gate(table, 5, (unsigned int)cpu, sizeof(struct cpu) - 1, 0x92, 0x40);
 
-    gdt_set_gate(0, 0, 0, 0, 0);                /* NULL descriptor */
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Code segment */
-    gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Data segment */
+    load_gdt(&gp[n]);
 
-    load_gdt(&gp);  // Changed from: load_gdt((unsigned int *)&gp);
-}
\ No newline at end of file
+    __asm__ volatile("ltr %0" : : "r"((unsigned short)GDT_KERNEL_TSS));
+    __asm__ volatile("mov %0, %%gs" : : "r"((unsigned short)GDT_PERCPU) : "memory");
+}
+
+/** gdt_set_double_fault_task */
+void gdt_set_double_fault_task(void (*entry)(void), unsigned int stack_top,
+                               unsigned int cr3)
+{
+    struct tss *tss = &double_fault_tss[cpu_self()->id];
+
+    tss->cr3 = cr3;
+    tss->eip = (unsigned int)entry;
+    tss->eflags = 0x2;     /* Reserved bit; interrupts off */
+    tss->esp = stack_top;
+    tss->ebp = 0;
+    tss->cs = GDT_KERNEL_CODE;
+    tss->ss = GDT_KERNEL_DATA;
+    tss->ds = GDT_KERNEL_DATA;
+    tss->es = GDT_KERNEL_DATA;
+    tss->fs = GDT_KERNEL_DATA;
+    tss->gs = GDT_PERCPU;   /* The handler can still use cpu_self */
+}
+
+/** gdt_get_kernel_tss */
+const struct tss *gdt_get_kernel_tss(void)
+{
+    return &kernel_tss[cpu_self()->id];
+}
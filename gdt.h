@@ -8,9 +8,53 @@
  */
 void load_gdt(void *gdt);
 
+/* Segment selectors */
+#define GDT_KERNEL_CODE         0x08
+#define GDT_KERNEL_DATA         0x10
+#define GDT_KERNEL_TSS          0x18
+#define GDT_DOUBLE_FAULT_TSS    0x20
+#define GDT_PERCPU              0x28    /* Base is the processor's struct cpu */
+
+struct cpu;
+
+/** 32-bit task state segment */
+struct tss {
+    unsigned int prev_tss;
+    unsigned int esp0, ss0, esp1, ss1, esp2, ss2;
+    unsigned int cr3, eip, eflags;
+    unsigned int eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    unsigned int es, cs, ss, ds, fs, gs;
+    unsigned int ldt;
+    unsigned short trap;
+    unsigned short iomap_base;
+} __attribute__((packed));
+
 /** gdt_install:
- *  Sets up the GDT
+ *  Sets up the GDT of a processor, loads the task register with its
+ *  kernel TSS and GS with its per-CPU segment. The kernel TSS receives
+ *  the CPU state when the double fault task takes over. Run on the
+ *  processor itself; GS must not change afterwards.
+ *
+ *  @param cpu  The processor's data, which cpu_self returns from now on
+ */
+void gdt_install(struct cpu *cpu);
+
+/** gdt_set_double_fault_task:
+ *  Sets up the TSS the double fault task gate switches to on the
+ *  calling processor
+ *
+ *  @param entry      The handler; it must not return
+ *  @param stack_top  The initial stack pointer of the handler
+ *  @param cr3        The page directory the handler runs with
+ */
+void gdt_set_double_fault_task(void (*entry)(void), unsigned int stack_top,
+                               unsigned int cr3);
+
+/** gdt_get_kernel_tss:
+ *  Gets the kernel TSS of the calling processor
+ *
+ *  @return The TSS; after a double fault it holds the faulting state
  */
-void gdt_install(void);
+const struct tss *gdt_get_kernel_tss(void);
 
 #endif /* INCLUDE_GDT_H */
\ No newline at end of file
@@ -0,0 +1,18 @@
+#!/bin/sh
+# gen_ksyms.sh - Turns `nm -n kernel` output (on stdin) into the C symbol
+# table used for backtraces (see ksyms.h). With empty input it produces an
+# empty table, used for the first link.
+
+echo '/* Generated by gen_ksyms.sh - do not edit */'
+echo '#include "ksyms.h"'
+echo ''
+echo 'const struct ksym ksyms_table[] = {'
+awk '$2 ~ /^[tT]$/ && $3 !~ /^__x86\.get_pc_thunk/ {
+    printf "    { 0x%s, \"%s\" },\n", $1, $3
+    count++
+}
+END {
+    printf "    { 0xFFFFFFFF, \"\" }\n"
+    printf "};\n\n"
+    printf "const unsigned int ksyms_count = %d;\n", count
+}'
@@ -1,4 +1,26 @@
 #include "hardware.h"
+#include "pmm.h"
+
+/* CPUID.1 feature bits */
+#define CPUID_EDX_FPU       (1 << 0)
+#define CPUID_EDX_FXSR      (1 << 24)
+#define CPUID_EDX_SSE       (1 << 25)
+#define CPUID_ECX_XSAVE     (1 << 26)
+
+/* Control register bits */
+#define CR0_MP              (1 << 1)    /* Monitor coprocessor (wait/TS) */
+#define CR0_EM              (1 << 2)    /* Emulate FPU: fault on FPU use */
+#define CR0_TS              (1 << 3)    /* Task switched: fault on FPU use */
+#define CR0_NE              (1 << 5)    /* Native FPU error reporting */
+#define CR4_OSFXSR          (1 << 9)    /* fxsave/fxrstor and SSE */
+#define CR4_OSXMMEXCPT      (1 << 10)   /* SIMD exceptions raise #XM */
+#define CR4_OSXSAVE         (1 << 18)   /* xsave and xgetbv/xsetbv */
+
+/* XCR0 state components */
+#define XCR0_X87            (1 << 0)
+#define XCR0_SSE            (1 << 1)
+
+static unsigned int fpu_flags = 0;
 
 /** cpuid:
  *  Execute CPUID instruction
@@ -12,79 +34,11 @@ static void cpuid(unsigned int code, unsigned int *a, unsigned int *b,
 }
 
 /** hw_detect_memory:
- *  Detect actual system memory
- *  Uses multiboot info and BIOS memory map
+ *  Usable memory as counted by the frame allocator from the multiboot map
  */
 unsigned int hw_detect_memory(void)
 {
-    /* Method 1: Read from CMOS (0x15-0x16 for extended memory in KB) */
-    unsigned int mem_kb = 0;
-    unsigned char low, high;
-    
-    /* Disable interrupts while accessing CMOS */
-    __asm__ volatile("cli");
-    
-    /* Read extended memory size from CMOS */
-    /* Address 0x17 (low byte) and 0x18 (high byte) */
-    __asm__ volatile(
-        "movb $0x17, %%al\n"
-        "outb %%al, $0x70\n"
-        "inb $0x71, %%al\n"
-        "movb %%al, %0\n"
-        : "=r"(low)
-        :
-        : "al"
-    );
-    
-    __asm__ volatile(
-        "movb $0x18, %%al\n"
-        "outb %%al, $0x70\n"
-        "inb $0x71, %%al\n"
-        "movb %%al, %0\n"
-        : "=r"(high)
-        :
-        : "al"
-    );
-    
-    __asm__ volatile("sti");
-    
-    /* Calculate total memory in KB (extended memory + 1MB base) */
-    mem_kb = (((unsigned int)high << 8) | low) + 1024;
-    
-    /* If CMOS reading failed or looks wrong, try method 2 */
-    if (mem_kb < 1024 || mem_kb > 1048576) {
-        /* Method 2: Use INT 0x15, EAX=0xE820 results stored by bootloader */
-        /* For now, try to detect by checking if memory is accessible */
-        /* This is a simplified detection - probe memory */
-        
-        volatile unsigned int *test_addr;
-        unsigned int mb;
-        
-        /* Start from 1MB and test each MB */
-        for (mb = 1; mb < 4096; mb++) {
-            test_addr = (unsigned int *)(0x100000 + (mb * 1024 * 1024));
-            
-            /* Try to read/write (this is risky but works in VM) */
-            unsigned int old_val = *test_addr;
-            *test_addr = 0xAA55AA55;
-            
-            if (*test_addr != 0xAA55AA55) {
-                /* Memory not accessible */
-                *test_addr = old_val;
-                return mb;
-            }
-            
-            *test_addr = old_val;
-            
-            /* Don't test beyond reasonable limits */
-            if (mb > 256) break;
-        }
-        
-        mem_kb = mb * 1024;
-    }
-    
-    /* Convert KB to MB */
-    return mem_kb / 1024;
+    return pmm_get_total_frames() / (1024 * 1024 / PMM_FRAME_SIZE);
 }
 
 /** hw_get_cpu_info:
@@ -128,4 +82,60 @@ void hw_get_cpu_features(unsigned int *edx, unsigned int *ecx)
     unsigned int eax, ebx;
     
     cpuid(1, &eax, &ebx, ecx, edx);
-}
\ No newline at end of file
+}
+
+/** hw_read_tsc:
+ *  Read the CPU time-stamp counter
+ */
+unsigned long long hw_read_tsc(void)
+{
+    unsigned int low, high;
+    
+    __asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+    
+    return ((unsigned long long)high << 32) | low;
+}
+
+/** hw_init_fpu */
+unsigned int hw_init_fpu(void)
+{
+    unsigned int edx, ecx;
+    unsigned int cr0, cr4;
+
+    hw_get_cpu_features(&edx, &ecx);
+    if (!(edx & CPUID_EDX_FPU)) {
+        return 0;
+    }
+
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+    __asm__ volatile("fninit");
+    fpu_flags = HW_FPU_X87;
+
+    if ((edx & CPUID_EDX_FXSR) && (edx & CPUID_EDX_SSE)) {
+        __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        if (ecx & CPUID_ECX_XSAVE) {
+            cr4 |= CR4_OSXSAVE;
+        }
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+        fpu_flags |= HW_FPU_SSE;
+
+        if (ecx & CPUID_ECX_XSAVE) {
+            /* The kernel uses no AVX: only x87 and SSE state exist */
+            __asm__ volatile("xsetbv"
+                             : : "c"(0), "a"(XCR0_X87 | XCR0_SSE), "d"(0));
+            fpu_flags |= HW_FPU_XSAVE;
+        }
+    }
+
+    return fpu_flags;
+}
+
+/** hw_fpu_enabled */
+unsigned int hw_fpu_enabled(void)
+{
+    return fpu_flags;
+}
@@ -2,7 +2,8 @@
 #define INCLUDE_HARDWARE_H
 
 /** hw_detect_memory:
- *  Detect actual system memory using BIOS data
+ *  Gets the usable RAM found in the multiboot memory map. Only valid
+ *  after pmm_init.
  *
  *  @return Memory size in MB
  */
@@ -27,4 +28,31 @@ void hw_get_cpu_info(char *vendor, unsigned int *family,
  */
 void hw_get_cpu_features(unsigned int *edx, unsigned int *ecx);
 
+/** hw_read_tsc:
+ *  Read the CPU time-stamp counter
+ *
+ *  @return Number of cycles since reset
+ */
+unsigned long long hw_read_tsc(void);
+
+/* What hw_init_fpu turned on */
+#define HW_FPU_X87      (1 << 0)    /* x87 FPU initialised */
+#define HW_FPU_SSE      (1 << 1)    /* fxsave/fxrstor and SSE usable */
+#define HW_FPU_XSAVE    (1 << 2)    /* XSAVE enabled, XCR0 = x87 | SSE */
+
+/** hw_init_fpu:
+ *  Enables the FPU, SSE and, where present, XSAVE: sets up CR0 and CR4
+ *  and XCR0. Until this runs any SSE instruction faults.
+ *
+ *  @return The HW_FPU_* flags for what was enabled
+ */
+unsigned int hw_init_fpu(void);
+
+/** hw_fpu_enabled:
+ *  Gets what hw_init_fpu enabled
+ *
+ *  @return The HW_FPU_* flags
+ */
+unsigned int hw_fpu_enabled(void);
+
 #endif /* INCLUDE_HARDWARE_H */
\ No newline at end of file
@@ -1,9 +1,10 @@
 #include "idt.h"
 #include "io.h"
 #include "serial.h"
-
-/* Forward declaration */
-void keyboard_handle_interrupt(unsigned char scan_code);
+#include "hardware.h"
+#include "exception.h"
+#include "softirq.h"
+#include "apic.h"
 
 /* IDT entry structure */
 struct idt_entry
@@ -36,11 +37,46 @@ struct idt_ptr ip;
 
 #define PIC_ACK 0x20
 
-/* Keyboard */
-#define KBD_DATA_PORT 0x60
+/* Registered handler and statistics for one vector */
+struct irq_entry
+{
+    irq_handler_t handler;
+    void *ctx;
+    unsigned int calls;
+    unsigned long long cycles;
+    unsigned int max_cycles;
+};
+
+/* Dispatch table, indexed by vector */
+static struct irq_entry irq_table[IDT_NUM_VECTORS];
+
+static const char *exception_names[32] = {
+    "#DE divide error", "#DB debug", "NMI", "#BP breakpoint",
+    "#OF overflow", "#BR bound range", "#UD invalid opcode",
+    "#NM device not available", "#DF double fault",
+    "coprocessor overrun", "#TS invalid TSS", "#NP segment not present",
+    "#SS stack fault", "#GP general protection", "#PF page fault",
+    "reserved", "#MF x87 fault", "#AC alignment check",
+    "#MC machine check", "#XM SIMD fault", "#VE virtualization",
+    "#CP control protection", "reserved", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved", "reserved",
+    "#SX security", "reserved"
+};
+
+static const char *irq_names[16] = {
+    "IRQ0 timer", "IRQ1 keyboard", "IRQ2 cascade", "IRQ3 COM2",
+    "IRQ4 COM1", "IRQ5 LPT2", "IRQ6 floppy", "IRQ7 LPT1",
+    "IRQ8 RTC", "IRQ9 ACPI", "IRQ10", "IRQ11",
+    "IRQ12 mouse", "IRQ13 FPU", "IRQ14 ATA1", "IRQ15 ATA2"
+};
+
+static const char *ipi_names[3] = {
+    "IPI reschedule", "IPI tick", "IPI TLB flush"
+};
 
 /** pic_acknowledge:
- *  Acknowledges an interrupt from either PIC 1 or PIC 2.
+ *  Acknowledges an interrupt from either PIC 1 or PIC 2. Interrupts from
+ *  PIC 2 arrive through the cascade on PIC 1, so both need the ACK.
  */
 void pic_acknowledge(unsigned int interrupt)
 {
@@ -49,22 +85,28 @@ void pic_acknowledge(unsigned int interrupt)
         return;
     }
 
-    if (interrupt < PIC2_START_INTERRUPT)
-    {
-        outb(PIC1_PORT_A, PIC_ACK);
-    }
-    else
+    if (interrupt >= PIC2_START_INTERRUPT)
     {
         outb(PIC2_PORT_A, PIC_ACK);
     }
+    outb(PIC1_PORT_A, PIC_ACK);
 }
 
-/** read_scan_code:
- *  Reads a scan code from the keyboard
+/** irq_acknowledge:
+ *  Signals end of interrupt to whichever controller delivered it
  */
-unsigned char read_scan_code(void)
+static void irq_acknowledge(unsigned int interrupt)
 {
-    return inb(KBD_DATA_PORT);
+    if (apic_is_enabled())
+    {
+        if (interrupt >= IRQ_BASE_VECTOR && interrupt != APIC_SPURIOUS_VECTOR)
+        {
+            apic_eoi();
+        }
+        return;
+    }
+
+    pic_acknowledge(interrupt);
 }
 
 /** idt_set_gate:
@@ -81,6 +123,13 @@ void idt_set_gate(int num, void (*handler)(void), unsigned short selector, unsig
     idt[num].type_attr = type_attr;
 }
 
+/** idt_set_task_gate */
+void idt_set_task_gate(unsigned int vector, unsigned short selector)
+{
+    /* Present, ring 0, task gate: the offset is unused */
+    idt_set_gate(vector, 0, selector, 0x85);
+}
+
 /** pic_remap:
  *  Remaps the PIC interrupts
  */
@@ -155,6 +204,10 @@ void idt_install(void)
     idt_set_gate(45, interrupt_handler_45, 0x08, 0x8E);
     idt_set_gate(46, interrupt_handler_46, 0x08, 0x8E);
     idt_set_gate(47, interrupt_handler_47, 0x08, 0x8E);
+    idt_set_gate(IPI_RESCHEDULE_VECTOR, interrupt_handler_48, 0x08, 0x8E);
+    idt_set_gate(IPI_TICK_VECTOR, interrupt_handler_49, 0x08, 0x8E);
+    idt_set_gate(IPI_TLB_VECTOR, interrupt_handler_50, 0x08, 0x8E);
+    idt_set_gate(APIC_SPURIOUS_VECTOR, interrupt_handler_255, 0x08, 0x8E);
 
     /* Remap the PIC */
     pic_remap(0x20, 0x28);
@@ -163,13 +216,94 @@ void idt_install(void)
     load_idt((unsigned int *)&ip);
 }
 
+/** idt_load */
+void idt_load(void)
+{
+    load_idt(&ip);
+}
+
+/** irq_register:
+ *  Installs the handler for an interrupt vector
+ */
+int irq_register(unsigned int vector, irq_handler_t handler, void *ctx)
+{
+    if (vector >= IDT_NUM_VECTORS) {
+        return -1;
+    }
+
+    irq_table[vector].ctx = ctx;
+    irq_table[vector].handler = handler;
+    return 0;
+}
+
+/** div_u64_u32:
+ *  Divides a 64-bit value by a 32-bit one whose quotient fits in 32 bits
+ *  (e.g. an average), without pulling in libgcc's 64-bit division.
+ */
+static unsigned int div_u64_u32(unsigned long long n, unsigned int d)
+{
+    unsigned int high = (unsigned int)(n >> 32) % d;
+    unsigned int low = (unsigned int)n;
+    unsigned int quotient, remainder;
+
+    __asm__("divl %4"
+            : "=a"(quotient), "=d"(remainder)
+            : "a"(low), "d"(high), "rm"(d));
+
+    return quotient;
+}
+
+/** irq_get_stats:
+ *  Gets the dispatch statistics of an interrupt vector
+ */
+int irq_get_stats(unsigned int vector, struct irq_stats *stats)
+{
+    struct irq_entry *entry;
+
+    stats->calls = 0;
+    stats->cycles = 0;
+    stats->avg_cycles = 0;
+    stats->max_cycles = 0;
+
+    if (vector >= IDT_NUM_VECTORS) {
+        return 0;
+    }
+
+    entry = &irq_table[vector];
+    stats->calls = entry->calls;
+    stats->cycles = entry->cycles;
+    stats->max_cycles = entry->max_cycles;
+    if (entry->calls > 0) {
+        stats->avg_cycles = div_u64_u32(entry->cycles, entry->calls);
+    }
+
+    return entry->handler != 0;
+}
+
+/** irq_get_name:
+ *  Gets a short description of an interrupt vector
+ */
+const char *irq_get_name(unsigned int vector)
+{
+    if (vector < 32) {
+        return exception_names[vector];
+    }
+    if (vector >= IRQ_BASE_VECTOR && vector < IRQ_BASE_VECTOR + 16) {
+        return irq_names[vector - IRQ_BASE_VECTOR];
+    }
+    if (vector >= IPI_RESCHEDULE_VECTOR && vector <= IPI_TLB_VECTOR) {
+        return ipi_names[vector - IPI_RESCHEDULE_VECTOR];
+    }
+    return "vector";
+}
+
 /** interrupt_handler_main:
- *  C function called by the common interrupt handler
+ *  C function called by the common interrupt handler. Dispatches to the
+ *  handler registered for the vector (the top half), accounts the time
+ *  spent in it, then runs pending softirqs (the bottom halves).
  */
 void interrupt_handler_main(unsigned int *regs)
 {
-    serial_write("INT!\n", 5);
-    
     // Stack layout when we get here:
     // regs points to the top of the stack after we pushed esp
     // Working backwards from there:
@@ -185,20 +319,35 @@ void interrupt_handler_main(unsigned int *regs)
     // Skip: gs(0), fs(1), es(2), ds(3), and 8 pusha registers = 12 total
     unsigned int interrupt = stack_ptr[12];  // interrupt number
     
-    serial_write("INT NUM: ", 9);
-    char buf[10];
-    buf[0] = '0' + (interrupt / 10);
-    buf[1] = '0' + (interrupt % 10);
-    serial_write(buf, 2);
-    serial_write("\n", 1);
+    struct irq_entry *entry;
+    unsigned long long start;
+    unsigned int cycles;
+    
+    if (interrupt >= IDT_NUM_VECTORS) {
+        return;
+    }
+    
+    entry = &irq_table[interrupt];
+    start = hw_read_tsc();
+    
+    if (entry->handler != 0) {
+        entry->handler(regs, entry->ctx);
+    } else if (interrupt < IRQ_BASE_VECTOR) {
+        /* Never return to a faulting instruction unreported */
+        exception_handler(regs, 0);
+    }
+    
+    irq_acknowledge(interrupt);
+    
+    cycles = (unsigned int)(hw_read_tsc() - start);
+    entry->calls++;
+    entry->cycles += cycles;
+    if (cycles > entry->max_cycles) {
+        entry->max_cycles = cycles;
+    }
     
-    /* Handle keyboard interrupt */
-    if (interrupt == 33) {  // 33 = 0x21 in decimal
-        serial_write("KBD!\n", 5);
-        unsigned char scan_code = read_scan_code();
-        keyboard_handle_interrupt(scan_code);
-        pic_acknowledge(interrupt);
-    } else {
-        pic_acknowledge(interrupt);
+    /* Run the deferred work of device interrupts, interrupts enabled */
+    if (interrupt >= IRQ_BASE_VECTOR) {
+        softirq_run();
     }
 }
\ No newline at end of file
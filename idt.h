@@ -13,6 +13,74 @@ void load_idt(void *idt);
  */
 void idt_install(void);
 
+/** idt_load:
+ *  Loads the IDT set up by idt_install on an application processor
+ */
+void idt_load(void);
+
+/** idt_set_task_gate:
+ *  Makes a vector switch to a task instead of calling a handler
+ *
+ *  @param vector    The interrupt vector
+ *  @param selector  The GDT selector of the task's TSS
+ */
+void idt_set_task_gate(unsigned int vector, unsigned short selector);
+
+/* Number of vectors tracked by the dispatch table */
+#define IDT_NUM_VECTORS 256
+
+/* First vector used by the remapped PIC (IRQ0) */
+#define IRQ_BASE_VECTOR 32
+
+/* Inter-processor interrupts, see smp.c */
+#define IPI_RESCHEDULE_VECTOR   48
+#define IPI_TICK_VECTOR         49
+#define IPI_TLB_VECTOR          50
+
+/** irq_handler_t:
+ *  An interrupt handler. regs points at the register frame saved by the
+ *  common interrupt stub (see interrupt_handler_main), ctx is the pointer
+ *  given to irq_register.
+ */
+typedef void (*irq_handler_t)(unsigned int *regs, void *ctx);
+
+/* Per-vector dispatch statistics */
+struct irq_stats {
+    unsigned int calls;             /* Number of times the vector fired */
+    unsigned long long cycles;      /* Total TSC cycles spent handling it */
+    unsigned int avg_cycles;        /* cycles / calls */
+    unsigned int max_cycles;        /* Slowest single invocation */
+};
+
+/** irq_register:
+ *  Installs the handler for an interrupt vector. Replaces any previous
+ *  handler for that vector.
+ *
+ *  @param vector   The interrupt vector (0-255)
+ *  @param handler  The handler, or 0 to remove the current one
+ *  @param ctx      Pointer passed back to the handler
+ *  @return         0 on success, -1 if the vector is out of range
+ */
+int irq_register(unsigned int vector, irq_handler_t handler, void *ctx);
+
+/** irq_get_stats:
+ *  Gets the dispatch statistics of an interrupt vector
+ *
+ *  @param vector  The interrupt vector
+ *  @param stats   Filled with the counters of the vector
+ *  @return        1 if a handler is registered for the vector, 0 if not
+ */
+int irq_get_stats(unsigned int vector, struct irq_stats *stats);
+
+/** irq_get_name:
+ *  Gets a short description of an interrupt vector: the exception
+ *  mnemonic for vectors 0-31 and the legacy device for IRQ vectors.
+ *
+ *  @param vector  The interrupt vector
+ *  @return        The name, never 0
+ */
+const char *irq_get_name(unsigned int vector);
+
 /* Declare interrupt handler functions */
 void interrupt_handler_0(void);
 void interrupt_handler_1(void);
@@ -62,6 +130,10 @@ void interrupt_handler_44(void);
 void interrupt_handler_45(void);
 void interrupt_handler_46(void);
 void interrupt_handler_47(void);
+void interrupt_handler_48(void);
+void interrupt_handler_49(void);
+void interrupt_handler_50(void);
+void interrupt_handler_255(void);
 void interrupt_handler_main(unsigned int *esp);
 
 
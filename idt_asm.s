@@ -6,12 +6,17 @@ load_idt:
     lidt [eax]
     ret
 
+; Offsets in struct cpu (smp.h)
+CPU_IRQ_STACK_TOP   equ 4
+CPU_IRQ_NESTING     equ 8
+CPU_NEED_RESCHED    equ 12
+
 %macro no_error_code_interrupt_handler 1
 global interrupt_handler_%1
 interrupt_handler_%1:
     cli
-    push byte 0                     ; push dummy error code
-    push byte %1                    ; push interrupt number
+    push dword 0                    ; push dummy error code
+    push dword %1                   ; push interrupt number (dword: vectors above 127)
     jmp common_interrupt_handler
 %endmacro
 
@@ -19,7 +24,7 @@ interrupt_handler_%1:
 global interrupt_handler_%1
 interrupt_handler_%1:
     cli
-    push byte %1                    ; push interrupt number
+    push dword %1                   ; push interrupt number
     jmp common_interrupt_handler
 %endmacro
 
@@ -34,16 +39,42 @@ common_interrupt_handler:
     mov ax, 0x10                    ; Load kernel data segment
     mov ds, ax
     mov es, ax
-    mov fs, ax
-    mov gs, ax
+    mov fs, ax                      ; GS always holds the per-CPU segment
     
     mov eax, esp                    ; Push stack pointer
+    
+    ; The outermost interrupt moves to this processor's interrupt stack
+    ; (kstack.c, smp.c); nested ones are already on it. The frame stays
+    ; where the CPU put it.
+    inc dword [gs:CPU_IRQ_NESTING]
+    cmp dword [gs:CPU_IRQ_NESTING], 1
+    jne .on_irq_stack
+    cmp dword [gs:CPU_IRQ_STACK_TOP], 0
+    je .on_irq_stack
+    mov esp, [gs:CPU_IRQ_STACK_TOP]
+.on_irq_stack:
+    push eax                        ; interrupted esp, restored below
     push eax
     
     extern interrupt_handler_main
     call interrupt_handler_main     ; Call C handler
     
     add esp, 4                      ; Clean up pushed esp
+    pop esp                         ; Back to the interrupted stack
+    dec dword [gs:CPU_IRQ_NESTING]
+    
+    ; Leaving the outermost interrupt: switch threads here if one is due
+    ; (thread.c), on the thread's own stack. Only if the interrupted code
+    ; had interrupts enabled (EFLAGS of the frame: 16 bytes of segments,
+    ; 32 of pusha, 8 of vector and error code, then eip and cs).
+    jnz .no_preempt
+    cmp dword [gs:CPU_NEED_RESCHED], 0
+    je .no_preempt
+    test dword [esp + 64], 0x200
+    jz .no_preempt
+    extern thread_preempt
+    call thread_preempt
+.no_preempt:
     
     pop gs
     pop fs
@@ -105,3 +136,7 @@ no_error_code_interrupt_handler 44
 no_error_code_interrupt_handler 45
 no_error_code_interrupt_handler 46
 no_error_code_interrupt_handler 47
+no_error_code_interrupt_handler 48 ; inter-processor interrupts (smp.c)
+no_error_code_interrupt_handler 49
+no_error_code_interrupt_handler 50
+no_error_code_interrupt_handler 255 ; local APIC spurious interrupt
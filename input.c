@@ -0,0 +1,129 @@
+/**
+ * input.c - Blocking input API
+ *
+ * Readers sleep on input_wait until the keyboard or serial softirq
+ * queues a key event, instead of spinning on keyboard_get_char.
+ */
+
+#include "input.h"
+#include "waitqueue.h"
+#include "timer.h"
+#include "fb.h"
+
+/* Lines moved by Shift+PgUp / Shift+PgDn */
+#define INPUT_SCROLL_LINES  12
+
+static struct wait_queue input_wait;
+
+/** input_wake */
+void input_wake(void)
+{
+    wake_up(&input_wait);
+}
+
+/** input_filter:
+ *  Handles console hot keys: Alt+F1.. switches virtual consoles and
+ *  Shift+PgUp/PgDn scrolls through history. They are handled here, in
+ *  the reader, so the screen is only touched from the foreground.
+ *
+ *  @return 1 if the event was consumed
+ */
+static int input_filter(struct key_event *event)
+{
+    if (event->flags & KEY_EVENT_RELEASED) {
+        return 0;
+    }
+
+    if ((event->modifiers & KEY_MOD_ALT) &&
+        event->scan_code >= KEY_F1 &&
+        event->scan_code < KEY_F1 + FB_NUM_CONSOLES) {
+        fb_console_show(event->scan_code - KEY_F1);
+        return 1;
+    }
+
+    if (event->modifiers & KEY_MOD_SHIFT) {
+        if (event->scan_code == KEY_PAGE_UP) {
+            fb_scroll_view(INPUT_SCROLL_LINES);
+            return 1;
+        }
+        if (event->scan_code == KEY_PAGE_DOWN) {
+            fb_scroll_view(-INPUT_SCROLL_LINES);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/** input_take_event:
+ *  Takes the next key event that isn't a console hot key
+ *
+ *  @return 1 if an event was taken
+ */
+static int input_take_event(struct key_event *event)
+{
+    while (keyboard_get_event(event)) {
+        if (!input_filter(event)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** input_read_event */
+void input_read_event(struct key_event *event)
+{
+    wait_event(input_wait, input_take_event(event));
+}
+
+/** input_poll_event */
+int input_poll_event(struct key_event *event, unsigned int timeout_ms)
+{
+    if (timeout_ms == 0) {
+        return input_take_event(event);
+    }
+    return wait_event_timeout(input_wait, input_take_event(event),
+                              timer_ms_to_ticks(timeout_ms));
+}
+
+/** is_typed_char:
+ *  Whether an event is a key press that produced a character
+ */
+static int is_typed_char(struct key_event *event)
+{
+    return !(event->flags & KEY_EVENT_RELEASED) && event->ascii != 0;
+}
+
+/** input_read_blocking */
+char input_read_blocking(void)
+{
+    struct key_event event;
+
+    do {
+        input_read_event(&event);
+    } while (!is_typed_char(&event));
+
+    return event.ascii;
+}
+
+/** input_poll */
+char input_poll(unsigned int timeout_ms)
+{
+    struct key_event event;
+    unsigned int deadline = timer_get_ticks() + timer_ms_to_ticks(timeout_ms);
+
+    while (1) {
+        unsigned int now = timer_get_ticks();
+        unsigned int left_ms = 0;
+
+        if ((int)(deadline - now) > 0) {
+            left_ms = (deadline - now) * (1000 / TIMER_HZ);
+        }
+        if (!input_poll_event(&event, left_ms)) {
+            return 0;
+        }
+        if (is_typed_char(&event)) {
+            return event.ascii;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef INCLUDE_INPUT_H
+#define INCLUDE_INPUT_H
+
+#include "keyboard.h"
+
+/** input_wake:
+ *  Wakes readers waiting for input. Called by the drivers after queueing
+ *  a key event.
+ */
+void input_wake(void);
+
+/** input_read_event:
+ *  Sleeps until a key event (press or release, keyboard or serial) is
+ *  available and takes it
+ *
+ *  @param event  Filled with the event
+ */
+void input_read_event(struct key_event *event);
+
+/** input_poll_event:
+ *  Takes the next key event, sleeping at most timeout_ms for one
+ *
+ *  @param event       Filled with the event
+ *  @param timeout_ms  How long to wait, 0 to only check
+ *  @return            1 if an event was taken, 0 on timeout
+ */
+int input_poll_event(struct key_event *event, unsigned int timeout_ms);
+
+/** input_read_blocking:
+ *  Sleeps until a character is typed and returns it. Releases and keys
+ *  without an ASCII value are skipped.
+ *
+ *  @return The character
+ */
+char input_read_blocking(void);
+
+/** input_poll:
+ *  Returns the next typed character, sleeping at most timeout_ms for one
+ *
+ *  @param timeout_ms  How long to wait, 0 to only check
+ *  @return            The character, or 0 on timeout
+ */
+char input_poll(unsigned int timeout_ms);
+
+#endif /* INCLUDE_INPUT_H */
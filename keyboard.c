@@ -1,54 +1,291 @@
 #include "keyboard.h"
-#include "serial.h"
+#include "idt.h"
+#include "io.h"
+#include "softirq.h"
+#include "input.h"
+
+/* Keyboard */
+#define KBD_DATA_PORT 0x60
+#define KBD_INTERRUPT 33
+
+/* Scan codes handled by the translation */
+#define SC_ESCAPE           0x01
+#define SC_LEFT_CTRL        0x1D
+#define SC_LEFT_SHIFT       0x2A
+#define SC_RIGHT_SHIFT      0x36
+#define SC_LEFT_ALT         0x38
+#define SC_CAPS_LOCK        0x3A
+#define SC_EXTENDED_PREFIX  0xE0
+#define SC_RELEASE_BIT      0x80
 
 /* US QWERTY keyboard layout scan code to ASCII table */
 static char scan_code_to_ascii[] = {
-    0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
+    0, 27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
     0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
     0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
     '*', 0, ' '
 };
 
-static char last_char = 0;
+/* Same layout with Shift held */
+static char scan_code_to_ascii_shift[] = {
+    0, 27, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
+    '*', 0, ' '
+};
+
+/* Raw scan codes, filled by the IRQ and drained by the bottom half */
+#define SCAN_QUEUE_SIZE 64
+
+static unsigned char scan_queue[SCAN_QUEUE_SIZE];
+static volatile unsigned int scan_head = 0;
+static volatile unsigned int scan_tail = 0;
+static volatile unsigned int scan_dropped = 0;    /* Lost to a full queue */
+
+/* Key event ring. Single producer (softirq context), single consumer
+ * (the foreground code), so the indices need no lock: each side only
+ * writes its own index, and publishes it after touching the slot.
+ * Indices run freely and are masked on access.
+ */
+#define EVENT_RING_SIZE 256     /* must be a power of two */
+
+static struct key_event event_ring[EVENT_RING_SIZE];
+static volatile unsigned int event_head = 0;
+static volatile unsigned int event_tail = 0;
+static volatile unsigned int event_dropped = 0;   /* Lost to a full ring */
+
+/* Translation state, only touched by the bottom half */
+static unsigned char modifiers = 0;
+static int extended_pending = 0;
+
+#define barrier() __asm__ volatile("" : : : "memory")
+
+static void keyboard_irq(unsigned int *regs, void *ctx);
+static void keyboard_bottom_half(void);
 
 /** keyboard_init:
  *  Initializes the keyboard driver
  */
 void keyboard_init(void)
 {
-    last_char = 0;
+    event_head = 0;
+    event_tail = 0;
+    scan_head = 0;
+    scan_tail = 0;
+    modifiers = 0;
+    extended_pending = 0;
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_bottom_half);
+    irq_register(KBD_INTERRUPT, keyboard_irq, 0);
+}
+
+/** event_ring_push:
+ *  Producer side of the event ring
+ */
+static void event_ring_push(struct key_event *event)
+{
+    unsigned int head = event_head;
+
+    if (head - event_tail >= EVENT_RING_SIZE) {
+        event_dropped++;
+        return;
+    }
+
+    event_ring[head & (EVENT_RING_SIZE - 1)] = *event;
+    barrier();
+    event_head = head + 1;
+
+    input_wake();
+}
+
+/** keyboard_push_char:
+ *  Queues a character typed on another input source, such as the serial
+ *  console, as a key press. Must be called from softirq context, which
+ *  is the single producer of the event ring.
+ *
+ *  @param c  The character to queue
+ */
+void keyboard_push_char(char c)
+{
+    struct key_event event;
+
+    if (c == 0) {
+        return;
+    }
+
+    event.scan_code = 0;
+    event.modifiers = 0;
+    event.flags = 0;
+    event.ascii = c;
+    event_ring_push(&event);
 }
 
-/** keyboard_handle_interrupt:
- *  Handles a keyboard interrupt and converts scan code to ASCII
+/** translate_ascii:
+ *  Maps a make code to ASCII under the current modifiers
+ */
+static char translate_ascii(unsigned char code)
+{
+    char c;
+    int shifted = (modifiers & KEY_MOD_SHIFT) != 0;
+
+    if (code >= sizeof(scan_code_to_ascii)) {
+        return 0;
+    }
+
+    c = scan_code_to_ascii[code];
+    if (c >= 'a' && c <= 'z' && (modifiers & KEY_MOD_CAPS_LOCK)) {
+        shifted = !shifted;
+    }
+    if (shifted) {
+        c = scan_code_to_ascii_shift[code];
+    }
+
+    /* Ctrl+letter gives the control character, e.g. Ctrl+C = 3 */
+    if ((modifiers & KEY_MOD_CTRL) && c != 0) {
+        if (c >= 'a' && c <= 'z') {
+            c = c - 'a' + 1;
+        } else if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 1;
+        }
+    }
+
+    return c;
+}
+
+/** keyboard_handle_scan_code:
+ *  Tracks modifiers and turns a scan code into a key event
  *  
  *  @param scan_code The scan code from the keyboard
  */
-void keyboard_handle_interrupt(unsigned char scan_code)
-{
-    serial_write("SCAN: ", 6);
-    serial_write((char*)&scan_code, 1);
-    serial_write("\n", 1);
-    
-    /* Only handle key presses (scan codes < 0x80) */
-    if (scan_code < 0x80) {
-        if (scan_code < sizeof(scan_code_to_ascii)) {
-            last_char = scan_code_to_ascii[scan_code];
-            serial_write("ASCII: ", 7);
-            serial_write(&last_char, 1);
-            serial_write("\n", 1);
+static void keyboard_handle_scan_code(unsigned char scan_code)
+{
+    struct key_event event;
+    unsigned char code;
+    int released;
+    int extended;
+
+    if (scan_code == SC_EXTENDED_PREFIX) {
+        extended_pending = 1;
+        return;
+    }
+
+    extended = extended_pending;
+    extended_pending = 0;
+    released = (scan_code & SC_RELEASE_BIT) != 0;
+    code = scan_code & ~SC_RELEASE_BIT;
+
+    /* Modifiers (right Ctrl/Alt are the extended versions of the left) */
+    if (code == SC_LEFT_SHIFT || code == SC_RIGHT_SHIFT) {
+        if (!extended) {
+            modifiers = released ? (modifiers & ~KEY_MOD_SHIFT)
+                                 : (modifiers | KEY_MOD_SHIFT);
+        }
+    } else if (code == SC_LEFT_CTRL) {
+        modifiers = released ? (modifiers & ~KEY_MOD_CTRL)
+                             : (modifiers | KEY_MOD_CTRL);
+    } else if (code == SC_LEFT_ALT) {
+        modifiers = released ? (modifiers & ~KEY_MOD_ALT)
+                             : (modifiers | KEY_MOD_ALT);
+    } else if (code == SC_CAPS_LOCK && !released) {
+        modifiers ^= KEY_MOD_CAPS_LOCK;
+    }
+
+    event.scan_code = code;
+    event.modifiers = modifiers;
+    event.flags = (released ? KEY_EVENT_RELEASED : 0) |
+                  (extended ? KEY_EVENT_EXTENDED : 0);
+    event.ascii = 0;
+
+    if (extended) {
+        /* Keypad Enter and '/' are the only extended keys with ASCII */
+        if (code == 0x1C) {
+            event.ascii = '\n';
+        } else if (code == 0x35) {
+            event.ascii = '/';
         }
+    } else {
+        event.ascii = translate_ascii(code);
     }
+
+    event_ring_push(&event);
+}
+
+/** keyboard_irq:
+ *  IRQ1 top half: reads the scan code from the controller, queues it and
+ *  defers the translation to the keyboard softirq
+ */
+static void keyboard_irq(unsigned int *regs, void *ctx)
+{
+    unsigned char scan_code = inb(KBD_DATA_PORT);
+    unsigned int next = (scan_head + 1) % SCAN_QUEUE_SIZE;
+
+    (void)regs;
+    (void)ctx;
+
+    if (next != scan_tail) {
+        scan_queue[scan_head] = scan_code;
+        scan_head = next;
+    } else {
+        scan_dropped++;
+    }
+    softirq_raise(SOFTIRQ_KEYBOARD);
 }
+
+/** keyboard_bottom_half:
+ *  Keyboard softirq: translates the queued scan codes
+ */
+static void keyboard_bottom_half(void)
+{
+    while (scan_tail != scan_head) {
+        unsigned char scan_code = scan_queue[scan_tail];
+        scan_tail = (scan_tail + 1) % SCAN_QUEUE_SIZE;
+        keyboard_handle_scan_code(scan_code);
+    }
+}
+
+/** keyboard_get_event:
+ *  Takes the next key event from the event ring (non-blocking)
+ *
+ *  @param event  Filled with the event
+ *  @return       1 if an event was taken, 0 if the ring is empty
+ */
+int keyboard_get_event(struct key_event *event)
+{
+    unsigned int tail = event_tail;
+
+    if (tail == event_head) {
+        return 0;
+    }
+
+    barrier();
+    *event = event_ring[tail & (EVENT_RING_SIZE - 1)];
+    barrier();
+    event_tail = tail + 1;
+    return 1;
+}
+
 /** keyboard_get_char:
- *  Gets the last character typed (non-blocking)
+ *  Gets the next typed character (non-blocking). Releases and keys
+ *  without an ASCII value are skipped.
  *  
  *  @return The character, or 0 if no character available
  */
 char keyboard_get_char(void)
 {
-    char c = last_char;
-    last_char = 0;
-    return c;
-}
\ No newline at end of file
+    struct key_event event;
+
+    while (keyboard_get_event(&event)) {
+        if (!(event.flags & KEY_EVENT_RELEASED) && event.ascii != 0) {
+            return event.ascii;
+        }
+    }
+    return 0;
+}
+
+/** keyboard_get_dropped */
+void keyboard_get_dropped(unsigned int *scan_codes, unsigned int *events)
+{
+    *scan_codes = scan_dropped;
+    *events = event_dropped;
+}
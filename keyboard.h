@@ -1,16 +1,71 @@
 #ifndef INCLUDE_KEYBOARD_H
 #define INCLUDE_KEYBOARD_H
 
+/* Modifier state carried by every key event */
+#define KEY_MOD_SHIFT       0x01
+#define KEY_MOD_CTRL        0x02
+#define KEY_MOD_ALT         0x04
+#define KEY_MOD_CAPS_LOCK   0x08
+
+/* Key event flags */
+#define KEY_EVENT_RELEASED  0x01    /* Key went up (otherwise down) */
+#define KEY_EVENT_EXTENDED  0x02    /* 0xE0 prefixed scan code */
+
+/* Set 1 scan codes of keys without an ASCII value */
+#define KEY_F1              0x3B
+#define KEY_F10             0x44
+#define KEY_UP              0x48    /* extended */
+#define KEY_PAGE_UP         0x49    /* extended */
+#define KEY_LEFT            0x4B    /* extended */
+#define KEY_RIGHT           0x4D    /* extended */
+#define KEY_DOWN            0x50    /* extended */
+#define KEY_PAGE_DOWN       0x51    /* extended */
+
+/* One key press or release */
+struct key_event {
+    unsigned char scan_code;    /* Set 1 make code, 0 for serial input */
+    unsigned char modifiers;    /* KEY_MOD_* at the time of the event */
+    unsigned char flags;        /* KEY_EVENT_* */
+    char ascii;                 /* Translated character, 0 if none */
+};
+
 /** keyboard_init:
  *  Initializes the keyboard driver
  */
 void keyboard_init(void);
 
+/** keyboard_get_event:
+ *  Takes the next key event from the event ring (non-blocking)
+ *
+ *  @param event  Filled with the event
+ *  @return       1 if an event was taken, 0 if the ring is empty
+ */
+int keyboard_get_event(struct key_event *event);
+
 /** keyboard_get_char:
- *  Gets the last character typed (non-blocking)
+ *  Gets the next typed character (non-blocking). Releases and keys
+ *  without an ASCII value are skipped.
  *  
  *  @return The character, or 0 if no character available
  */
 char keyboard_get_char(void);
 
-#endif /* INCLUDE_KEYBOARD_H */
\ No newline at end of file
+/** keyboard_push_char:
+ *  Queues a character typed on another input source, such as the serial
+ *  console, as a key press. Must be called from softirq context, which
+ *  is the single producer of the event ring.
+ *
+ *  @param c  The character to queue
+ */
+void keyboard_push_char(char c);
+
+/** keyboard_get_dropped:
+ *  Gets how much input was lost because a queue was full. Both should
+ *  stay 0; shown in /proc/keyboard.
+ *
+ *  @param scan_codes  Filled with the scan codes the IRQ had no room for
+ *  @param events      Filled with the key events the ring had no room for
+ */
+void keyboard_get_dropped(unsigned int *scan_codes, unsigned int *events);
+
+#endif /* INCLUDE_KEYBOARD_H */
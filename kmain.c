@@ -7,30 +7,144 @@
 #include "filesystem.h"
 #include "bootsplash.h"
 #include "sysfiles.h"
+#include "softirq.h"
+#include "apic.h"
+#include "exception.h"
+#include "timer.h"
+#include "memory.h"
+#include "hardware.h"
+#include "pmm.h"
+#include "slab.h"
+#include "paging.h"
+#include "kstack.h"
+#include "thread.h"
+#include "smp.h"
+#include "kstring.h"
 
-int kmain(void)
+/** serial_write_num:
+ *  Writes a decimal number to the serial port
+ */
+static void serial_write_num(unsigned int num)
 {
+    char buf[16];
+    serial_write(buf, uint_to_str(num, buf));
+}
+
+static void kmain_late(void) __attribute__((noreturn));
+
+int kmain(unsigned int magic, struct multiboot_info *mbi)
+{
+    struct kstack *main_stack;
+    
     /* Configure serial port */
     serial_configure_baud_rate(SERIAL_COM1_BASE, 3);
     serial_configure_line(SERIAL_COM1_BASE);
     serial_configure_fifo_buffer(SERIAL_COM1_BASE);
     serial_configure_modem(SERIAL_COM1_BASE);
+    serial_configure_interrupts(SERIAL_COM1_BASE);
     
     /* Write to serial */
     serial_write("Kernel starting...\n", 19);
     
-    /* Set up GDT */
-    gdt_install();
+    /* Set up the virtual consoles before anything prints */
+    fb_init();
+    
+    /* Replace the boot mappings with the kernel page directory */
+    paging_init();
+    serial_write("Paging enabled\n", 15);
+    
+    /* Hand the usable RAM from the loader's memory map to the frame allocator */
+    if (pmm_init(magic, phys_to_virt(mbi)) < 0) {
+        serial_write("No multiboot memory map, assuming 15 MB\n", 40);
+    }
+    serial_write("Physical memory: ", 17);
+    serial_write_num(pmm_get_total_frames() / 256);
+    serial_write(" MB usable\n", 11);
+    slab_init();
+    
+    /* Leave the 4 KB boot stack for guarded stacks: one for interrupts,
+     * one for the rest of the kernel
+     */
+    kstack_init();
+    main_stack = kstack_create("main", KSTACK_SIZE);
+    if (main_stack) {
+        kstack_run(main_stack, kmain_late);
+    }
+    serial_write("No memory for the main stack\n", 29);
+    kmain_late();
+    
+    return 0;
+}
+
+/** kmain_late:
+ *  The rest of the boot and the main loop, on the main stack
+ */
+static void kmain_late(void)
+{
+    /* Enable FPU/SSE state, then pick memcpy/memset routines to match */
+    if (hw_init_fpu() & HW_FPU_SSE) {
+        serial_write("FPU and SSE enabled\n", 20);
+    }
+    memory_init();
+    
+    /* Set up the boot processor's GDT; its GS segment is what the
+     * thread system and the interrupt stub find per-CPU data through */
+    gdt_install(&cpus[0]);
     serial_write("GDT installed\n", 14);
     
+    /* From here on the boot flow is the "main" thread. It stays on the
+     * boot processor, which owns the console and the device interrupts */
+    thread_init();
+    thread_set_priority(thread_current(), THREAD_PRIO_HIGH);
+    thread_set_affinity(thread_current(), 1);
+    serial_write("Threads initialized\n", 20);
+    
+    /* Report what an address space switch costs on this CPU */
+    if (paging_measure_cr3() == 0) {
+        struct paging_cr3_cost cost;
+        
+        paging_get_cr3_cost(&cost);
+        serial_write("CR3 cycles reload/switch/refill: ", 33);
+        serial_write_num(cost.reload);
+        serial_write("/", 1);
+        serial_write_num(cost.swap);
+        serial_write("/", 1);
+        serial_write_num(cost.refill);
+        serial_write("\n", 1);
+    }
+    
     /* Set up IDT */
     idt_install();
     serial_write("IDT installed\n", 14);
     
+    /* Report CPU exceptions instead of returning into the fault */
+    exception_init();
+    serial_write("Exception handlers installed\n", 29);
+    
+    /* Switch interrupt delivery to the APIC when there is one */
+    if (apic_init()) {
+        serial_write("APIC enabled, 8259 PIC masked\n", 30);
+    } else {
+        serial_write("No APIC, using 8259 PIC\n", 24);
+    }
+    
+    /* Set up deferred interrupt work */
+    softirq_init();
+    serial_write("Softirqs initialized\n", 21);
+    
     /* Initialize keyboard */
     keyboard_init();
     serial_write("Keyboard initialized\n", 21);
     
+    /* Start the system tick used for sleeps and timeouts */
+    timer_init();
+    serial_write("Timer initialized\n", 18);
+    
+    /* Route COM1 input to the same queue as the keyboard */
+    serial_init_console();
+    irq_register(SERIAL_COM1_INTERRUPT, serial_handle_interrupt, 0);
+    serial_write("Serial console initialized\n", 27);
+    
     /* Initialize filesystem */
     fs_init();
     serial_write("Filesystem initialized\n", 23);
@@ -50,11 +164,19 @@ int kmain(void)
     /* Initialize system files */
     sysfiles_init();
     serial_write("System files populated\n", 23);
+    if (sysfiles_start_refresh() == 0) {
+        serial_write("procfs refresh thread started\n", 30);
+    }
     
     /* Enable interrupts */
     __asm__ ("sti");
     serial_write("Interrupts enabled\n", 19);
     
+    /* Start the other processors; they join the scheduler as they come up */
+    serial_write("CPUs online: ", 13);
+    serial_write_num(smp_init());
+    serial_write("\n", 1);
+    
     /* Show boot splash screen */
     bootsplash_show();
     serial_write("Boot splash displayed\n", 22);
@@ -63,10 +185,8 @@ int kmain(void)
     shell_init();
     serial_write("Shell started\n", 14);
     
-    /* Main loop */
+    /* Main loop: the shell sleeps until input arrives */
     while (1) {
         shell_update();
     }
-    
-    return 0;
 }
\ No newline at end of file
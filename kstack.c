@@ -0,0 +1,224 @@
+/**
+ * kstack.c - Guarded kernel stacks
+ *
+ * Stacks live in the vmap area as [guard page][stack pages]. The guard
+ * page is never mapped, so running off the bottom of a stack faults
+ * right away instead of corrupting whatever lies below. That fault can't
+ * be handled on the overflowed stack, so it turns into a double fault,
+ * which runs as its own task on its own stack (see exception.c).
+ *
+ * New stacks are filled with a canary value. The lowest overwritten word
+ * marks the deepest the stack has been, which /proc/stacks reports.
+ */
+
+#include "kstack.h"
+#include "paging.h"
+#include "pmm.h"
+#include "slab.h"
+#include "smp.h"
+#include "spinlock.h"
+
+static struct kstack *stack_list = 0;
+
+/* Address ranges of destroyed stacks, reused by size */
+static struct kstack *free_ranges = 0;
+
+static struct kmem_cache kstack_cache;
+static struct spinlock list_lock;
+
+/** kstack_lock:
+ *  Locks the stack lists against other threads and processors,
+ *  returning the old EFLAGS
+ */
+static unsigned int kstack_lock(void)
+{
+    return spin_lock_irqsave(&list_lock);
+}
+
+/** kstack_unlock:
+ *  Releases the lock taken by kstack_lock
+ */
+static void kstack_unlock(unsigned int flags)
+{
+    spin_unlock_irqrestore(&list_lock, flags);
+}
+
+/** kstack_unmap:
+ *  Unmaps the pages of [base, base + size) and frees their frames.
+ *  Nothing runs on a dead stack, so other processors' stale translations
+ *  only matter once the range is reused, after the shootdown at the end.
+ */
+static void kstack_unmap(unsigned int base, unsigned int size)
+{
+    unsigned int off;
+
+    for (off = 0; off < size; off += PAGE_SIZE) {
+        unsigned int phys = paging_unmap_page(paging_kernel_directory(), base + off);
+        if (phys) {
+            pmm_free_frame(phys);
+        }
+    }
+    paging_shootdown(paging_kernel_directory(), base, size / PAGE_SIZE);
+}
+
+/** kstack_create */
+struct kstack *kstack_create(const char *name, unsigned int size)
+{
+    struct kstack *stack = 0;
+    struct kstack **link;
+    unsigned int base = 0;
+    unsigned int off;
+    unsigned int flags;
+
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (size == 0) {
+        return 0;
+    }
+
+    /* Reuse a range left by kstack_destroy */
+    flags = kstack_lock();
+    for (link = &free_ranges; *link; link = &(*link)->next) {
+        if ((*link)->size == size) {
+            stack = *link;
+            *link = stack->next;
+            base = stack->base;
+            break;
+        }
+    }
+    kstack_unlock(flags);
+
+    if (!stack) {
+        stack = kmem_cache_alloc(&kstack_cache);
+        if (!stack) {
+            return 0;
+        }
+        base = paging_vmap_reserve(PAGE_SIZE + size);
+        if (base == 0) {
+            kmem_cache_free(&kstack_cache, stack);
+            return 0;
+        }
+        base += PAGE_SIZE;
+    }
+
+    stack->name = name;
+    stack->base = base;
+    stack->size = size;
+
+    for (off = 0; off < size; off += PAGE_SIZE) {
+        unsigned int frame = pmm_alloc_frame();
+        unsigned int *words;
+        unsigned int i;
+
+        if (frame == 0 ||
+            paging_map_page(paging_kernel_directory(), base + off, frame, PAGE_WRITE) < 0) {
+            if (frame) {
+                pmm_free_frame(frame);
+            }
+            kstack_unmap(base, off);
+            flags = kstack_lock();
+            stack->next = free_ranges;
+            free_ranges = stack;
+            kstack_unlock(flags);
+            return 0;
+        }
+
+        words = (unsigned int *)(base + off);
+        for (i = 0; i < PAGE_SIZE / 4; i++) {
+            words[i] = KSTACK_CANARY;
+        }
+    }
+
+    flags = kstack_lock();
+    stack->next = stack_list;
+    stack_list = stack;
+    kstack_unlock(flags);
+    return stack;
+}
+
+/** kstack_destroy */
+void kstack_destroy(struct kstack *stack)
+{
+    struct kstack **link;
+    unsigned int flags = kstack_lock();
+
+    for (link = &stack_list; *link; link = &(*link)->next) {
+        if (*link == stack) {
+            *link = stack->next;
+            break;
+        }
+    }
+    kstack_unlock(flags);
+
+    kstack_unmap(stack->base, stack->size);
+
+    flags = kstack_lock();
+    stack->name = 0;
+    stack->next = free_ranges;
+    free_ranges = stack;
+    kstack_unlock(flags);
+}
+
+/** kstack_top */
+unsigned int kstack_top(const struct kstack *stack)
+{
+    return stack->base + stack->size;
+}
+
+/** kstack_high_water */
+unsigned int kstack_high_water(const struct kstack *stack)
+{
+    const unsigned int *words = (const unsigned int *)stack->base;
+    unsigned int count = stack->size / 4;
+    unsigned int i;
+
+    for (i = 0; i < count && words[i] == KSTACK_CANARY; i++) {
+    }
+    return (count - i) * 4;
+}
+
+/** kstack_find */
+const struct kstack *kstack_find(unsigned int addr)
+{
+    const struct kstack *stack;
+
+    for (stack = stack_list; stack; stack = stack->next) {
+        if (addr >= stack->base - PAGE_SIZE && addr < stack->base + stack->size) {
+            return stack;
+        }
+    }
+    return 0;
+}
+
+/** kstack_list */
+const struct kstack *kstack_list(void)
+{
+    return stack_list;
+}
+
+/** kstack_init */
+void kstack_init(void)
+{
+    struct kstack *irq_stack;
+
+    kmem_cache_init(&kstack_cache, "kstack", sizeof(struct kstack));
+    irq_stack = kstack_create("irq", KSTACK_IRQ_SIZE);
+
+    /* Without it interrupts simply stay on the interrupted stack */
+    if (irq_stack) {
+        cpus[0].irq_stack_top = kstack_top(irq_stack);
+    }
+}
+
+/** kstack_run */
+void kstack_run(struct kstack *stack, void (*fn)(void))
+{
+    __asm__ volatile("mov %0, %%esp\n"
+                     "xor %%ebp, %%ebp\n"   /* end of the backtrace chain */
+                     "call *%1\n"
+                     :
+                     : "r"(kstack_top(stack)), "r"(fn)
+                     : "memory");
+    while (1) {
+        __asm__ volatile("cli; hlt");
+    }
+}
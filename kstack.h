@@ -0,0 +1,86 @@
+#ifndef INCLUDE_KSTACK_H
+#define INCLUDE_KSTACK_H
+
+/* Stack sizes; each stack also gets an unmapped guard page below it */
+#define KSTACK_SIZE             16384   /* Kernel main, idle and default thread stacks */
+#define KSTACK_IRQ_SIZE         16384   /* Interrupts and softirqs */
+#define KSTACK_DOUBLE_FAULT_SIZE 4096   /* Double fault task */
+
+/* Unused stack words hold this value; see kstack_high_water */
+#define KSTACK_CANARY           0x57AC57AC
+
+/** A kernel stack in the vmap area */
+struct kstack {
+    const char *name;
+    unsigned int base;          /* Lowest mapped address */
+    unsigned int size;          /* Mapped bytes; the guard page is below base */
+    struct kstack *next;
+};
+
+/** kstack_init:
+ *  Creates the boot processor's interrupt stack and switches the
+ *  interrupt stub to it (struct cpu, smp.h). Needs slab_init; must run
+ *  before kstack_create.
+ */
+void kstack_init(void);
+
+/** kstack_create:
+ *  Allocates a stack with an unmapped guard page below it and fills it
+ *  with KSTACK_CANARY
+ *
+ *  @param name  The name shown in /proc/stacks
+ *  @param size  The stack size, rounded up to pages
+ *  @return      The stack, or 0 if memory is exhausted
+ */
+struct kstack *kstack_create(const char *name, unsigned int size);
+
+/** kstack_destroy:
+ *  Unmaps a stack and frees its frames. The address range is kept for
+ *  the next stack of the same size.
+ *
+ *  @param stack  The stack, not the one in use
+ */
+void kstack_destroy(struct kstack *stack);
+
+/** kstack_top:
+ *  Gets the initial stack pointer of a stack
+ *
+ *  @param stack  The stack
+ *  @return       The address just past its end
+ */
+unsigned int kstack_top(const struct kstack *stack);
+
+/** kstack_high_water:
+ *  Gets the deepest the stack has been, by finding the lowest word that
+ *  no longer holds the canary
+ *
+ *  @param stack  The stack
+ *  @return       The maximum number of bytes used
+ */
+unsigned int kstack_high_water(const struct kstack *stack);
+
+/** kstack_find:
+ *  Finds the stack an address belongs to, guard page included
+ *
+ *  @param addr  The address, e.g. a faulting ESP
+ *  @return      The stack, or 0 if it isn't in any
+ */
+const struct kstack *kstack_find(unsigned int addr);
+
+/** kstack_list:
+ *  Gets the first stack; follow ->next for the rest
+ *
+ *  @return The first stack
+ */
+const struct kstack *kstack_list(void);
+
+/** kstack_run:
+ *  Switches to a stack and calls a function on it. Never returns; the
+ *  old stack is abandoned.
+ *
+ *  @param stack  The stack
+ *  @param fn     The function, which must not return
+ */
+void kstack_run(struct kstack *stack, void (*fn)(void)) __attribute__((noreturn));
+
+#endif /* INCLUDE_KSTACK_H */
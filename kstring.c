@@ -0,0 +1,239 @@
+/**
+ * kstring.c - Freestanding string functions and number formatting
+ *
+ * The scanning loops test a word (or, with SSE2, 16 bytes) at a time:
+ * a word w contains a zero byte exactly when
+ * (w - 0x01010101) & ~w & 0x80808080 is non-zero.
+ */
+
+#include "kstring.h"
+#include "memory.h"
+
+#define ONES    0x01010101u
+#define HIGHS   0x80808080u
+
+#define has_zero_byte(w)    (((w) - ONES) & ~(w) & HIGHS)
+
+/* Below this size memchr_sse2's setup costs more than it saves */
+#define MEMCHR_SSE2_THRESHOLD   64
+
+/* From kstring_asm.s */
+unsigned int strlen_sse2(const char *str);
+void *memchr_sse2(const void *s, int c, unsigned int n);
+
+/* Pairs of decimal digits, "00" to "99" */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/** strlen */
+int strlen(const char *str)
+{
+    const char *p = str;
+    const unsigned int *w;
+
+    if (memory_sse2_enabled()) {
+        return (int)strlen_sse2(str);
+    }
+
+    /* Bytes up to word alignment */
+    while ((unsigned int)p & 3) {
+        if (*p == '\0') {
+            return p - str;
+        }
+        p++;
+    }
+
+    /* Aligned words never cross a page, so over-reading is safe */
+    w = (const unsigned int *)p;
+    while (!has_zero_byte(*w)) {
+        w++;
+    }
+
+    p = (const char *)w;
+    while (*p != '\0') {
+        p++;
+    }
+    return p - str;
+}
+
+/** strcmp */
+int strcmp(const char *s1, const char *s2)
+{
+    /* Word compare when both strings can reach alignment together */
+    if ((((unsigned int)s1 ^ (unsigned int)s2) & 3) == 0) {
+        while ((unsigned int)s1 & 3) {
+            if (*s1 == '\0' || *s1 != *s2) {
+                return *(unsigned char *)s1 - *(unsigned char *)s2;
+            }
+            s1++;
+            s2++;
+        }
+        while (1) {
+            unsigned int w1 = *(const unsigned int *)s1;
+            unsigned int w2 = *(const unsigned int *)s2;
+
+            if (w1 != w2 || has_zero_byte(w1)) {
+                break;
+            }
+            s1 += 4;
+            s2 += 4;
+        }
+    }
+
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+/** strncmp */
+int strncmp(const char *s1, const char *s2, unsigned int n)
+{
+    while (n > 0 && *s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+        n--;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+/** strcpy */
+void strcpy(char *dest, const char *src)
+{
+    memcpy(dest, src, strlen(src) + 1);
+}
+
+/** strlcpy */
+int strlcpy(char *dest, const char *src, int size)
+{
+    int len = strlen(src);
+
+    if (len > size - 1) {
+        len = size - 1;
+    }
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+    return len;
+}
+
+/** strcat */
+void strcat(char *dest, const char *src)
+{
+    strcpy(dest + strlen(dest), src);
+}
+
+/** strstr */
+char *strstr(const char *haystack, const char *needle)
+{
+    int needle_len = strlen(needle);
+    int remaining = strlen(haystack);
+
+    if (needle_len == 0) {
+        return (char *)haystack;
+    }
+
+    /* Jump between occurrences of the first character */
+    while (remaining >= needle_len) {
+        const char *hit = memchr(haystack, needle[0], remaining - needle_len + 1);
+
+        if (hit == 0) {
+            return 0;
+        }
+        if (strncmp(hit, needle, needle_len) == 0) {
+            return (char *)hit;
+        }
+        remaining -= hit + 1 - haystack;
+        haystack = hit + 1;
+    }
+    return 0;
+}
+
+/** memchr */
+void *memchr(const void *s, int c, unsigned int n)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    unsigned char b = (unsigned char)c;
+    unsigned int pattern = b * ONES;
+
+    if (memory_sse2_enabled() && n >= MEMCHR_SSE2_THRESHOLD) {
+        return memchr_sse2(s, c, n);
+    }
+
+    while (n > 0 && ((unsigned int)p & 3)) {
+        if (*p == b) {
+            return (void *)p;
+        }
+        p++;
+        n--;
+    }
+
+    /* XOR turns matching bytes into zero bytes */
+    while (n >= 4) {
+        unsigned int w = *(const unsigned int *)p ^ pattern;
+        if (has_zero_byte(w)) {
+            break;
+        }
+        p += 4;
+        n -= 4;
+    }
+
+    while (n > 0) {
+        if (*p == b) {
+            return (void *)p;
+        }
+        p++;
+        n--;
+    }
+    return 0;
+}
+
+/** uint_to_str */
+int uint_to_str(unsigned int num, char *str)
+{
+    char buf[10];
+    char *p = buf + sizeof(buf);
+    int len;
+
+    /* Two digits per division, written from the end */
+    while (num >= 100) {
+        unsigned int pair = (num % 100) * 2;
+        num /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (num >= 10) {
+        *--p = digit_pairs[num * 2 + 1];
+        *--p = digit_pairs[num * 2];
+    } else {
+        *--p = '0' + num;
+    }
+
+    len = buf + sizeof(buf) - p;
+    memcpy(str, p, len);
+    str[len] = '\0';
+    return len;
+}
+
+/** int_to_str */
+int int_to_str(int num, char *str)
+{
+    if (num < 0) {
+        /* Negate as unsigned so INT_MIN works */
+        str[0] = '-';
+        return uint_to_str(0u - (unsigned int)num, str + 1) + 1;
+    }
+    return uint_to_str((unsigned int)num, str);
+}
@@ -0,0 +1,95 @@
+#ifndef INCLUDE_KSTRING_H
+#define INCLUDE_KSTRING_H
+
+/** strlen:
+ *  Gets the length of a string
+ *
+ *  @param str  The string
+ *  @return     The number of characters before the terminator
+ */
+int strlen(const char *str);
+
+/** strcmp:
+ *  Compares two strings
+ *
+ *  @param s1  The first string
+ *  @param s2  The second string
+ *  @return    0 if equal, otherwise the difference of the first differing
+ *             characters (as unsigned char)
+ */
+int strcmp(const char *s1, const char *s2);
+
+/** strncmp:
+ *  Compares at most n characters of two strings
+ *
+ *  @param s1  The first string
+ *  @param s2  The second string
+ *  @param n   The maximum number of characters to compare
+ *  @return    As strcmp
+ */
+int strncmp(const char *s1, const char *s2, unsigned int n);
+
+/** strcpy:
+ *  Copies a string, including the terminator
+ *
+ *  @param dest  The destination, large enough for src
+ *  @param src   The string
+ */
+void strcpy(char *dest, const char *src);
+
+/** strlcpy:
+ *  Copies a string, truncating it to fit size bytes with the terminator
+ *
+ *  @param dest  The destination
+ *  @param src   The string
+ *  @param size  The size of dest, at least 1
+ *  @return      The number of characters copied
+ */
+int strlcpy(char *dest, const char *src, int size);
+
+/** strcat:
+ *  Appends a string
+ *
+ *  @param dest  The string to append to, large enough for both
+ *  @param src   The string to append
+ */
+void strcat(char *dest, const char *src);
+
+/** strstr:
+ *  Finds a substring
+ *
+ *  @param haystack  The string to search
+ *  @param needle    The string to find
+ *  @return          The first occurrence, or 0 if there is none
+ */
+char *strstr(const char *haystack, const char *needle);
+
+/** memchr:
+ *  Finds a byte
+ *
+ *  @param s  The memory to search
+ *  @param c  The byte value
+ *  @param n  The number of bytes to search
+ *  @return   The first occurrence, or 0 if there is none
+ */
+void *memchr(const void *s, int c, unsigned int n);
+
+/** int_to_str:
+ *  Formats a signed integer in decimal
+ *
+ *  @param num  The number
+ *  @param str  The destination, at least 12 bytes
+ *  @return     The number of characters written, without the terminator
+ */
+int int_to_str(int num, char *str);
+
+/** uint_to_str:
+ *  Formats an unsigned integer in decimal
+ *
+ *  @param num  The number
+ *  @param str  The destination, at least 11 bytes
+ *  @return     The number of characters written, without the terminator
+ */
+int uint_to_str(unsigned int num, char *str);
+
+#endif /* INCLUDE_KSTRING_H */
@@ -0,0 +1,83 @@
+; kstring_asm.s - SSE2 string scanning
+; Called from kstring.c when memory_sse2_enabled(). cdecl.
+
+section .text
+
+; strlen_sse2: unsigned int strlen_sse2(const char *str)
+; Scans aligned 16-byte blocks for a zero byte. An aligned block never
+; crosses a page, so reading past the terminator can't fault.
+global strlen_sse2
+strlen_sse2:
+    mov eax, [esp + 4]          ; str
+    mov ecx, eax
+    and ecx, 15                 ; offset into the first block
+    and eax, ~15
+    pxor xmm0, xmm0
+
+    ; First block: ignore the bytes before str
+    movdqa xmm1, [eax]
+    pcmpeqb xmm1, xmm0
+    pmovmskb edx, xmm1
+    shr edx, cl
+    shl edx, cl
+    test edx, edx
+    jnz .found
+
+.loop:
+    add eax, 16
+    movdqa xmm1, [eax]
+    pcmpeqb xmm1, xmm0
+    pmovmskb edx, xmm1
+    test edx, edx
+    jz .loop
+
+.found:
+    bsf edx, edx
+    add eax, edx
+    sub eax, [esp + 4]
+    ret
+
+; memchr_sse2: void *memchr_sse2(const void *s, int c, unsigned int n)
+; Requires n >= 16. Checks 16 bytes per iteration with unaligned loads,
+; then one overlapping load for the last partial block.
+global memchr_sse2
+memchr_sse2:
+    push esi
+    mov esi, [esp + 8]          ; s
+    movzx eax, byte [esp + 12]  ; c
+    mov ecx, [esp + 16]         ; n
+
+    ; Broadcast c to all 16 lanes of xmm0
+    movd xmm0, eax
+    punpcklbw xmm0, xmm0
+    punpcklwd xmm0, xmm0
+    pshufd xmm0, xmm0, 0
+
+    lea edx, [esi + ecx - 16]   ; start of the last full block
+.loop:
+    cmp esi, edx
+    jae .last
+    movdqu xmm1, [esi]
+    pcmpeqb xmm1, xmm0
+    pmovmskb eax, xmm1
+    test eax, eax
+    jnz .found
+    add esi, 16
+    jmp .loop
+
+.last:
+    mov esi, edx
+    movdqu xmm1, [esi]
+    pcmpeqb xmm1, xmm0
+    pmovmskb eax, xmm1
+    test eax, eax
+    jnz .found
+    xor eax, eax
+    pop esi
+    ret
+
+.found:
+    bsf eax, eax
+    add eax, esi
+    pop esi
+    ret
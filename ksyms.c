@@ -0,0 +1,34 @@
+/**
+ * ksyms.c - Kernel symbol lookup for backtraces
+ *
+ * The table itself is generated by the Makefile: the kernel is linked
+ * once with an empty table, its text symbols are extracted with nm, and
+ * the kernel is linked again with the real table. The table lives in
+ * .rodata, after .text, so adding it does not move any function.
+ */
+
+#include "ksyms.h"
+
+/** ksyms_lookup */
+const char *ksyms_lookup(unsigned int address, unsigned int *offset)
+{
+    unsigned int low = 0;
+    unsigned int high = ksyms_count;
+
+    if (ksyms_count == 0 || address < ksyms_table[0].address) {
+        return 0;
+    }
+
+    /* Last symbol whose address is <= the given one */
+    while (high - low > 1) {
+        unsigned int mid = low + (high - low) / 2;
+        if (ksyms_table[mid].address <= address) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    *offset = address - ksyms_table[low].address;
+    return ksyms_table[low].name;
+}
@@ -0,0 +1,23 @@
+#ifndef INCLUDE_KSYMS_H
+#define INCLUDE_KSYMS_H
+
+/* One kernel text symbol */
+struct ksym {
+    unsigned int address;
+    const char *name;
+};
+
+/* Generated at link time by gen_ksyms.sh, sorted by address */
+extern const struct ksym ksyms_table[];
+extern const unsigned int ksyms_count;
+
+/** ksyms_lookup:
+ *  Finds the function containing a code address
+ *
+ *  @param address  The code address
+ *  @param offset   Set to the distance from the start of the function
+ *  @return         The function name, or 0 if the address is not covered
+ */
+const char *ksyms_lookup(unsigned int address, unsigned int *offset);
+
+#endif /* INCLUDE_KSYMS_H */
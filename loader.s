@@ -1,27 +1,70 @@
 global loader                   ; the entry symbol for ELF
 
 MAGIC_NUMBER equ 0x1BADB002     ; define the magic number constant
-FLAGS        equ 0x0            ; multiboot flags
-CHECKSUM     equ -MAGIC_NUMBER  ; calculate the checksum
+ALIGN_MODULES equ 1 << 0        ; load modules on page boundaries
+MEMINFO      equ 1 << 1         ; provide the memory map
+FLAGS        equ ALIGN_MODULES | MEMINFO ; multiboot flags
+CHECKSUM     equ -(MAGIC_NUMBER + FLAGS) ; calculate the checksum
 
 KERNEL_STACK_SIZE equ 4096      ; size of stack in bytes
 
+KERNEL_VIRTUAL_BASE equ 0xC0000000          ; must match link.ld
+KERNEL_PDE_INDEX    equ KERNEL_VIRTUAL_BASE >> 22
+
+BOOT_PDE_FLAGS equ 0x83         ; present, writable, 4 MB page
+CR4_PSE        equ 1 << 4       ; 4 MB pages
+CR0_PG         equ 1 << 31      ; paging
+
 section .text                   ; start of the text (code) section
 align 4                         ; the code must be 4 byte aligned
     dd MAGIC_NUMBER             ; write the magic number to the machine code,
     dd FLAGS                    ; the flags,
     dd CHECKSUM                 ; and the checksum
 
+; GRUB jumps here at the physical address (loader_phys in link.ld) with
+; paging off, so until the jump to .higher_half only physical addresses
+; may be used. EAX and EBX hold the multiboot magic and info pointer.
 loader:                         ; the loader label (defined as entry point in linker script)
+    mov ecx, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov cr3, ecx                ; physical address of the boot page directory
+
+    mov ecx, cr4
+    or ecx, CR4_PSE             ; the boot mappings are 4 MB pages
+    mov cr4, ecx
+
+    mov ecx, cr0
+    or ecx, CR0_PG              ; turn paging on
+    mov cr0, ecx
+
+    lea ecx, [.higher_half]     ; absolute, so this jumps to 3 GB + x
+    jmp ecx
+
+.higher_half:
     mov esp, kernel_stack + KERNEL_STACK_SIZE   ; point esp to the start of the stack
-    
+    xor ebp, ebp                ; terminate the frame chain for backtraces
+
+    push ebx                    ; kmain's second argument: multiboot info (physical)
+    push eax                    ; kmain's first argument: bootloader magic
+
     extern kmain
     call kmain                  ; call the C function
     
 .loop:
     jmp .loop                   ; loop forever
 
+section .data align=4096        ; CR3 takes a page aligned address
+; The first 8 MB mapped twice: at 0 so the instructions after enabling
+; paging still run, and at 3 GB where the kernel is linked. paging_init
+; replaces it with the real kernel page directory.
+boot_page_directory:
+    dd 0x00000000 | BOOT_PDE_FLAGS
+    dd 0x00400000 | BOOT_PDE_FLAGS
+    times (KERNEL_PDE_INDEX - 2) dd 0
+    dd 0x00000000 | BOOT_PDE_FLAGS
+    dd 0x00400000 | BOOT_PDE_FLAGS
+    times (1024 - KERNEL_PDE_INDEX - 2) dd 0
+
 section .bss
 align 4                         ; align at 4 bytes
 kernel_stack:                   ; label points to beginning of memory
-    resb KERNEL_STACK_SIZE      ; reserve stack for the kernel
\ No newline at end of file
+    resb KERNEL_STACK_SIZE      ; reserve stack for the kernel
@@ -0,0 +1,58 @@
+/**
+ * meminfo.c - Live memory statistics
+ *
+ * Nothing is cached here: every call reads the counters the allocators
+ * keep, so mem, sysinfo and /proc/meminfo always show the current state.
+ */
+
+#include "meminfo.h"
+#include "pmm.h"
+#include "slab.h"
+#include "paging.h"
+#include "kstack.h"
+#include "filesystem.h"
+
+#define FRAME_KB    (PMM_FRAME_SIZE / 1024)
+
+/** bytes_to_kb */
+static unsigned int bytes_to_kb(unsigned int bytes)
+{
+    return (bytes + 1023) / 1024;
+}
+
+/** meminfo_get */
+void meminfo_get(struct meminfo *info)
+{
+    const struct kstack *stack;
+    unsigned int slab_frames, slab_bytes;
+    unsigned int large_allocs, large_frames;
+    unsigned int file_bytes, file_alloc;
+    unsigned int counted;
+
+    info->total = pmm_get_total_frames() * FRAME_KB;
+    info->free = pmm_get_free_frames() * FRAME_KB;
+    info->used = info->total - info->free;
+    info->reserved = pmm_get_reserved_frames() * FRAME_KB;
+    info->kernel = bytes_to_kb(pmm_get_kernel_size());
+
+    slab_stats(&slab_frames, &slab_bytes);
+    kmalloc_large_stats(&large_allocs, &large_frames);
+    info->slab = slab_frames * FRAME_KB;
+    info->slab_active = bytes_to_kb(slab_bytes);
+    info->heap_large = large_frames * FRAME_KB;
+
+    info->page_tables = paging_get_table_frames() * FRAME_KB;
+
+    info->kernel_stack = 0;
+    for (stack = kstack_list(); stack; stack = stack->next) {
+        info->kernel_stack += stack->size / 1024;
+    }
+
+    counted = info->reserved + info->slab + info->heap_large +
+              info->page_tables + info->kernel_stack;
+    info->other = info->used > counted ? info->used - counted : 0;
+
+    fs_get_usage(&info->files, &file_bytes, &file_alloc);
+    info->cached = bytes_to_kb(file_alloc);
+    info->file_data = bytes_to_kb(file_bytes);
+}
@@ -0,0 +1,32 @@
+#ifndef INCLUDE_MEMINFO_H
+#define INCLUDE_MEMINFO_H
+
+/** Memory usage in KB, read live from the allocators */
+struct meminfo {
+    unsigned int total;         /* Usable RAM from the memory map */
+    unsigned int free;          /* Free frames */
+    unsigned int used;          /* total - free */
+    unsigned int reserved;      /* Kernel image, boot information, modules */
+    unsigned int kernel;        /* The kernel image alone, code through bss */
+    unsigned int slab;          /* Frames in slab caches */
+    unsigned int slab_active;   /* Allocated objects in them */
+    unsigned int heap_large;    /* Whole-frame kmalloc allocations */
+    unsigned int page_tables;   /* Page directories and tables */
+    unsigned int kernel_stack;  /* Guarded kernel stacks */
+    unsigned int other;         /* Used frames not counted above */
+    unsigned int cached;        /* Heap memory holding file contents */
+    unsigned int file_data;     /* Bytes in files, rounded up to KB */
+    unsigned int files;         /* Number of files (a count, not KB) */
+};
+
+/** meminfo_get:
+ *  Collects the current memory usage from the frame allocator, the
+ *  heap, paging, kernel stacks and the filesystem. Cached and file_data
+ *  are part of slab and heap_large; the RAM filesystem has no separate
+ *  page cache, its contents are the cache.
+ *
+ *  @param info  Filled in
+ */
+void meminfo_get(struct meminfo *info);
+
+#endif /* INCLUDE_MEMINFO_H */
@@ -0,0 +1,153 @@
+/**
+ * memory.c - Freestanding memcpy, memmove, memset and memcmp
+ *
+ * The common path uses rep movsd / rep stosd. Large copies and fills use
+ * SSE2 loops (memory_asm.s) when memory_init found SSE usable.
+ */
+
+#include "memory.h"
+#include "hardware.h"
+
+/* CPUID.1:EDX bit for SSE2 */
+#define CPUID_EDX_SSE2  (1 << 26)
+
+/* CR4 bit enabling fxsave/fxrstor and SSE instructions */
+#define CR4_OSFXSR      (1 << 9)
+
+/* Below this size the SSE2 setup costs more than it saves */
+#define MEM_SSE2_THRESHOLD  256
+
+/* From memory_asm.s */
+void memcpy_sse2(void *dest, const void *src, unsigned int n);
+void memset_sse2(void *dest, int c, unsigned int n);
+
+static int use_sse2 = 0;
+
+/** read_cr4 */
+static unsigned int read_cr4(void)
+{
+    unsigned int value;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+/** memory_init */
+void memory_init(void)
+{
+    unsigned int edx, ecx;
+
+    hw_get_cpu_features(&edx, &ecx);
+    use_sse2 = (edx & CPUID_EDX_SSE2) && (read_cr4() & CR4_OSFXSR);
+}
+
+/** memory_sse2_enabled */
+int memory_sse2_enabled(void)
+{
+    return use_sse2;
+}
+
+/** copy_forward:
+ *  rep movsd for the dwords, rep movsb for the rest
+ */
+static void copy_forward(void *dest, const void *src, unsigned int n)
+{
+    unsigned int dwords = n >> 2;
+    unsigned int bytes = n & 3;
+
+    __asm__ volatile("rep movsl\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep movsb"
+                     : "+D"(dest), "+S"(src), "+c"(dwords)
+                     : "r"(bytes)
+                     : "memory");
+}
+
+/** memcpy */
+void *memcpy(void *dest, const void *src, unsigned int n)
+{
+    if (use_sse2 && n >= MEM_SSE2_THRESHOLD) {
+        memcpy_sse2(dest, src, n);
+    } else {
+        copy_forward(dest, src, n);
+    }
+    return dest;
+}
+
+/** memmove */
+void *memmove(void *dest, const void *src, unsigned int n)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if (d <= s || d >= s + n) {
+        /* A forward copy never overwrites source it hasn't read yet */
+        return memcpy(dest, src, n);
+    }
+
+    /* dest overlaps the end of src: copy backwards, odd bytes first */
+    {
+        unsigned int bytes = n & 3;
+        unsigned int dwords = n >> 2;
+        unsigned char *dp = d + n - 1;
+        const unsigned char *sp = s + n - 1;
+
+        __asm__ volatile("std\n\t"
+                         "rep movsb\n\t"
+                         "sub $3, %%edi\n\t"
+                         "sub $3, %%esi\n\t"
+                         "mov %3, %%ecx\n\t"
+                         "rep movsl\n\t"
+                         "cld"
+                         : "+D"(dp), "+S"(sp), "+c"(bytes)
+                         : "r"(dwords)
+                         : "memory", "cc");
+    }
+    return dest;
+}
+
+/** memset */
+void *memset(void *dest, int c, unsigned int n)
+{
+    unsigned int value = (unsigned char)c;
+    unsigned int dwords = n >> 2;
+    unsigned int bytes = n & 3;
+    void *d = dest;
+
+    if (use_sse2 && n >= MEM_SSE2_THRESHOLD) {
+        memset_sse2(dest, c, n);
+        return dest;
+    }
+
+    value |= value << 8;
+    value |= value << 16;
+    __asm__ volatile("rep stosl\n\t"
+                     "mov %2, %%ecx\n\t"
+                     "rep stosb"
+                     : "+D"(d), "+c"(dwords)
+                     : "r"(bytes), "a"(value)
+                     : "memory");
+    return dest;
+}
+
+/** memcmp */
+int memcmp(const void *a, const void *b, unsigned int n)
+{
+    const unsigned char *pa = (const unsigned char *)a;
+    const unsigned char *pb = (const unsigned char *)b;
+
+    /* Skip equal dwords, then find the differing byte */
+    while (n >= 4 && *(const unsigned int *)pa == *(const unsigned int *)pb) {
+        pa += 4;
+        pb += 4;
+        n -= 4;
+    }
+    while (n > 0) {
+        if (*pa != *pb) {
+            return *pa - *pb;
+        }
+        pa++;
+        pb++;
+        n--;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef INCLUDE_MEMORY_H
+#define INCLUDE_MEMORY_H
+
+/** memory_init:
+ *  Chooses the copy and fill routines for this CPU. The SSE2 versions
+ *  are used when the CPU has SSE2 and SSE state has been enabled.
+ */
+void memory_init(void);
+
+/** memory_sse2_enabled:
+ *  Whether the SSE2 routines were chosen
+ *
+ *  @return 1 if memcpy and memset use SSE2 for large sizes
+ */
+int memory_sse2_enabled(void);
+
+/** memcpy:
+ *  Copies n bytes. The areas must not overlap.
+ *
+ *  @param dest  The destination
+ *  @param src   The source
+ *  @param n     The number of bytes
+ *  @return      dest
+ */
+void *memcpy(void *dest, const void *src, unsigned int n);
+
+/** memmove:
+ *  Copies n bytes. The areas may overlap.
+ *
+ *  @param dest  The destination
+ *  @param src   The source
+ *  @param n     The number of bytes
+ *  @return      dest
+ */
+void *memmove(void *dest, const void *src, unsigned int n);
+
+/** memset:
+ *  Fills n bytes with a value
+ *
+ *  @param dest  The destination
+ *  @param c     The byte value
+ *  @param n     The number of bytes
+ *  @return      dest
+ */
+void *memset(void *dest, int c, unsigned int n);
+
+/** memcmp:
+ *  Compares n bytes
+ *
+ *  @param a  The first area
+ *  @param b  The second area
+ *  @param n  The number of bytes
+ *  @return   0 if equal, otherwise the difference of the first differing
+ *            bytes (as unsigned char)
+ */
+int memcmp(const void *a, const void *b, unsigned int n);
+
+#endif /* INCLUDE_MEMORY_H */
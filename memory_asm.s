@@ -0,0 +1,92 @@
+; memory_asm.s - SSE2 copy and fill loops
+; Called from memory.c for large sizes once SSE state is enabled.
+; cdecl: arguments on the stack, eax/ecx/edx are scratch.
+
+section .text
+
+; memcpy_sse2: void memcpy_sse2(void *dest, const void *src, unsigned int n)
+; Requires n >= 64. Aligns the destination to 16 bytes, then copies 64
+; bytes per iteration with unaligned loads and aligned stores.
+global memcpy_sse2
+memcpy_sse2:
+    push edi
+    push esi
+    mov edi, [esp + 12]         ; dest
+    mov esi, [esp + 16]         ; src
+    mov ecx, [esp + 20]         ; n
+
+    ; Bytes until dest is 16-byte aligned
+    mov edx, edi
+    neg edx
+    and edx, 15
+    sub ecx, edx
+    xchg ecx, edx               ; ecx = head bytes, edx = rest
+    rep movsb
+
+    mov ecx, edx
+    shr ecx, 6                  ; 64-byte blocks
+    jz .copy_tail
+.copy_loop:
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi + 16]
+    movdqu xmm2, [esi + 32]
+    movdqu xmm3, [esi + 48]
+    movdqa [edi], xmm0
+    movdqa [edi + 16], xmm1
+    movdqa [edi + 32], xmm2
+    movdqa [edi + 48], xmm3
+    add esi, 64
+    add edi, 64
+    dec ecx
+    jnz .copy_loop
+
+.copy_tail:
+    mov ecx, edx
+    and ecx, 63
+    rep movsb
+
+    pop esi
+    pop edi
+    ret
+
+; memset_sse2: void memset_sse2(void *dest, int c, unsigned int n)
+; Requires n >= 64. Same structure as memcpy_sse2.
+global memset_sse2
+memset_sse2:
+    push edi
+    mov edi, [esp + 8]          ; dest
+    movzx eax, byte [esp + 12]  ; c
+    mov ecx, [esp + 16]         ; n
+
+    ; Broadcast the byte to all 16 lanes of xmm0
+    movd xmm0, eax
+    punpcklbw xmm0, xmm0
+    punpcklwd xmm0, xmm0
+    pshufd xmm0, xmm0, 0
+
+    mov edx, edi
+    neg edx
+    and edx, 15
+    sub ecx, edx
+    xchg ecx, edx               ; ecx = head bytes, edx = rest
+    rep stosb
+
+    mov ecx, edx
+    shr ecx, 6
+    jz .set_tail
+.set_loop:
+    movdqa [edi], xmm0
+    movdqa [edi + 16], xmm0
+    movdqa [edi + 32], xmm0
+    movdqa [edi + 48], xmm0
+    add edi, 64
+    dec ecx
+    jnz .set_loop
+
+.set_tail:
+    mov ecx, edx
+    and ecx, 63
+    rep stosb
+
+    pop edi
+    ret
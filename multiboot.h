@@ -0,0 +1,53 @@
+#ifndef INCLUDE_MULTIBOOT_H
+#define INCLUDE_MULTIBOOT_H
+
+/* Value in EAX when a multiboot loader jumps to the kernel */
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+/* multiboot_info.flags: which fields are valid */
+#define MULTIBOOT_INFO_MEMORY       (1 << 0)    /* mem_lower, mem_upper */
+#define MULTIBOOT_INFO_CMDLINE      (1 << 2)
+#define MULTIBOOT_INFO_MODS         (1 << 3)
+#define MULTIBOOT_INFO_MEM_MAP      (1 << 6)
+
+/* multiboot_mmap_entry.type */
+#define MULTIBOOT_MEMORY_AVAILABLE  1
+
+/* Boot information passed in EBX (Multiboot 0.6.96, section 3.3) */
+struct multiboot_info {
+    unsigned int flags;
+    unsigned int mem_lower;         /* KB below 1 MB */
+    unsigned int mem_upper;         /* KB from 1 MB to the first hole */
+    unsigned int boot_device;
+    unsigned int cmdline;
+    unsigned int mods_count;
+    unsigned int mods_addr;
+    unsigned int syms[4];
+    unsigned int mmap_length;
+    unsigned int mmap_addr;
+    unsigned int drives_length;
+    unsigned int drives_addr;
+    unsigned int config_table;
+    unsigned int boot_loader_name;
+    unsigned int apm_table;
+} __attribute__((packed));
+
+/* One memory map entry. size doesn't count itself: the next entry is at
+ * (char *)entry + entry->size + 4.
+ */
+struct multiboot_mmap_entry {
+    unsigned int size;
+    unsigned long long addr;
+    unsigned long long len;
+    unsigned int type;
+} __attribute__((packed));
+
+/* A boot module loaded next to the kernel */
+struct multiboot_module {
+    unsigned int mod_start;
+    unsigned int mod_end;
+    unsigned int string;
+    unsigned int reserved;
+} __attribute__((packed));
+
+#endif /* INCLUDE_MULTIBOOT_H */
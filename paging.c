@@ -0,0 +1,451 @@
+/**
+ * paging.c - Page directories, the direct map and the vmap area
+ *
+ * The kernel half of every address space is the same: the direct map of
+ * the first 768 MB of physical memory in 4 MB pages, then the vmap area
+ * with statically allocated page tables. Because those page directory
+ * entries never change after paging_init, new directories just copy
+ * them. Page tables are reached through the direct map, so no recursive
+ * mapping is needed.
+ */
+
+#include "paging.h"
+#include "pmm.h"
+#include "hardware.h"
+#include "memory.h"
+#include "smp.h"
+#include "spinlock.h"
+
+#define PDE_INDEX(v)        ((v) >> 22)
+#define PTE_INDEX(v)        (((v) >> 12) & 0x3FF)
+#define LARGE_PAGE_SIZE     0x400000
+
+#define KERNEL_PDE_FIRST    PDE_INDEX(KERNEL_VIRTUAL_BASE)
+#define VMAP_TABLES         ((PAGING_VMAP_END - PAGING_VMAP_START) / LARGE_PAGE_SIZE)
+
+/* CPUID.1 EDX and CR4 bits */
+#define CPUID_EDX_PGE       (1 << 13)
+#define CR4_PGE             (1 << 7)
+#define CR0_WP              (1 << 16)
+
+/* Longest range paging_flush_tlb_range invalidates page by page */
+#define PAGING_INVLPG_MAX   32
+
+/* Measurement loop length */
+#define CR3_ITERATIONS      1000
+
+/* User-half address of the pages touched by the refill measurement */
+#define CR3_REFILL_BASE     0x40000000
+
+static unsigned int kernel_directory[1024] __attribute__((aligned(PAGE_SIZE)));
+static unsigned int vmap_tables[VMAP_TABLES][1024] __attribute__((aligned(PAGE_SIZE)));
+
+static unsigned int *current_directory = kernel_directory;
+
+/* PAGE_GLOBAL if the CPU supports it */
+static unsigned int global_flag = 0;
+
+/* Next free vmap address */
+static unsigned int vmap_next = PAGING_VMAP_START;
+static struct spinlock vmap_lock;
+
+/* Frames holding page tables and directories of other address spaces */
+static unsigned int table_frames = 0;
+
+static struct paging_cr3_cost cr3_cost;
+
+static void write_cr3(unsigned int value)
+{
+    __asm__ volatile("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static void invlpg(unsigned int virt)
+{
+    __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+/** paging_init */
+void paging_init(void)
+{
+    unsigned int edx, ecx;
+    unsigned int i;
+
+    hw_get_cpu_features(&edx, &ecx);
+    if (edx & CPUID_EDX_PGE) {
+        global_flag = PAGE_GLOBAL;
+    }
+
+    for (i = 0; i < PAGING_DIRECT_MAP_SIZE / LARGE_PAGE_SIZE; i++) {
+        kernel_directory[KERNEL_PDE_FIRST + i] = (i * LARGE_PAGE_SIZE) |
+            PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global_flag;
+    }
+
+    for (i = 0; i < VMAP_TABLES; i++) {
+        kernel_directory[PDE_INDEX(PAGING_VMAP_START) + i] =
+            virt_to_phys(vmap_tables[i]) | PAGE_PRESENT | PAGE_WRITE;
+    }
+
+    current_directory = kernel_directory;
+    paging_init_cpu();
+}
+
+/** paging_init_cpu */
+void paging_init_cpu(void)
+{
+    write_cr3(virt_to_phys(kernel_directory));
+
+    /* Honour read-only pages in ring 0 too, for read-only fs_mmap */
+    {
+        unsigned int cr0;
+        __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+        __asm__ volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_WP) : "memory");
+    }
+
+    if (global_flag) {
+        unsigned int cr4;
+        __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4 | CR4_PGE) : "memory");
+    }
+}
+
+/** paging_flush_tlb */
+void paging_flush_tlb(void)
+{
+    unsigned int cr3;
+
+    /* Toggling CR4.PGE drops global entries too */
+    if (global_flag) {
+        unsigned int cr4;
+        __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4 & ~CR4_PGE) : "memory");
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+        return;
+    }
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    write_cr3(cr3);
+}
+
+/** paging_flush_tlb_range */
+void paging_flush_tlb_range(unsigned int virt, unsigned int pages)
+{
+    unsigned int i;
+
+    if (pages > PAGING_INVLPG_MAX) {
+        paging_flush_tlb();
+        return;
+    }
+    for (i = 0; i < pages; i++) {
+        invlpg(virt + i * PAGE_SIZE);
+    }
+}
+
+/** paging_shootdown */
+void paging_shootdown(unsigned int *dir, unsigned int virt, unsigned int pages)
+{
+    /* Every processor runs on the kernel directory */
+    if (pages && (dir == kernel_directory || virt >= KERNEL_VIRTUAL_BASE)) {
+        smp_flush_tlb_range(virt, pages);
+    }
+}
+
+/** paging_set_low_identity */
+void paging_set_low_identity(int enable)
+{
+    if (enable) {
+        kernel_directory[0] = PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE;
+    } else {
+        kernel_directory[0] = 0;
+    }
+    invlpg(0);
+}
+
+/** paging_kernel_directory */
+unsigned int *paging_kernel_directory(void)
+{
+    return kernel_directory;
+}
+
+/** paging_get_pte */
+unsigned int *paging_get_pte(unsigned int *dir, unsigned int virt, int create)
+{
+    unsigned int pde = dir[PDE_INDEX(virt)];
+    unsigned int *table;
+
+    if (pde & PAGE_PRESENT) {
+        if (pde & PAGE_LARGE) {
+            return 0;
+        }
+        table = phys_to_virt(pde & ~PAGE_FLAGS_MASK);
+        return &table[PTE_INDEX(virt)];
+    }
+
+    if (!create || virt >= KERNEL_VIRTUAL_BASE) {
+        return 0;
+    }
+
+    pde = pmm_alloc_frame();
+    if (pde == 0) {
+        return 0;
+    }
+    table_frames++;
+    table = phys_to_virt(pde);
+    memset(table, 0, PAGE_SIZE);
+    dir[PDE_INDEX(virt)] = pde | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+    return &table[PTE_INDEX(virt)];
+}
+
+/** paging_map_page */
+int paging_map_page(unsigned int *dir, unsigned int virt, unsigned int phys,
+                    unsigned int flags)
+{
+    unsigned int *pte = paging_get_pte(dir, virt, 1);
+
+    if (!pte) {
+        return -1;
+    }
+
+    if (virt >= KERNEL_VIRTUAL_BASE) {
+        flags |= global_flag;
+    }
+    *pte = (phys & ~PAGE_FLAGS_MASK) | (flags & PAGE_FLAGS_MASK) | PAGE_PRESENT;
+
+    if (dir == current_directory || virt >= KERNEL_VIRTUAL_BASE) {
+        invlpg(virt);
+    }
+    return 0;
+}
+
+/** paging_unmap_page */
+unsigned int paging_unmap_page(unsigned int *dir, unsigned int virt)
+{
+    unsigned int *pte = paging_get_pte(dir, virt, 0);
+    unsigned int phys;
+
+    if (!pte || !(*pte & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    phys = *pte & ~PAGE_FLAGS_MASK;
+    *pte = 0;
+
+    if (dir == current_directory || virt >= KERNEL_VIRTUAL_BASE) {
+        invlpg(virt);
+    }
+    return phys;
+}
+
+/** paging_test_and_clear_dirty */
+int paging_test_and_clear_dirty(unsigned int *dir, unsigned int virt)
+{
+    unsigned int *pte = paging_get_pte(dir, virt, 0);
+
+    if (!pte || (*pte & (PAGE_PRESENT | PAGE_DIRTY)) != (PAGE_PRESENT | PAGE_DIRTY)) {
+        return 0;
+    }
+
+    *pte &= ~PAGE_DIRTY;
+
+    /* A cached translation would let the next write skip setting it */
+    if (dir == current_directory || virt >= KERNEL_VIRTUAL_BASE) {
+        invlpg(virt);
+    }
+    return 1;
+}
+
+/** paging_translate */
+int paging_translate(unsigned int *dir, unsigned int virt, unsigned int *phys)
+{
+    unsigned int pde = dir[PDE_INDEX(virt)];
+    unsigned int *pte;
+
+    if (!(pde & PAGE_PRESENT)) {
+        return -1;
+    }
+
+    if (pde & PAGE_LARGE) {
+        *phys = (pde & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+        return 0;
+    }
+
+    pte = paging_get_pte(dir, virt, 0);
+    if (!pte || !(*pte & PAGE_PRESENT)) {
+        return -1;
+    }
+
+    *phys = (*pte & ~PAGE_FLAGS_MASK) | (virt & PAGE_FLAGS_MASK);
+    return 0;
+}
+
+/** paging_create_directory */
+unsigned int *paging_create_directory(void)
+{
+    unsigned int frame = pmm_alloc_frame();
+    unsigned int *dir;
+
+    if (frame == 0) {
+        return 0;
+    }
+    table_frames++;
+
+    dir = phys_to_virt(frame);
+    memset(dir, 0, KERNEL_PDE_FIRST * sizeof(unsigned int));
+    memcpy(&dir[KERNEL_PDE_FIRST], &kernel_directory[KERNEL_PDE_FIRST],
+           (1024 - KERNEL_PDE_FIRST) * sizeof(unsigned int));
+    return dir;
+}
+
+/** paging_destroy_directory */
+void paging_destroy_directory(unsigned int *dir)
+{
+    unsigned int i;
+
+    if (dir == kernel_directory || dir == current_directory) {
+        return;
+    }
+
+    for (i = 0; i < KERNEL_PDE_FIRST; i++) {
+        if ((dir[i] & PAGE_PRESENT) && !(dir[i] & PAGE_LARGE)) {
+            pmm_free_frame(dir[i] & ~PAGE_FLAGS_MASK);
+            table_frames--;
+        }
+    }
+    pmm_free_frame(virt_to_phys(dir));
+    table_frames--;
+}
+
+/** paging_switch_directory */
+void paging_switch_directory(unsigned int *dir)
+{
+    current_directory = dir;
+    write_cr3(virt_to_phys(dir));
+}
+
+/** paging_vmap_reserve */
+unsigned int paging_vmap_reserve(unsigned int size)
+{
+    unsigned int pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned int virt = 0;
+    unsigned int flags;
+
+    /* Threads may reserve concurrently, on any processor */
+    flags = spin_lock_irqsave(&vmap_lock);
+    if (size != 0 && pages <= (PAGING_VMAP_END - vmap_next) / PAGE_SIZE) {
+        virt = vmap_next;
+        vmap_next += pages * PAGE_SIZE;
+    }
+    spin_unlock_irqrestore(&vmap_lock, flags);
+    return virt;
+}
+
+/** paging_vmap */
+void *paging_vmap(unsigned int phys, unsigned int size, unsigned int flags)
+{
+    unsigned int offset = phys & PAGE_FLAGS_MASK;
+    unsigned int virt;
+    unsigned int i;
+
+    if (size == 0 || size > 0xFFFFFFFF - offset) {
+        return 0;
+    }
+
+    virt = paging_vmap_reserve(offset + size);
+    if (virt == 0) {
+        return 0;
+    }
+
+    phys -= offset;
+    for (i = 0; i < offset + size; i += PAGE_SIZE) {
+        paging_map_page(kernel_directory, virt + i, phys + i, flags);
+    }
+
+    return (void *)(virt + offset);
+}
+
+/** cr3_loop:
+ *  Average cycles of CR3_ITERATIONS loads alternating between a and b,
+ *  touching `touch` pages from CR3_REFILL_BASE after each load
+ */
+static unsigned int cr3_loop(unsigned int a, unsigned int b, unsigned int touch)
+{
+    unsigned long long start;
+    unsigned int i, j;
+
+    start = hw_read_tsc();
+    for (i = 0; i < CR3_ITERATIONS; i++) {
+        write_cr3((i & 1) ? b : a);
+        for (j = 0; j < touch; j++) {
+            (void)*(volatile unsigned int *)(CR3_REFILL_BASE + j * PAGE_SIZE);
+        }
+    }
+    return (unsigned int)(hw_read_tsc() - start) / CR3_ITERATIONS;
+}
+
+/** cr3_measure:
+ *  Maps the refill pages in both directories and runs the three loops
+ */
+static int cr3_measure(unsigned int *other, unsigned int frame)
+{
+    unsigned int kernel_cr3 = virt_to_phys(kernel_directory);
+    unsigned int other_cr3 = virt_to_phys(other);
+    unsigned int flags;
+    unsigned int i;
+
+    /* The same frame at every address: one TLB entry per page either way */
+    for (i = 0; i < PAGING_REFILL_PAGES; i++) {
+        unsigned int virt = CR3_REFILL_BASE + i * PAGE_SIZE;
+
+        if (paging_map_page(kernel_directory, virt, frame, 0) < 0 ||
+            paging_map_page(other, virt, frame, 0) < 0) {
+            return -1;
+        }
+    }
+
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    cr3_cost.reload = cr3_loop(kernel_cr3, kernel_cr3, 0);
+    cr3_cost.swap = cr3_loop(kernel_cr3, other_cr3, 0);
+    cr3_cost.refill = cr3_loop(kernel_cr3, other_cr3, PAGING_REFILL_PAGES);
+    write_cr3(kernel_cr3);
+    __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+
+    return 0;
+}
+
+/** paging_measure_cr3 */
+int paging_measure_cr3(void)
+{
+    unsigned int *other = paging_create_directory();
+    unsigned int frame = pmm_alloc_frame();
+    unsigned int refill_pde = PDE_INDEX(CR3_REFILL_BASE);
+    int ret = -1;
+
+    if (other && frame) {
+        ret = cr3_measure(other, frame);
+    }
+
+    /* Drop the test page table from the kernel directory again */
+    if (kernel_directory[refill_pde] & PAGE_PRESENT) {
+        pmm_free_frame(kernel_directory[refill_pde] & ~PAGE_FLAGS_MASK);
+        table_frames--;
+        kernel_directory[refill_pde] = 0;
+        write_cr3(virt_to_phys(kernel_directory));
+    }
+    if (other) {
+        paging_destroy_directory(other);
+    }
+    if (frame) {
+        pmm_free_frame(frame);
+    }
+    return ret;
+}
+
+/** paging_get_table_frames */
+unsigned int paging_get_table_frames(void)
+{
+    return table_frames;
+}
+
+/** paging_get_cr3_cost */
+void paging_get_cr3_cost(struct paging_cr3_cost *cost)
+{
+    *cost = cr3_cost;
+}
@@ -0,0 +1,223 @@
+#ifndef INCLUDE_PAGING_H
+#define INCLUDE_PAGING_H
+
+/* The kernel is linked at 3 GB + 1 MB (link.ld, loader.s) */
+#define KERNEL_VIRTUAL_BASE     0xC0000000
+
+/* Physical memory 0-768 MB is mapped at KERNEL_VIRTUAL_BASE with 4 MB
+ * pages. The PMM only hands out frames from this range.
+ */
+#define PAGING_DIRECT_MAP_SIZE  0x30000000
+
+/* Kernel virtual mappings of MMIO and firmware tables, in 4 KB pages */
+#define PAGING_VMAP_START       0xF0000000
+#define PAGING_VMAP_END         0xF4000000
+
+#define PAGE_SIZE               4096
+
+/* Page directory and page table entry bits */
+#define PAGE_PRESENT    (1 << 0)
+#define PAGE_WRITE      (1 << 1)
+#define PAGE_USER       (1 << 2)
+#define PAGE_PWT        (1 << 3)    /* Write-through */
+#define PAGE_PCD        (1 << 4)    /* Cache disabled */
+#define PAGE_ACCESSED   (1 << 5)
+#define PAGE_DIRTY      (1 << 6)
+#define PAGE_LARGE      (1 << 7)    /* PDE only: 4 MB page */
+#define PAGE_GLOBAL     (1 << 8)    /* Kept in the TLB across CR3 loads */
+
+#define PAGE_FLAGS_MASK 0xFFF
+#define PAGE_MMIO       (PAGE_WRITE | PAGE_PCD | PAGE_PWT)
+
+/* Directly mapped memory: physical <-> kernel virtual */
+#define phys_to_virt(p) ((void *)((unsigned int)(p) + KERNEL_VIRTUAL_BASE))
+#define virt_to_phys(v) ((unsigned int)(v) - KERNEL_VIRTUAL_BASE)
+
+/* Cycles per CR3 load, measured by paging_measure_cr3 */
+struct paging_cr3_cost {
+    unsigned int reload;    /* Reloading the current directory */
+    unsigned int swap;      /* Switching between two directories */
+    unsigned int refill;    /* Switching, then touching PAGING_REFILL_PAGES
+                               non-global pages */
+};
+
+#define PAGING_REFILL_PAGES 16
+
+/** paging_init:
+ *  Builds the kernel page directory: the direct map with 4 MB global
+ *  pages and the page tables of the vmap area. Drops the identity map
+ *  of the first 8 MB that loader.s set up, so null pointers fault.
+ *  Sets CR0.WP so read-only pages also fault on kernel writes.
+ */
+void paging_init(void);
+
+/** paging_init_cpu:
+ *  Gives an application processor the boot processor's paging setup:
+ *  the kernel page directory, CR0.WP and global pages
+ */
+void paging_init_cpu(void);
+
+/** paging_flush_tlb:
+ *  Flushes the calling processor's TLB, global pages included
+ */
+void paging_flush_tlb(void);
+
+/** paging_flush_tlb_range:
+ *  Drops a range of pages from the calling processor's TLB, or the
+ *  whole TLB when the range is long
+ *
+ *  @param virt   The first page
+ *  @param pages  The number of pages
+ */
+void paging_flush_tlb_range(unsigned int virt, unsigned int pages);
+
+/** paging_shootdown:
+ *  Drops a range from the other processors' TLBs after its mappings were
+ *  removed or changed with paging_unmap_page or
+ *  paging_test_and_clear_dirty. Only kernel directory and kernel half
+ *  mappings are shared; other ranges need nothing.
+ *
+ *  @param dir    The page directory
+ *  @param virt   The first page
+ *  @param pages  The number of pages
+ */
+void paging_shootdown(unsigned int *dir, unsigned int virt, unsigned int pages);
+
+/** paging_set_low_identity:
+ *  Maps or unmaps the first 4 MB 1:1 in the kernel page directory. The
+ *  SMP trampoline needs it while it turns paging on; null pointers don't
+ *  fault in the meantime.
+ *
+ *  @param enable  Non-zero to map, 0 to unmap
+ */
+void paging_set_low_identity(int enable);
+
+/** paging_kernel_directory:
+ *  Gets the kernel page directory
+ *
+ *  @return The directory
+ */
+unsigned int *paging_kernel_directory(void);
+
+/** paging_get_pte:
+ *  Finds the page table entry for an address. Below KERNEL_VIRTUAL_BASE
+ *  a missing page table can be allocated; the kernel half is shared by
+ *  every directory and never changes after paging_init.
+ *
+ *  @param dir     The page directory
+ *  @param virt    The virtual address
+ *  @param create  Allocate a missing page table when non-zero
+ *  @return        The entry, or 0 if there is none or a 4 MB page
+ *                 covers the address
+ */
+unsigned int *paging_get_pte(unsigned int *dir, unsigned int virt, int create);
+
+/** paging_map_page:
+ *  Maps one 4 KB page
+ *
+ *  @param dir    The page directory
+ *  @param virt   The virtual address
+ *  @param phys   The physical address
+ *  @param flags  PAGE_* bits; PAGE_PRESENT is implied
+ *  @return       0 on success, -1 if no page table could be set up
+ */
+int paging_map_page(unsigned int *dir, unsigned int virt, unsigned int phys,
+                    unsigned int flags);
+
+/** paging_unmap_page:
+ *  Removes a 4 KB mapping. The frame isn't freed. Other processors keep
+ *  the old translation until paging_shootdown.
+ *
+ *  @param dir   The page directory
+ *  @param virt  The virtual address
+ *  @return      The physical address it mapped, or 0 if none
+ */
+unsigned int paging_unmap_page(unsigned int *dir, unsigned int virt);
+
+/** paging_test_and_clear_dirty:
+ *  Checks whether a page was written since it was mapped or last
+ *  checked, and clears its dirty bit. Other processors may write it
+ *  without setting the bit again until paging_shootdown.
+ *
+ *  @param dir   The page directory
+ *  @param virt  The virtual address
+ *  @return      1 if the page is dirty, 0 if clean or not mapped
+ */
+int paging_test_and_clear_dirty(unsigned int *dir, unsigned int virt);
+
+/** paging_translate:
+ *  Looks up the physical address of a virtual one
+ *
+ *  @param dir   The page directory
+ *  @param virt  The virtual address
+ *  @param phys  Set to the physical address
+ *  @return      0 on success, -1 if the address isn't mapped
+ */
+int paging_translate(unsigned int *dir, unsigned int virt, unsigned int *phys);
+
+/** paging_create_directory:
+ *  Creates an address space with an empty user half and the shared
+ *  kernel half
+ *
+ *  @return The directory, or 0 if memory is exhausted
+ */
+unsigned int *paging_create_directory(void);
+
+/** paging_destroy_directory:
+ *  Frees a directory from paging_create_directory and its user page
+ *  tables. The frames they mapped aren't freed.
+ *
+ *  @param dir  The directory, not the current one
+ */
+void paging_destroy_directory(unsigned int *dir);
+
+/** paging_switch_directory:
+ *  Loads CR3. Global kernel mappings stay in the TLB.
+ *
+ *  @param dir  The directory
+ */
+void paging_switch_directory(unsigned int *dir);
+
+/** paging_vmap:
+ *  Maps physical memory outside the direct map (MMIO, firmware tables)
+ *  into the vmap area. Mappings are permanent.
+ *
+ *  @param phys   The physical address
+ *  @param size   The number of bytes
+ *  @param flags  PAGE_* bits, e.g. PAGE_MMIO
+ *  @return       The virtual address of phys, or 0 if the area is full
+ */
+void *paging_vmap(unsigned int phys, unsigned int size, unsigned int flags);
+
+/** paging_vmap_reserve:
+ *  Reserves kernel address space in the vmap area without mapping it,
+ *  for callers that map pages themselves (e.g. stacks with a guard page)
+ *
+ *  @param size  The number of bytes, rounded up to pages
+ *  @return      The page aligned address, or 0 if the area is full
+ */
+unsigned int paging_vmap_reserve(unsigned int size);
+
+/** paging_measure_cr3:
+ *  Measures the cost of CR3 loads with the TSC. Needs the PMM.
+ *
+ *  @return 0 on success, -1 if the test directory couldn't be set up
+ */
+int paging_measure_cr3(void);
+
+/** paging_get_table_frames:
+ *  Gets the frames allocated for page directories and tables. The
+ *  kernel directory and the vmap tables are part of the kernel image.
+ *
+ *  @return The frame count
+ */
+unsigned int paging_get_table_frames(void);
+
+/** paging_get_cr3_cost:
+ *  Gets the costs measured at boot
+ *
+ *  @param cost  Filled with cycles per load, all 0 if not measured
+ */
+void paging_get_cr3_cost(struct paging_cr3_cost *cost);
+
+#endif /* INCLUDE_PAGING_H */
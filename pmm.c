@@ -0,0 +1,325 @@
+/**
+ * pmm.c - Physical frame allocator
+ *
+ * One bit per 4 KB frame of the direct map (the first 768 MB, see
+ * paging.h), set while the frame is used or doesn't exist. Memory above
+ * it is ignored, so every frame has a kernel address via phys_to_virt.
+ * The bitmap starts all set and only the available regions of the
+ * multiboot memory map are cleared, so holes and reserved ranges never
+ * need listing.
+ */
+
+#include "pmm.h"
+#include "paging.h"
+#include "spinlock.h"
+
+#define PMM_MAX_FRAMES      (PAGING_DIRECT_MAP_SIZE / PMM_FRAME_SIZE)
+#define PMM_BITMAP_WORDS    (PMM_MAX_FRAMES / 32)
+
+/* Everything below 1 MB stays reserved: IVT, BDA, EBDA, VGA and BIOS */
+#define PMM_LOW_LIMIT       0x100000
+
+/* Assumed when the loader gives no map: 1 MB up to the ISA hole */
+#define PMM_DEFAULT_TOP     0xF00000
+
+/* Defined in link.ld */
+extern char kernel_start[];
+extern char kernel_end[];
+
+static unsigned int bitmap[PMM_BITMAP_WORDS];
+static unsigned int total_frames = 0;
+static unsigned int free_frames = 0;
+
+/* Usable frames held by pmm_init: the kernel image and boot data */
+static unsigned int reserved_frames = 0;
+
+/* First bitmap word that may have a free bit */
+static unsigned int search_hint = 0;
+
+static struct spinlock bitmap_lock;
+
+/** pmm_lock:
+ *  Locks the bitmap, returning the old EFLAGS. Any thread on any
+ *  processor may allocate frames.
+ */
+static unsigned int pmm_lock(void)
+{
+    return spin_lock_irqsave(&bitmap_lock);
+}
+
+/** pmm_unlock:
+ *  Releases the lock taken by pmm_lock
+ */
+static void pmm_unlock(unsigned int flags)
+{
+    spin_unlock_irqrestore(&bitmap_lock, flags);
+}
+
+static void frame_set(unsigned int frame)
+{
+    bitmap[frame / 32] |= 1u << (frame % 32);
+}
+
+static void frame_clear(unsigned int frame)
+{
+    bitmap[frame / 32] &= ~(1u << (frame % 32));
+}
+
+static int frame_test(unsigned int frame)
+{
+    return (bitmap[frame / 32] >> (frame % 32)) & 1;
+}
+
+/** pmm_release_range:
+ *  Marks the whole frames inside [start, end) available
+ */
+static void pmm_release_range(unsigned long long start, unsigned long long end)
+{
+    unsigned long long frame;
+    unsigned long long last;
+
+    if (start < PMM_LOW_LIMIT) {
+        start = PMM_LOW_LIMIT;
+    }
+    if (end > PAGING_DIRECT_MAP_SIZE) {
+        end = PAGING_DIRECT_MAP_SIZE;
+    }
+
+    frame = (start + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    last = end / PMM_FRAME_SIZE;
+    for (; frame < last; frame++) {
+        if (frame_test((unsigned int)frame)) {
+            frame_clear((unsigned int)frame);
+            total_frames++;
+            free_frames++;
+        }
+    }
+}
+
+/** pmm_reserve_range:
+ *  Marks every frame touching [start, end) used
+ */
+static void pmm_reserve_range(unsigned int start, unsigned int end)
+{
+    unsigned int frame;
+
+    if (end > PAGING_DIRECT_MAP_SIZE) {
+        end = PAGING_DIRECT_MAP_SIZE;
+    }
+    if (end <= start) {
+        return;
+    }
+
+    for (frame = start / PMM_FRAME_SIZE;
+         frame <= (end - 1) / PMM_FRAME_SIZE; frame++) {
+        if (!frame_test(frame)) {
+            frame_set(frame);
+            free_frames--;
+            reserved_frames++;
+        }
+    }
+}
+
+/** pmm_boot_map:
+ *  Gets a kernel pointer to boot data from the loader, which may place
+ *  it anywhere below 4 GB: through the direct map or, above it, a vmap
+ *  mapping
+ *
+ *  @return The pointer, or 0 if it couldn't be mapped
+ */
+static void *pmm_boot_map(unsigned int phys, unsigned int size)
+{
+    if (phys < PAGING_DIRECT_MAP_SIZE && size <= PAGING_DIRECT_MAP_SIZE - phys) {
+        return phys_to_virt(phys);
+    }
+    return paging_vmap(phys, size, 0);
+}
+
+/** pmm_init */
+int pmm_init(unsigned int magic, struct multiboot_info *mbi)
+{
+    void *mmap = 0;
+    unsigned int i;
+    int ret = 0;
+
+    for (i = 0; i < PMM_BITMAP_WORDS; i++) {
+        bitmap[i] = 0xFFFFFFFF;
+    }
+    total_frames = 0;
+    free_frames = 0;
+    reserved_frames = 0;
+
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC &&
+        (mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        mmap = pmm_boot_map(mbi->mmap_addr, mbi->mmap_length);
+    }
+
+    if (mmap) {
+        unsigned int addr = (unsigned int)mmap;
+        unsigned int end = addr + mbi->mmap_length;
+
+        while (addr < end) {
+            struct multiboot_mmap_entry *entry =
+                (struct multiboot_mmap_entry *)addr;
+
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                pmm_release_range(entry->addr, entry->addr + entry->len);
+            }
+            addr += entry->size + sizeof(entry->size);
+        }
+    } else if (magic == MULTIBOOT_BOOTLOADER_MAGIC &&
+               (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        pmm_release_range(PMM_LOW_LIMIT,
+                          PMM_LOW_LIMIT + (unsigned long long)mbi->mem_upper * 1024);
+    } else {
+        pmm_release_range(PMM_LOW_LIMIT, PMM_DEFAULT_TOP);
+        ret = -1;
+    }
+
+    pmm_reserve_range(virt_to_phys(kernel_start), virt_to_phys(kernel_end));
+
+    /* The modules and the boot information stay readable after boot */
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        pmm_reserve_range(virt_to_phys(mbi), virt_to_phys(mbi) + sizeof(*mbi));
+
+        if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+            pmm_reserve_range(mbi->mmap_addr,
+                              mbi->mmap_addr + mbi->mmap_length);
+        }
+
+        if ((mbi->flags & MULTIBOOT_INFO_MODS) && mbi->mods_count) {
+            unsigned int size = mbi->mods_count * sizeof(struct multiboot_module);
+            struct multiboot_module *mods = pmm_boot_map(mbi->mods_addr, size);
+
+            pmm_reserve_range(mbi->mods_addr, mbi->mods_addr + size);
+            for (i = 0; mods && i < mbi->mods_count; i++) {
+                pmm_reserve_range(mods[i].mod_start, mods[i].mod_end);
+            }
+        }
+    }
+
+    search_hint = 0;
+    return ret;
+}
+
+/** pmm_alloc_frame */
+unsigned int pmm_alloc_frame(void)
+{
+    unsigned int flags = pmm_lock();
+    unsigned int i;
+
+    for (i = search_hint; i < PMM_BITMAP_WORDS; i++) {
+        if (bitmap[i] != 0xFFFFFFFF) {
+            unsigned int bit;
+
+            __asm__("bsf %1, %0" : "=r"(bit) : "r"(~bitmap[i]));
+            bitmap[i] |= 1u << bit;
+            free_frames--;
+            search_hint = i;
+            pmm_unlock(flags);
+            return (i * 32 + bit) * PMM_FRAME_SIZE;
+        }
+    }
+
+    pmm_unlock(flags);
+    return 0;
+}
+
+/** pmm_alloc_frames */
+unsigned int pmm_alloc_frames(unsigned int count)
+{
+    unsigned int frame;
+    unsigned int run = 0;
+    unsigned int flags;
+
+    if (count == 1) {
+        return pmm_alloc_frame();
+    }
+
+    flags = pmm_lock();
+    if (count == 0 || count > free_frames) {
+        pmm_unlock(flags);
+        return 0;
+    }
+
+    for (frame = search_hint * 32; frame < PMM_MAX_FRAMES; frame++) {
+        /* Skip full words a whole word at a time */
+        if (run == 0 && frame % 32 == 0 && bitmap[frame / 32] == 0xFFFFFFFF) {
+            frame += 31;
+            continue;
+        }
+
+        if (frame_test(frame)) {
+            run = 0;
+            continue;
+        }
+
+        if (++run == count) {
+            unsigned int first = frame - count + 1;
+            unsigned int f;
+
+            for (f = first; f <= frame; f++) {
+                frame_set(f);
+            }
+            free_frames -= count;
+            pmm_unlock(flags);
+            return first * PMM_FRAME_SIZE;
+        }
+    }
+
+    pmm_unlock(flags);
+    return 0;
+}
+
+/** pmm_free_frame */
+void pmm_free_frame(unsigned int addr)
+{
+    unsigned int frame = addr / PMM_FRAME_SIZE;
+    unsigned int flags = pmm_lock();
+
+    if (addr < PMM_LOW_LIMIT || addr >= PAGING_DIRECT_MAP_SIZE || !frame_test(frame)) {
+        pmm_unlock(flags);
+        return;
+    }
+
+    frame_clear(frame);
+    free_frames++;
+    if (frame / 32 < search_hint) {
+        search_hint = frame / 32;
+    }
+    pmm_unlock(flags);
+}
+
+/** pmm_free_frames */
+void pmm_free_frames(unsigned int addr, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        pmm_free_frame(addr + i * PMM_FRAME_SIZE);
+    }
+}
+
+/** pmm_get_total_frames */
+unsigned int pmm_get_total_frames(void)
+{
+    return total_frames;
+}
+
+/** pmm_get_free_frames */
+unsigned int pmm_get_free_frames(void)
+{
+    return free_frames;
+}
+
+/** pmm_get_reserved_frames */
+unsigned int pmm_get_reserved_frames(void)
+{
+    return reserved_frames;
+}
+
+/** pmm_get_kernel_size */
+unsigned int pmm_get_kernel_size(void)
+{
+    return kernel_end - kernel_start;
+}
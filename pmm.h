@@ -0,0 +1,80 @@
+#ifndef INCLUDE_PMM_H
+#define INCLUDE_PMM_H
+
+#include "multiboot.h"
+
+#define PMM_FRAME_SIZE  4096
+
+/** pmm_init:
+ *  Builds the frame bitmap from the multiboot memory map. Frames below
+ *  1 MB, the kernel image, boot modules and the boot information stay
+ *  reserved. Needs paging_init first.
+ *
+ *  @param magic  The value the loader passed in EAX
+ *  @param mbi    The multiboot information the loader passed in EBX,
+ *                through the direct map
+ *  @return       0 if a memory map was used, -1 if the loader gave none
+ *                and a conservative default was assumed
+ */
+int pmm_init(unsigned int magic, struct multiboot_info *mbi);
+
+/** pmm_alloc_frame:
+ *  Allocates one 4 KB physical frame. Use phys_to_virt to access it.
+ *
+ *  @return The physical address, or 0 if memory is exhausted
+ */
+unsigned int pmm_alloc_frame(void);
+
+/** pmm_alloc_frames:
+ *  Allocates physically contiguous frames
+ *
+ *  @param count  The number of frames
+ *  @return       The physical address of the first, or 0 on failure
+ */
+unsigned int pmm_alloc_frames(unsigned int count);
+
+/** pmm_free_frame:
+ *  Frees a frame from pmm_alloc_frame
+ *
+ *  @param addr  The physical address
+ */
+void pmm_free_frame(unsigned int addr);
+
+/** pmm_free_frames:
+ *  Frees frames from pmm_alloc_frames
+ *
+ *  @param addr   The physical address of the first
+ *  @param count  The number of frames
+ */
+void pmm_free_frames(unsigned int addr, unsigned int count);
+
+/** pmm_get_total_frames:
+ *  Gets the number of usable frames reported by the memory map
+ *
+ *  @return The frame count
+ */
+unsigned int pmm_get_total_frames(void);
+
+/** pmm_get_free_frames:
+ *  Gets the number of frames currently free
+ *
+ *  @return The frame count
+ */
+unsigned int pmm_get_free_frames(void);
+
+/** pmm_get_reserved_frames:
+ *  Gets the number of usable frames pmm_init kept for the kernel image,
+ *  the boot information and modules. They are never freed.
+ *
+ *  @return The frame count
+ */
+unsigned int pmm_get_reserved_frames(void);
+
+/** pmm_get_kernel_size:
+ *  Gets the size of the loaded kernel image, code through bss
+ *
+ *  @return The size in bytes
+ */
+unsigned int pmm_get_kernel_size(void);
+
+#endif /* INCLUDE_PMM_H */
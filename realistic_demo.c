@@ -6,6 +6,7 @@
 
 #include "realistic.h"
 #include "fb.h"
+#include "input.h"
 
 /** Print truth table for binary operation */
 static void print_truth_table_binary(const char *op_name,
@@ -140,8 +141,5 @@ void realistic_demo(void)
     fb_puts("Press any key to return to shell...\n");
     
     /* Wait for keypress */
-    extern char keyboard_get_char(void);
-    while (keyboard_get_char() == 0) {
-        /* Wait for key */
-    }
+    input_read_blocking();
 }
@@ -1,5 +1,36 @@
 #include "io.h"
 #include "serial.h"
+#include "keyboard.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+/* Bytes received by the interrupt, waiting for the serial softirq */
+#define SERIAL_RX_QUEUE_SIZE 64
+
+static char rx_queue[SERIAL_RX_QUEUE_SIZE];
+static volatile unsigned int rx_head = 0;
+static volatile unsigned int rx_tail = 0;
+
+/* Console output waiting for the UART. serial_write_char only queues it;
+ * serial_flush arms the "transmitter empty" interrupt, which refills the
+ * 16-byte FIFO until the ring is empty. Indices run freely and are
+ * masked on access.
+ */
+#define SERIAL_TX_RING_SIZE 4096    /* must be a power of two */
+#define SERIAL_FIFO_SIZE    16
+
+/* Interrupt enable register values: receive only, or also transmit */
+#define SERIAL_IER_RX       0x01
+#define SERIAL_IER_RX_TX    0x03
+
+static char tx_ring[SERIAL_TX_RING_SIZE];
+static unsigned int tx_head = 0;
+static unsigned int tx_tail = 0;
+static struct spinlock tx_lock;
+static int tx_irq_ready = 0;    /* Interrupt handler registered */
+static int tx_armed = 0;        /* Transmit interrupt enabled */
+
+static void serial_bottom_half(void);
 
 /** serial_configure_baud_rate:
  *  Sets the speed of the data being sent. The default speed of a serial
@@ -63,6 +94,26 @@ void serial_configure_modem(unsigned short com)
     outb(SERIAL_MODEM_COMMAND_PORT(com), 0x03);
 }
 
+/** serial_configure_interrupts:
+ *  Enables the "received data available" interrupt of the given serial port
+ *  and routes it to the PIC by raising the OUT2 line of the modem.
+ *
+ *  @param com  The serial port to configure
+ */
+void serial_configure_interrupts(unsigned short com)
+{
+    /* Bit:     | 7 6 5 4 | 3   | 2   | 1    | 0    |
+     * Content: | r       | msi | lsi | thre | rda  |
+     * Value:   | 0 0 0 0 | 0   | 0   | 0    | 1    | = 0x01
+     */
+    outb(SERIAL_INTERRUPT_ENABLE_PORT(com), 0x01);
+
+    /* Same as serial_configure_modem, plus ao2 (OUT2) which gates the
+     * UART interrupt line onto the PIC: 0x0B
+     */
+    outb(SERIAL_MODEM_COMMAND_PORT(com), 0x0B);
+}
+
 /** serial_is_transmit_fifo_empty:
  *  Checks whether the transmit FIFO queue is empty or not for the given COM
  *  port.
@@ -92,4 +143,191 @@ int serial_write(char *buf, unsigned int len)
         outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), buf[i]);
     }
     return len;
+}
+
+/** serial_tx_fill:
+ *  Moves queued output into the transmit FIFO if it is empty. Called
+ *  with tx_lock held.
+ */
+static void serial_tx_fill(void)
+{
+    unsigned int n;
+
+    if (!serial_is_transmit_fifo_empty(SERIAL_COM1_BASE)) {
+        return;
+    }
+    for (n = 0; n < SERIAL_FIFO_SIZE && tx_tail != tx_head; n++) {
+        outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE),
+             tx_ring[tx_tail & (SERIAL_TX_RING_SIZE - 1)]);
+        tx_tail++;
+    }
+}
+
+/** serial_tx_drain:
+ *  Polls the queued output out of the UART. Called with tx_lock held.
+ */
+static void serial_tx_drain(void)
+{
+    while (tx_tail != tx_head) {
+        serial_tx_fill();
+    }
+}
+
+/** serial_tx_put:
+ *  Queues one byte, making room by polling if the ring is full. Called
+ *  with tx_lock held.
+ */
+static void serial_tx_put(char c)
+{
+    while (tx_head - tx_tail >= SERIAL_TX_RING_SIZE) {
+        serial_tx_fill();
+    }
+    tx_ring[tx_head & (SERIAL_TX_RING_SIZE - 1)] = c;
+    tx_head++;
+}
+
+/** serial_write_char:
+ *  Queues a single character of console output for the serial port.
+ *  Newlines are sent as CR LF and backspace erases the previous
+ *  character, so a terminal attached to COM1 shows the same text as the
+ *  screen.
+ *
+ *  @param c  The character to write
+ */
+void serial_write_char(char c)
+{
+    unsigned int flags = spin_lock_irqsave(&tx_lock);
+
+    if (c == '\n') {
+        serial_tx_put('\r');
+        serial_tx_put('\n');
+    } else if (c == '\b') {
+        serial_tx_put('\b');
+        serial_tx_put(' ');
+        serial_tx_put('\b');
+    } else {
+        serial_tx_put(c);
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+/** serial_flush */
+void serial_flush(void)
+{
+    unsigned int flags = spin_lock_irqsave(&tx_lock);
+
+    if (tx_tail != tx_head) {
+        if (!tx_irq_ready) {
+            serial_tx_drain();
+        } else if (!tx_armed) {
+            /* Raises the interrupt at once if the FIFO is already empty */
+            tx_armed = 1;
+            outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE), SERIAL_IER_RX_TX);
+        }
+    }
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+/** serial_drain */
+void serial_drain(void)
+{
+    unsigned int flags;
+    int locked;
+
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+
+    /* A panic may have interrupted the lock holder: go on without it */
+    locked = spin_trylock(&tx_lock);
+    serial_tx_drain();
+    if (locked) {
+        spin_unlock(&tx_lock);
+    }
+    __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+/** serial_is_receive_data_ready:
+ *  Checks whether the receive buffer of the given COM port holds a byte.
+ *
+ *  @param  com The COM port
+ *  @return 0 if there is no data to read
+ *          1 if a byte can be read
+ */
+int serial_is_receive_data_ready(unsigned int com)
+{
+    /* 0x01 = 0000 0001 */
+    return inb(SERIAL_LINE_STATUS_PORT(com)) & 0x01;
+}
+
+/** serial_handle_interrupt:
+ *  Interrupt handler for COM1 (see irq_register). Drains the receive FIFO
+ *  and defers the bytes to the serial softirq, which feeds them into the
+ *  keyboard input queue so the shell can be driven over the serial line.
+ *  Refills the transmit FIFO from the output ring while it is armed.
+ *
+ *  @param regs  The saved register frame (unused)
+ *  @param ctx   The handler context (unused)
+ */
+void serial_handle_interrupt(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+
+    while (serial_is_receive_data_ready(SERIAL_COM1_BASE)) {
+        char c = inb(SERIAL_DATA_PORT(SERIAL_COM1_BASE));
+        unsigned int next = (rx_head + 1) % SERIAL_RX_QUEUE_SIZE;
+
+        if (next != rx_tail) {
+            rx_queue[rx_head] = c;
+            rx_head = next;
+        }
+    }
+    softirq_raise(SOFTIRQ_SERIAL);
+
+    spin_lock(&tx_lock);
+    if (tx_armed) {
+        serial_tx_fill();
+        if (tx_tail == tx_head) {
+            tx_armed = 0;
+            outb(SERIAL_INTERRUPT_ENABLE_PORT(SERIAL_COM1_BASE), SERIAL_IER_RX);
+        }
+    }
+    spin_unlock(&tx_lock);
+}
+
+/** serial_init_console:
+ *  Registers the softirq that turns received bytes into console input.
+ *  From then on queued output is sent by the interrupt.
+ */
+void serial_init_console(void)
+{
+    softirq_register(SOFTIRQ_SERIAL, serial_bottom_half);
+    tx_irq_ready = 1;
+}
+
+/** serial_bottom_half:
+ *  Serial softirq: translates terminal key codes and queues the input
+ */
+static void serial_bottom_half(void)
+{
+    static char last_received = 0;
+
+    while (rx_tail != rx_head) {
+        char c = rx_queue[rx_tail];
+        rx_tail = (rx_tail + 1) % SERIAL_RX_QUEUE_SIZE;
+
+        /* Terminals send CR (or CR LF) for Enter and DEL for Backspace */
+        if (c == '\n' && last_received == '\r') {
+            last_received = c;
+            continue;
+        }
+        last_received = c;
+
+        if (c == '\r') {
+            c = '\n';
+        } else if (c == 0x7F) {
+            c = '\b';
+        }
+
+        keyboard_push_char(c);
+    }
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define SERIAL_COM1_BASE                0x3F8      /* COM1 base port */
 
 #define SERIAL_DATA_PORT(base)          (base)
+#define SERIAL_INTERRUPT_ENABLE_PORT(base) (base + 1)
 #define SERIAL_FIFO_COMMAND_PORT(base)  (base + 2)
 #define SERIAL_LINE_COMMAND_PORT(base)  (base + 3)
 #define SERIAL_MODEM_COMMAND_PORT(base) (base + 4)
@@ -24,6 +25,9 @@
  */
 #define SERIAL_LINE_ENABLE_DLAB         0x80
 
+/* COM1 raises IRQ4, which the PIC is remapped to deliver on vector 36 */
+#define SERIAL_COM1_INTERRUPT           36
+
 /** serial_configure_baud_rate:
  *  Sets the speed of the data being sent. The default speed of a serial
  *  port is 115200 bits/s. The argument is a divisor of that number, hence
@@ -57,6 +61,14 @@ void serial_configure_fifo_buffer(unsigned short com);
  */
 void serial_configure_modem(unsigned short com);
 
+/** serial_configure_interrupts:
+ *  Enables the "received data available" interrupt of the given serial port
+ *  and routes it to the PIC by raising the OUT2 line of the modem.
+ *
+ *  @param com  The serial port to configure
+ */
+void serial_configure_interrupts(unsigned short com);
+
 /** serial_is_transmit_fifo_empty:
  *  Checks whether the transmit FIFO queue is empty or not for the given COM
  *  port.
@@ -76,4 +88,53 @@ int serial_is_transmit_fifo_empty(unsigned int com);
  */
 int serial_write(char *buf, unsigned int len);
 
+/** serial_write_char:
+ *  Queues a single character of console output for the serial port.
+ *  Newlines are sent as CR LF and backspace erases the previous character,
+ *  so a terminal attached to COM1 shows the same text as the screen.
+ *  Nothing is sent until serial_flush, unless the queue fills up.
+ *
+ *  @param c  The character to write
+ */
+void serial_write_char(char c);
+
+/** serial_flush:
+ *  Starts sending the queued console output. Once serial_init_console has
+ *  run, the transmit interrupt sends it in the background, 16 bytes per
+ *  interrupt; before that it is polled out here.
+ */
+void serial_flush(void);
+
+/** serial_drain:
+ *  Sends all queued console output before returning, by polling. For
+ *  panics, which halt with interrupts disabled.
+ */
+void serial_drain(void);
+
+/** serial_is_receive_data_ready:
+ *  Checks whether the receive buffer of the given COM port holds a byte.
+ *
+ *  @param  com The COM port
+ *  @return 0 if there is no data to read
+ *          1 if a byte can be read
+ */
+int serial_is_receive_data_ready(unsigned int com);
+
+/** serial_init_console:
+ *  Registers the softirq that turns received bytes into console input, and
+ *  lets serial_flush leave queued output to the transmit interrupt. Call
+ *  before enabling the COM1 interrupt.
+ */
+void serial_init_console(void);
+
+/** serial_handle_interrupt:
+ *  Interrupt handler for COM1 (see irq_register). Drains the receive FIFO
+ *  and defers the bytes to the serial softirq, which feeds them into the
+ *  keyboard input queue so the shell can be driven over the serial line.
+ *
+ *  @param regs  The saved register frame (unused)
+ *  @param ctx   The handler context (unused)
+ */
+void serial_handle_interrupt(unsigned int *regs, void *ctx);
+
 #endif /* INCLUDE_SERIAL_H */
\ No newline at end of file
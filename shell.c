@@ -1,6 +1,6 @@
 #include "shell.h"
 #include "fb.h"
-#include "keyboard.h"
+#include "input.h"
 #include "serial.h"
 #include "snake.h"
 #include "io.h"
@@ -10,110 +10,59 @@
 #include "realistic_demo.h"
 #include "sysfiles.h"
 #include "filemanager.h"
+#include "memory.h"
+#include "kstring.h"
+#include "timer.h"
+#include "meminfo.h"
+#include "paging.h"
+#include "arena.h"
+#include "thread.h"
+#include "smp.h"
 
 #define COMMAND_BUFFER_SIZE 256
 #define MAX_PATH_LENGTH 128
 
+/* Virtual consoles (Alt+F1..F3) */
+#define SHELL_CONSOLE   0
+#define EDITOR_CONSOLE  1
+#define GAME_CONSOLE    2
+
 static char command_buffer[COMMAND_BUFFER_SIZE];
 static unsigned int buffer_index = 0;
 static char current_directory[MAX_PATH_LENGTH] = "/";
 
-/** strcmp */
-int strcmp(const char *s1, const char *s2)
-{
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char *)s1 - *(unsigned char *)s2;
-}
+/* Scratch memory for the running command, reset when it returns */
+static struct arena command_arena;
 
-/** strstr */
-char* strstr(const char *haystack, const char *needle)
+/** shell_alloc */
+void *shell_alloc(unsigned int size)
 {
-    if (!*needle) return (char*)haystack;
-    
-    for (; *haystack; haystack++) {
-        const char *h = haystack;
-        const char *n = needle;
-        
-        while (*h && *n && (*h == *n)) {
-            h++;
-            n++;
-        }
-        
-        if (!*n) return (char*)haystack;
-    }
-    
-    return 0;
+    return arena_alloc(&command_arena, size);
 }
 
-/** strlen */
-int strlen(const char *str)
+/** shell_build_path */
+char *shell_build_path(const char *dir, const char *arg)
 {
-    int len = 0;
-    while (str[len] != '\0') {
-        len++;
-    }
-    return len;
-}
-
-/** strcpy */
-void strcpy(char *dest, const char *src)
-{
-    while (*src) {
-        *dest++ = *src++;
-    }
-    *dest = '\0';
-}
-
-/** strcat */
-void strcat(char *dest, const char *src)
-{
-    while (*dest) dest++;
-    while (*src) {
-        *dest++ = *src++;
-    }
-    *dest = '\0';
-}
-
-/** int_to_str */
-static void int_to_str(int num, char *str)
-{
-    int i = 0;
-    int is_negative = 0;
+    int dir_len = strlen(dir);
+    char *path = shell_alloc(dir_len + strlen(arg) + 2);
     
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
-        return;
+    if (!path) {
+        return 0;
     }
     
-    if (num < 0) {
-        is_negative = 1;
-        num = -num;
-    }
-    
-    while (num > 0) {
-        str[i++] = '0' + (num % 10);
-        num /= 10;
-    }
-    
-    if (is_negative) {
-        str[i++] = '-';
+    if (arg[0] == '/') {
+        /* Absolute path */
+        strcpy(path, arg);
+        return path;
     }
     
-    str[i] = '\0';
-    
-    int start = 0;
-    int end = i - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        start++;
-        end--;
+    /* Relative path - add a slash if the directory isn't root */
+    strcpy(path, dir);
+    if (dir_len > 0 && path[dir_len - 1] != '/') {
+        path[dir_len++] = '/';
     }
+    strcpy(path + dir_len, arg);
+    return path;
 }
 
 /** shell_visit_command */
@@ -272,21 +221,32 @@ void shell_sysinfo_command(void)
     if (feat_ecx & (1 << 0)) fb_puts("SSE3 ");
     fb_puts("\n\n");
     
+    struct meminfo info;
+    meminfo_get(&info);
+    
     fb_puts("Memory:\n");
-    unsigned int mem = hw_detect_memory();
     fb_puts("  Total RAM: ");
-    int_to_str(mem, buffer);
+    int_to_str(info.total / 1024, buffer);
     fb_puts(buffer);
     fb_puts(" MB (REAL!)\n");
-    fb_puts("  Used: ~2 MB\n");
+    fb_puts("  Used: ");
+    int_to_str(info.used, buffer);
+    fb_puts(buffer);
+    fb_puts(" KB\n");
     fb_puts("  Available: ");
-    int_to_str(mem - 2, buffer);
+    int_to_str(info.free / 1024, buffer);
     fb_puts(buffer);
     fb_puts(" MB\n\n");
     
     fb_puts("Filesystem:\n");
     fb_puts("  Type: RAM-based\n");
-    fb_puts("  Max Files: 50\n");
+    fb_puts("  Files: ");
+    int_to_str(info.files, buffer);
+    fb_puts(buffer);
+    fb_puts(" (");
+    int_to_str(info.file_data, buffer);
+    fb_puts(buffer);
+    fb_puts(" KB of data)\n");
     fb_puts("  Max Size/File: 2 KB\n\n");
     
     fb_puts("System:\n");
@@ -334,52 +294,177 @@ void shell_cpu_command(void)
     if (feat_edx & (1 << 26)) fb_puts("  [x] SSE2\n");
     if (feat_ecx & (1 << 0)) fb_puts("  [x] SSE3\n");
     
+    fb_puts("\nEnabled: ");
+    fb_puts((hw_fpu_enabled() & HW_FPU_X87) ? "FPU " : "");
+    fb_puts((hw_fpu_enabled() & HW_FPU_SSE) ? "SSE " : "");
+    fb_puts((hw_fpu_enabled() & HW_FPU_XSAVE) ? "XSAVE" : "");
+    fb_puts("\n");
+    
+    fb_puts("Processors online: ");
+    int_to_str(smp_get_online_count(), buffer);
+    fb_puts(buffer);
+    fb_puts("\n");
+    
     fb_puts("\n==============================\n");
 }
 
+/** mem_print_kb - one "label N KB" line of the mem command */
+static void mem_print_kb(char *label, unsigned int kb)
+{
+    char buffer[16];
+    
+    fb_puts(label);
+    int_to_str(kb, buffer);
+    fb_puts(buffer);
+    fb_puts(" KB\n");
+}
+
 /** shell_mem_command - REAL HARDWARE! */
 void shell_mem_command(void)
 {
     char buffer[32];
-    unsigned int mem = hw_detect_memory();
+    struct meminfo info;
+    
+    meminfo_get(&info);
     
     fb_puts("=== Memory (REAL) ===\n\n");
     
-    fb_puts("Total: ");
-    int_to_str(mem, buffer);
-    fb_puts(buffer);
-    fb_puts(" MB\n");
+    mem_print_kb("Total:         ", info.total);
+    mem_print_kb("Used:          ", info.used);
+    mem_print_kb("Free:          ", info.free);
+    fb_puts("\n");
+    mem_print_kb("Kernel image:  ", info.kernel);
+    mem_print_kb("Boot reserved: ", info.reserved);
+    mem_print_kb("Slab:          ", info.slab);
+    mem_print_kb("  in use:      ", info.slab_active);
+    mem_print_kb("Large kmalloc: ", info.heap_large);
+    mem_print_kb("Page tables:   ", info.page_tables);
+    mem_print_kb("Kernel stacks: ", info.kernel_stack);
+    mem_print_kb("Other:         ", info.other);
+    mem_print_kb("File data:     ", info.file_data);
+    mem_print_kb("  cached:      ", info.cached);
+    fb_puts("\n");
     
-    fb_puts("Used: ~2 MB\n");
-    fb_puts("Available: ");
-    int_to_str(mem - 2, buffer);
-    fb_puts(buffer);
-    fb_puts(" MB\n\n");
+    fb_puts("Detection: Multiboot memory map\n");
     
-    fb_puts("Detection: CMOS + Probing\n");
+    struct paging_cr3_cost cost;
+    paging_get_cr3_cost(&cost);
+    fb_puts("Paging: kernel at 0xC0000000, 4 MB pages\n");
+    fb_puts("CR3 reload: ");
+    int_to_str(cost.reload, buffer);
+    fb_puts(buffer);
+    fb_puts(" cycles, switch: ");
+    int_to_str(cost.swap, buffer);
+    fb_puts(buffer);
+    fb_puts(", switch + ");
+    int_to_str(PAGING_REFILL_PAGES, buffer);
+    fb_puts(buffer);
+    fb_puts(" TLB misses: ");
+    int_to_str(cost.refill, buffer);
+    fb_puts(buffer);
+    fb_puts("\n");
     
     fb_puts("\n=====================\n");
 }
 
+/* membench: buffer size limit and bytes moved per measured size */
+#define MEMBENCH_MAX_SIZE   65536
+#define MEMBENCH_TOTAL      (4 * 1024 * 1024)
+
+static char membench_src[MEMBENCH_MAX_SIZE];
+static char membench_dst[MEMBENCH_MAX_SIZE];
+
+/** membench_print_rate:
+ *  Prints MEMBENCH_TOTAL bytes over the given cycles as GB/s
+ */
+static void membench_print_rate(unsigned int cycles, unsigned int tsc_per_us)
+{
+    char buffer[32];
+    unsigned int us = cycles / tsc_per_us;
+    unsigned int mb_per_s;
+    
+    if (us == 0) {
+        us = 1;
+    }
+    /* Bytes per microsecond is MB/s */
+    mb_per_s = MEMBENCH_TOTAL / us;
+    
+    int_to_str(mb_per_s / 1000, buffer);
+    fb_puts(buffer);
+    fb_puts(".");
+    if ((mb_per_s % 1000) / 10 < 10) {
+        fb_puts("0");
+    }
+    int_to_str((mb_per_s % 1000) / 10, buffer);
+    fb_puts(buffer);
+}
+
+/** shell_membench_command */
+void shell_membench_command(void)
+{
+    char buffer[32];
+    unsigned int tsc_per_us;
+    unsigned int size;
+    
+    fb_puts("Calibrating TSC against the PIT...\n");
+    tsc_per_us = timer_tsc_per_us();
+    fb_puts("TSC: ");
+    int_to_str(tsc_per_us, buffer);
+    fb_puts(buffer);
+    fb_puts(" MHz, SSE2 path: ");
+    fb_puts(memory_sse2_enabled() ? "on\n\n" : "off\n\n");
+    
+    fb_puts("    SIZE  memcpy GB/s  memset GB/s\n");
+    for (size = 64; size <= MEMBENCH_MAX_SIZE; size *= 4) {
+        unsigned int iterations = MEMBENCH_TOTAL / size;
+        unsigned int i;
+        unsigned long long start;
+        unsigned int copy_cycles, set_cycles;
+        
+        start = hw_read_tsc();
+        for (i = 0; i < iterations; i++) {
+            memcpy(membench_dst, membench_src, size);
+        }
+        copy_cycles = (unsigned int)(hw_read_tsc() - start);
+        
+        start = hw_read_tsc();
+        for (i = 0; i < iterations; i++) {
+            memset(membench_dst, i, size);
+        }
+        set_cycles = (unsigned int)(hw_read_tsc() - start);
+        
+        int_to_str(size, buffer);
+        for (i = strlen(buffer); i < 8; i++) {
+            fb_putc(' ');
+        }
+        fb_puts(buffer);
+        fb_puts("  ");
+        membench_print_rate(copy_cycles, tsc_per_us);
+        fb_puts("         ");
+        membench_print_rate(set_cycles, tsc_per_us);
+        fb_puts("\n");
+    }
+}
+
 /** shell_edit_command */
 void shell_edit_command(char *args)
 {
+    fb_console_select(EDITOR_CONSOLE);
     if (args[0] == '\0') {
         texteditor_open(0, current_directory);
     } else {
         texteditor_open(args, current_directory);
     }
-    fb_clear();
-    fb_puts("Welcome back!\n\n");
+    fb_console_select(SHELL_CONSOLE);
 }
 
 /** shell_cat_command */
 void shell_cat_command(char *args)
 {
-    char file_content[2048];
-    char filepath[256];
+    char *file_content;
+    char *filepath;
+    int size;
     int bytes_read;
-    int i;
     
     if (args[0] == '\0') {
         fb_puts("Usage: cat <filename>\n");
@@ -388,50 +473,45 @@ void shell_cat_command(char *args)
     }
     
     /* Build full path */
-    if (args[0] == '/') {
-        /* Absolute path */
-        i = 0;
-        while (args[i] && i < 255) {
-            filepath[i] = args[i];
-            i++;
-        }
-        filepath[i] = '\0';
-    } else {
-        /* Relative path - prepend current directory */
-        i = 0;
-        const char *dir = current_directory;
-        while (*dir && i < 200) {
-            filepath[i++] = *dir++;
-        }
-        
-        /* Add slash if not root */
-        if (i > 0 && filepath[i-1] != '/') {
-            filepath[i++] = '/';
-        }
-        
-        /* Add filename */
-        int j = 0;
-        while (args[j] && i < 255) {
-            filepath[i++] = args[j++];
-        }
-        filepath[i] = '\0';
+    filepath = shell_build_path(current_directory, args);
+    if (!filepath) {
+        fb_puts("cat: out of memory\n");
+        return;
     }
     
-    /* Read file */
-    bytes_read = fs_read(filepath, file_content, sizeof(file_content) - 1);
+    /* /proc files are generated, refresh them before reading */
+    if (strstr(filepath, "/proc/") == filepath) {
+        sysfiles_update_proc();
+    }
     
-    if (bytes_read < 0) {
+    size = fs_get_size(filepath);
+    if (size < 0) {
         fb_puts("cat: ");
         fb_puts(filepath);
         fb_puts(": No such file\n");
         return;
     }
     
-    if (bytes_read == 0) {
+    if (size == 0) {
         /* Empty file */
         return;
     }
     
+    /* Read file */
+    file_content = shell_alloc(size + 1);
+    if (!file_content) {
+        fb_puts("cat: out of memory\n");
+        return;
+    }
+    bytes_read = fs_read(filepath, file_content, size);
+    if (bytes_read < 0) {
+        /* Removed or rewritten since fs_get_size, e.g. by the procfs thread */
+        fb_puts("cat: ");
+        fb_puts(filepath);
+        fb_puts(": Read failed\n");
+        return;
+    }
+    
     /* Null-terminate */
     file_content[bytes_read] = '\0';
     
@@ -450,6 +530,226 @@ void shell_clear_command(void)
     fb_clear();
 }
 
+/* Threads shown by ps and top */
+#define SHELL_MAX_THREADS 32
+
+static const char *thread_state_names[] = { "running", "ready", "blocked", "dead" };
+static const char *thread_prio_names[THREAD_PRIORITIES] = { "high", "normal", "low" };
+
+/* What ps and top show of a thread, copied so they print unlocked */
+struct thread_info {
+    unsigned int id;
+    char name[13];
+    int state;
+    int priority;
+    unsigned int cpu;
+    unsigned int cpu_ticks;
+    unsigned int switches;
+    unsigned int stack_used;
+};
+
+/** thread_snapshot - copies up to max threads, returns how many exist */
+static unsigned int thread_snapshot(struct thread_info *info, unsigned int max)
+{
+    const struct thread *t;
+    unsigned int count = 0;
+    
+    /* Threads can't exit and be freed while we walk the list. Printing
+     * waits for the UART and the screen, so it happens after unlocking.
+     */
+    thread_list_lock();
+    for (t = thread_list(); t; t = t->all_next, count++) {
+        if (count < max) {
+            struct thread_info *i = &info[count];
+            
+            i->id = t->id;
+            strlcpy(i->name, t->name, sizeof(i->name));
+            i->state = t->state;
+            i->priority = t->priority;
+            i->cpu = t->cpu;
+            i->cpu_ticks = t->cpu_ticks;
+            i->switches = t->switches;
+            i->stack_used = t->stack ? kstack_high_water(t->stack) : 0;
+        }
+    }
+    thread_list_unlock();
+    return count;
+}
+
+/** print_column - text left-aligned in a column of the given width */
+static void print_column(const char *text, int width)
+{
+    char buffer[2] = { 0, 0 };
+    
+    while (*text && width > 0) {
+        buffer[0] = *text++;
+        fb_puts(buffer);
+        width--;
+    }
+    while (width-- > 0) {
+        fb_puts(" ");
+    }
+}
+
+/** print_number - a number right-aligned in a column of the given width */
+static void print_number(unsigned int num, int width)
+{
+    char buffer[16];
+    int len = uint_to_str(num, buffer);
+    
+    while (width-- > len) {
+        fb_puts(" ");
+    }
+    fb_puts(buffer);
+}
+
+/** print_more_threads - notes the threads a snapshot had no room for */
+static void print_more_threads(unsigned int total)
+{
+    if (total > SHELL_MAX_THREADS) {
+        fb_puts("  ... ");
+        print_number(total - SHELL_MAX_THREADS, 0);
+        fb_puts(" more\n");
+    }
+}
+
+/** shell_ps_command */
+void shell_ps_command(void)
+{
+    struct thread_info *info = shell_alloc(SHELL_MAX_THREADS * sizeof(*info));
+    unsigned int total, count, n;
+    
+    if (!info) {
+        fb_puts("ps: out of memory\n");
+        return;
+    }
+    total = thread_snapshot(info, SHELL_MAX_THREADS);
+    count = total < SHELL_MAX_THREADS ? total : SHELL_MAX_THREADS;
+    
+    fb_puts("  ID NAME        STATE    PRIO  CPU    CPU(ms) SWITCHES  STACK\n");
+    for (n = 0; n < count; n++) {
+        struct thread_info *t = &info[n];
+        
+        print_number(t->id, 4);
+        fb_puts(" ");
+        print_column(t->name, 12);
+        print_column(thread_state_names[t->state], 9);
+        print_column(thread_prio_names[t->priority], 6);
+        print_number(t->cpu, 3);
+        print_number(t->cpu_ticks * (1000 / TIMER_HZ), 11);
+        print_number(t->switches, 9);
+        print_number(t->stack_used, 7);
+        fb_puts("\n");
+    }
+    print_more_threads(total);
+}
+
+/** shell_top_command - CPU use per thread, refreshed every second */
+void shell_top_command(void)
+{
+    struct thread_info *info = shell_alloc(SHELL_MAX_THREADS * sizeof(*info));
+    unsigned int prev_ids[SHELL_MAX_THREADS];
+    unsigned int prev_ticks[SHELL_MAX_THREADS];
+    unsigned int prev_count = 0;
+    unsigned int prev_idle = thread_get_idle_ticks();
+    unsigned int prev_time = timer_get_ticks();
+    
+    if (!info) {
+        fb_puts("top: out of memory\n");
+        return;
+    }
+    
+    while (1) {
+        unsigned int now = timer_get_ticks();
+        unsigned int idle = thread_get_idle_ticks();
+        unsigned int elapsed = now - prev_time;
+        unsigned int total = thread_snapshot(info, SHELL_MAX_THREADS);
+        unsigned int count = total < SHELL_MAX_THREADS ? total : SHELL_MAX_THREADS;
+        unsigned int n, i;
+        
+        if (elapsed == 0) {
+            elapsed = 1;
+        }
+        
+        fb_clear();
+        fb_puts("top - uptime ");
+        print_number(now / TIMER_HZ, 0);
+        fb_puts(" s, idle ");
+        /* Idle time of all processors, as a share of their total */
+        print_number((idle - prev_idle) * 100 / (elapsed * smp_get_online_count()), 0);
+        fb_puts("%   (any key quits)\n\n");
+        fb_puts("  ID NAME        STATE    PRIO   %CPU    CPU(ms)\n");
+        
+        for (n = 0; n < count; n++) {
+            struct thread_info *t = &info[n];
+            unsigned int used = t->cpu_ticks;
+            
+            /* Ticks since the last refresh, if we saw the thread then */
+            for (i = 0; i < prev_count; i++) {
+                if (prev_ids[i] == t->id) {
+                    used -= prev_ticks[i];
+                    break;
+                }
+            }
+            
+            print_number(t->id, 4);
+            fb_puts(" ");
+            print_column(t->name, 12);
+            print_column(thread_state_names[t->state], 9);
+            print_column(thread_prio_names[t->priority], 6);
+            print_number(used * 100 / elapsed, 5);
+            print_number(t->cpu_ticks * (1000 / TIMER_HZ), 11);
+            fb_puts("\n");
+        }
+        print_more_threads(total);
+        
+        for (n = 0; n < count; n++) {
+            prev_ids[n] = info[n].id;
+            prev_ticks[n] = info[n].cpu_ticks;
+        }
+        prev_count = count;
+        prev_idle = idle;
+        prev_time = now;
+        
+        if (input_poll(1000)) {
+            break;
+        }
+    }
+    fb_clear();
+}
+
+/** burn_thread - spins until the tick count in arg */
+static void burn_thread(void *arg)
+{
+    unsigned int deadline = (unsigned int)arg;
+    
+    while ((int)(deadline - timer_get_ticks()) > 0) {
+    }
+}
+
+/** shell_burn_command - a CPU-bound low priority thread, to watch in top */
+void shell_burn_command(char *args)
+{
+    unsigned int seconds = 0;
+    struct thread *t;
+    
+    while (*args >= '0' && *args <= '9') {
+        seconds = seconds * 10 + (*args++ - '0');
+    }
+    if (seconds == 0) {
+        seconds = 10;
+    }
+    
+    t = thread_create("burn", burn_thread,
+                      (void *)(timer_get_ticks() + seconds * TIMER_HZ),
+                      THREAD_PRIO_LOW, KSTACK_SIZE);
+    if (!t) {
+        fb_puts("burn: out of memory\n");
+        return;
+    }
+    fb_puts("burn: spinning in the background, see ps/top\n");
+}
+
 /** shell_help_command */
 void shell_help_command(void)
 {
@@ -459,6 +759,9 @@ void shell_help_command(void)
     fb_puts("  sysinfo  - System info (REAL!)\n");
     fb_puts("  cpu      - CPU info (REAL!)\n");
     fb_puts("  mem      - Memory info (REAL!)\n");
+    fb_puts("  membench - memcpy/memset throughput\n");
+    fb_puts("  ps/top   - Threads and CPU use\n");
+    fb_puts("  burn     - Busy background thread\n");
     fb_puts("  cd/pwd/ls- Navigation\n");
     fb_puts("  cat      - Display file contents\n");
     fb_puts("  mkdir    - Create directory\n");
@@ -471,6 +774,7 @@ void shell_help_command(void)
     fb_puts("  play     - Snake game\n");
     fb_puts("  realistic- 3-valued logic demo\n");
     fb_puts("  reboot/halt - Power\n");
+    fb_puts("Alt+F1..F4 switch consoles, Shift+PgUp/PgDn scroll back\n");
 }
 
 /** shell_echo_command */
@@ -542,6 +846,7 @@ void shell_reboot_command(void)
 void shell_halt_command(void)
 {
     fb_puts("Halting...\n");
+    fb_flush();
     __asm__ volatile("cli; hlt");
     while(1);
 }
@@ -549,9 +854,9 @@ void shell_halt_command(void)
 /** shell_play_command */
 void shell_play_command(void)
 {
+    fb_console_select(GAME_CONSOLE);
     snake_game();
-    fb_clear();
-    fb_puts("Welcome back!\n\n");
+    fb_console_select(SHELL_CONSOLE);
 }
 
 /** shell_execute_command */
@@ -591,6 +896,14 @@ void shell_execute_command(void)
         shell_cpu_command();
     } else if (strcmp(cmd, "mem") == 0) {
         shell_mem_command();
+    } else if (strcmp(cmd, "membench") == 0) {
+        shell_membench_command();
+    } else if (strcmp(cmd, "ps") == 0) {
+        shell_ps_command();
+    } else if (strcmp(cmd, "top") == 0) {
+        shell_top_command();
+    } else if (strcmp(cmd, "burn") == 0) {
+        shell_burn_command(args);
     } else if (strcmp(cmd, "visit") == 0 || strcmp(cmd, "vst") == 0 || strcmp(cmd, "cd") == 0) {
         shell_visit_command(args);
     } else if (strcmp(cmd, "pwd") == 0) {
@@ -632,15 +945,19 @@ void shell_execute_command(void)
         fb_puts("\n");
     }
     
+    arena_reset(&command_arena);
+    
     buffer_index = 0;
     fb_puts(current_directory);
     fb_puts(" > ");
+    fb_flush();
 }
 
 /** shell_init */
 void shell_init(void)
 {
     buffer_index = 0;
+    arena_init(&command_arena);
     fb_clear();
     
     fb_puts(" ____       _        __     _  ___  ____  \n");
@@ -662,25 +979,20 @@ void shell_init(void)
 /** shell_update */
 void shell_update(void)
 {
-    char c = keyboard_get_char();
-    
-    if (c != 0) {
-        serial_write("CHAR: ", 6);
-        serial_write(&c, 1);
-        serial_write("\n", 1);
-        
-        if (c == '\n') {
-            fb_putc('\n');
-            shell_execute_command();
-        } else if (c == '\b') {
-            if (buffer_index > 0) {
-                buffer_index--;
-                fb_putc('\b');
-            }
-        } else if (buffer_index < COMMAND_BUFFER_SIZE - 1) {
-            command_buffer[buffer_index] = c;
-            buffer_index++;
-            fb_putc(c);
+    char c = input_read_blocking();
+    
+    if (c == '\n') {
+        fb_putc('\n');
+        shell_execute_command();
+    } else if (c == '\b') {
+        if (buffer_index > 0) {
+            buffer_index--;
+            fb_putc('\b');
         }
+    } else if (c >= 32 && c <= 126 && buffer_index < COMMAND_BUFFER_SIZE - 1) {
+        /* Printable only: ESC would start an escape sequence on screen */
+        command_buffer[buffer_index] = c;
+        buffer_index++;
+        fb_putc(c);
     }
 }
\ No newline at end of file
@@ -7,8 +7,28 @@
 void shell_init(void);
 
 /** shell_update:
- *  Updates the shell (call this in main loop)
+ *  Sleeps until a character is typed and handles it (call this in
+ *  main loop)
  */
 void shell_update(void);
 
+/** shell_alloc:
+ *  Allocates scratch memory for the running command. It is all freed
+ *  at once when the command returns, so there is no free call.
+ *
+ *  @param size  The number of bytes
+ *  @return      The memory, or 0 if memory is exhausted
+ */
+void *shell_alloc(unsigned int size);
+
+/** shell_build_path:
+ *  Resolves a command argument against a directory, in memory from
+ *  shell_alloc
+ *
+ *  @param dir  The directory relative paths start from
+ *  @param arg  An absolute or relative path
+ *  @return     The full path, or 0 if memory is exhausted
+ */
+char *shell_build_path(const char *dir, const char *arg);
+
 #endif /* INCLUDE_SHELL_H */
\ No newline at end of file
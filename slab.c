@@ -0,0 +1,339 @@
+/**
+ * slab.c - Slab caches and kmalloc
+ *
+ * Each slab is one frame: a header, then equally sized objects. Free
+ * objects are chained through their first word, so allocation and free
+ * are a list pop and push. The header sits at the start of the frame,
+ * which lets kfree find it by masking the pointer. Frame-sized kmalloc
+ * requests use the same header with no cache.
+ */
+
+#include "slab.h"
+#include "pmm.h"
+#include "paging.h"
+#include "spinlock.h"
+
+/** Frame header; also the header of a large kmalloc allocation */
+struct slab {
+    struct slab *prev;
+    struct slab *next;
+    struct kmem_cache *cache;       /* 0 for a large allocation */
+    void *free_list;
+    unsigned int inuse;
+    unsigned int frames;            /* Large allocations only */
+};
+
+/* Objects start after the header, 16-byte aligned */
+#define SLAB_HEADER_SIZE    ((sizeof(struct slab) + 15) & ~15u)
+
+#define SLAB_MIN_OBJECT     8
+
+#define KMALLOC_NUM_CLASSES 7       /* 16 to 1024 bytes */
+
+static const char *kmalloc_names[KMALLOC_NUM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+static struct kmem_cache kmalloc_caches[KMALLOC_NUM_CLASSES];
+
+static struct kmem_cache *cache_list = 0;
+
+static unsigned int large_allocs = 0;
+static unsigned int large_frames = 0;
+
+/* One lock for every cache; taken before the PMM's */
+static struct spinlock heap_lock;
+
+/** slab_lock:
+ *  Locks the caches against other threads and processors, returning
+ *  the old EFLAGS
+ */
+static unsigned int slab_lock(void)
+{
+    return spin_lock_irqsave(&heap_lock);
+}
+
+/** slab_unlock:
+ *  Releases the lock taken by slab_lock
+ */
+static void slab_unlock(unsigned int flags)
+{
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+static struct slab *slab_of(void *ptr)
+{
+    return (struct slab *)((unsigned int)ptr & ~(PMM_FRAME_SIZE - 1));
+}
+
+static void slab_list_add(struct slab **head, struct slab *s)
+{
+    s->prev = 0;
+    s->next = *head;
+    if (*head) {
+        (*head)->prev = s;
+    }
+    *head = s;
+}
+
+static void slab_list_remove(struct slab **head, struct slab *s)
+{
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        *head = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+}
+
+/** slab_create:
+ *  Takes a frame from the PMM and threads its objects onto a free list
+ */
+static struct slab *slab_create(struct kmem_cache *cache)
+{
+    unsigned int frame = pmm_alloc_frame();
+    struct slab *s;
+    char *obj;
+    unsigned int i;
+
+    if (frame == 0) {
+        return 0;
+    }
+
+    s = phys_to_virt(frame);
+    s->cache = cache;
+    s->inuse = 0;
+    s->frames = 1;
+    s->free_list = 0;
+
+    /* Thread back to front so the list hands out ascending addresses */
+    obj = (char *)s + SLAB_HEADER_SIZE + cache->objects_per_slab * cache->object_size;
+    for (i = 0; i < cache->objects_per_slab; i++) {
+        obj -= cache->object_size;
+        *(void **)obj = s->free_list;
+        s->free_list = obj;
+    }
+
+    cache->num_slabs++;
+    cache->total_objects += cache->objects_per_slab;
+    return s;
+}
+
+/** slab_destroy:
+ *  Gives an empty slab's frame back to the PMM
+ */
+static void slab_destroy(struct kmem_cache *cache, struct slab *s)
+{
+    cache->num_slabs--;
+    cache->total_objects -= cache->objects_per_slab;
+    pmm_free_frame(virt_to_phys(s));
+}
+
+/** kmem_cache_init */
+int kmem_cache_init(struct kmem_cache *cache, const char *name,
+                    unsigned int size)
+{
+    if (size == 0 || size > KMALLOC_MAX_SLAB_SIZE) {
+        return -1;
+    }
+    if (size < SLAB_MIN_OBJECT) {
+        size = SLAB_MIN_OBJECT;
+    }
+
+    cache->name = name;
+    cache->object_size = (size + 7) & ~7u;
+    cache->objects_per_slab = (PMM_FRAME_SIZE - SLAB_HEADER_SIZE) / cache->object_size;
+    cache->partial = 0;
+    cache->full = 0;
+    cache->empty = 0;
+    cache->active_objects = 0;
+    cache->total_objects = 0;
+    cache->num_slabs = 0;
+
+    cache->next = cache_list;
+    cache_list = cache;
+    return 0;
+}
+
+/** kmem_cache_alloc */
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+    unsigned int flags = slab_lock();
+    struct slab *s = cache->partial;
+    void *obj;
+
+    if (!s) {
+        if (cache->empty) {
+            s = cache->empty;
+            cache->empty = 0;
+        } else {
+            s = slab_create(cache);
+            if (!s) {
+                slab_unlock(flags);
+                return 0;
+            }
+        }
+        slab_list_add(&cache->partial, s);
+    }
+
+    obj = s->free_list;
+    s->free_list = *(void **)obj;
+    s->inuse++;
+    cache->active_objects++;
+
+    if (s->inuse == cache->objects_per_slab) {
+        slab_list_remove(&cache->partial, s);
+        slab_list_add(&cache->full, s);
+    }
+
+    slab_unlock(flags);
+    return obj;
+}
+
+/** kmem_cache_free */
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+    unsigned int flags = slab_lock();
+    struct slab *s = slab_of(obj);
+
+    if (s->inuse == cache->objects_per_slab) {
+        slab_list_remove(&cache->full, s);
+        slab_list_add(&cache->partial, s);
+    }
+
+    *(void **)obj = s->free_list;
+    s->free_list = obj;
+    s->inuse--;
+    cache->active_objects--;
+
+    /* Keep one empty slab so alloc/free at a boundary doesn't thrash the PMM */
+    if (s->inuse == 0) {
+        slab_list_remove(&cache->partial, s);
+        if (!cache->empty) {
+            cache->empty = s;
+        } else {
+            slab_destroy(cache, s);
+        }
+    }
+
+    slab_unlock(flags);
+}
+
+/** kmem_cache_list */
+const struct kmem_cache *kmem_cache_list(void)
+{
+    return cache_list;
+}
+
+/** slab_init */
+void slab_init(void)
+{
+    unsigned int i;
+
+    /* Added in reverse so /proc/slabinfo lists the smallest class first */
+    for (i = KMALLOC_NUM_CLASSES; i-- > 0; ) {
+        kmem_cache_init(&kmalloc_caches[i], kmalloc_names[i], 16u << i);
+    }
+}
+
+/** kmalloc */
+void *kmalloc(unsigned int size)
+{
+    unsigned int i;
+    unsigned int frames;
+    unsigned int flags;
+    unsigned int phys;
+    struct slab *s = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    if (size <= KMALLOC_MAX_SLAB_SIZE) {
+        for (i = 0; (16u << i) < size; i++) {
+        }
+        return kmem_cache_alloc(&kmalloc_caches[i]);
+    }
+
+    if (size > 0xFFFFFFFF - SLAB_HEADER_SIZE - PMM_FRAME_SIZE) {
+        return 0;
+    }
+    frames = (size + SLAB_HEADER_SIZE + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+
+    flags = slab_lock();
+    phys = pmm_alloc_frames(frames);
+    if (phys) {
+        s = phys_to_virt(phys);
+        s->cache = 0;
+        s->frames = frames;
+        large_allocs++;
+        large_frames += frames;
+    }
+    slab_unlock(flags);
+
+    return s ? (char *)s + SLAB_HEADER_SIZE : 0;
+}
+
+/** kfree */
+void kfree(void *ptr)
+{
+    struct slab *s;
+    unsigned int flags;
+
+    if (!ptr) {
+        return;
+    }
+
+    s = slab_of(ptr);
+    if (s->cache) {
+        kmem_cache_free(s->cache, ptr);
+        return;
+    }
+
+    flags = slab_lock();
+    large_allocs--;
+    large_frames -= s->frames;
+    pmm_free_frames(virt_to_phys(s), s->frames);
+    slab_unlock(flags);
+}
+
+/** ksize */
+unsigned int ksize(const void *ptr)
+{
+    struct slab *s;
+
+    if (!ptr) {
+        return 0;
+    }
+
+    s = slab_of((void *)ptr);
+    if (s->cache) {
+        return s->cache->object_size;
+    }
+    return s->frames * PMM_FRAME_SIZE - SLAB_HEADER_SIZE;
+}
+
+/** slab_stats */
+void slab_stats(unsigned int *frames, unsigned int *active_bytes)
+{
+    struct kmem_cache *cache;
+    unsigned int flags = slab_lock();
+
+    *frames = 0;
+    *active_bytes = 0;
+    for (cache = cache_list; cache; cache = cache->next) {
+        *frames += cache->num_slabs;
+        *active_bytes += cache->active_objects * cache->object_size;
+    }
+    slab_unlock(flags);
+}
+
+/** kmalloc_large_stats */
+void kmalloc_large_stats(unsigned int *allocs, unsigned int *frames)
+{
+    *allocs = large_allocs;
+    *frames = large_frames;
+}
@@ -0,0 +1,105 @@
+#ifndef INCLUDE_SLAB_H
+#define INCLUDE_SLAB_H
+
+/* Largest kmalloc size served from a slab; bigger requests get whole frames */
+#define KMALLOC_MAX_SLAB_SIZE   1024
+
+struct slab;
+
+/** A cache of equally sized objects, carved out of 4 KB frames */
+struct kmem_cache {
+    const char *name;
+    unsigned int object_size;
+    unsigned int objects_per_slab;
+    struct slab *partial;           /* Slabs with used and free objects */
+    struct slab *full;              /* Slabs with no free object */
+    struct slab *empty;             /* At most one spare slab */
+    unsigned int active_objects;
+    unsigned int total_objects;
+    unsigned int num_slabs;
+    struct kmem_cache *next;        /* All caches, for /proc/slabinfo */
+};
+
+/** kmem_cache_init:
+ *  Sets up a cache and adds it to the cache list. Objects are aligned
+ *  to 8 bytes.
+ *
+ *  @param cache  The cache, usually a static in the owning module
+ *  @param name   The name shown in /proc/slabinfo
+ *  @param size   The object size, at most KMALLOC_MAX_SLAB_SIZE
+ *  @return       0 on success, -1 if the size is out of range
+ */
+int kmem_cache_init(struct kmem_cache *cache, const char *name,
+                    unsigned int size);
+
+/** kmem_cache_alloc:
+ *  Allocates one object. O(1) unless a new frame is needed.
+ *
+ *  @param cache  The cache
+ *  @return       The object (not zeroed), or 0 if memory is exhausted
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+
+/** kmem_cache_free:
+ *  Returns an object to its cache
+ *
+ *  @param cache  The cache it came from
+ *  @param obj    The object
+ */
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/** kmem_cache_list:
+ *  Gets the first cache; follow ->next for the rest
+ *
+ *  @return The first cache
+ */
+const struct kmem_cache *kmem_cache_list(void);
+
+/** slab_init:
+ *  Sets up the kmalloc size-class caches. Needs pmm_init first.
+ */
+void slab_init(void);
+
+/** kmalloc:
+ *  Allocates memory from the kernel heap. Sizes up to
+ *  KMALLOC_MAX_SLAB_SIZE come from the smallest fitting size class,
+ *  larger ones from contiguous frames.
+ *
+ *  @param size  The number of bytes
+ *  @return      The memory (not zeroed), or 0 on failure
+ */
+void *kmalloc(unsigned int size);
+
+/** kfree:
+ *  Frees memory from kmalloc. kfree(0) does nothing.
+ *
+ *  @param ptr  The memory
+ */
+void kfree(void *ptr);
+
+/** ksize:
+ *  Gets the usable size of a kmalloc allocation, which may be more than
+ *  was asked for
+ *
+ *  @param ptr  The allocation, or 0
+ *  @return     The size in bytes, 0 for a null pointer
+ */
+unsigned int ksize(const void *ptr);
+
+/** slab_stats:
+ *  Gets the memory held by all slab caches
+ *
+ *  @param frames        Set to the number of frames in slabs
+ *  @param active_bytes  Set to the bytes of allocated objects in them
+ */
+void slab_stats(unsigned int *frames, unsigned int *active_bytes);
+
+/** kmalloc_large_stats:
+ *  Gets the allocations kmalloc served from whole frames
+ *
+ *  @param allocs  Set to the number of live allocations
+ *  @param frames  Set to the number of frames they use
+ */
+void kmalloc_large_stats(unsigned int *allocs, unsigned int *frames);
+
+#endif /* INCLUDE_SLAB_H */
@@ -0,0 +1,367 @@
+/**
+ * smp.c - Application processor bring-up and inter-processor interrupts
+ *
+ * The boot processor finds the others in the ACPI MADT (apic.c) and
+ * starts them one at a time with INIT-SIPI-SIPI. An AP begins in real
+ * mode in the trampoline (smp_asm.s) copied below 1 MB, which turns on
+ * protected mode and paging and calls smp_ap_main on a stack allocated
+ * for it. While APs start, the kernel page directory also maps the first
+ * 4 MB 1:1 so the trampoline keeps running once paging is on.
+ *
+ * Every processor gets its own GDT and TSS with a per-CPU segment in GS
+ * pointing at its struct cpu, its own interrupt and double fault stacks
+ * and an idle thread; the IDT is shared. Device interrupts still all go
+ * to the boot processor, which forwards the timer tick to the others
+ * for their time slices. Threads move between processors through the
+ * shared run queues (thread.c), and reschedule IPIs wake idle ones.
+ */
+
+#include "smp.h"
+#include "gdt.h"
+#include "idt.h"
+#include "kstack.h"
+#include "thread.h"
+#include "paging.h"
+#include "hardware.h"
+#include "exception.h"
+#include "timer.h"
+#include "memory.h"
+#include "kstring.h"
+#include "spinlock.h"
+
+/* From smp_asm.s */
+extern char smp_trampoline_start[];
+extern char smp_trampoline_end[];
+extern char smp_trampoline_cr3[];
+extern char smp_trampoline_stack[];
+extern char smp_trampoline_entry[];
+
+/* Waits of the startup sequence, in microseconds */
+#define SMP_INIT_DELAY_US       10000
+#define SMP_SIPI_DELAY_US       200
+#define SMP_START_TIMEOUT_US    100000
+#define SMP_POLL_US             100
+
+struct cpu cpus[SMP_MAX_CPUS];
+
+static volatile unsigned int online_count = 1;
+
+/* The AP being started; it sets booting_done once it is up or gave up */
+static struct cpu *volatile booting_cpu = 0;
+static volatile int booting_done = 0;
+
+/* One TLB shootdown at a time. The initiator sets the range, then a bit
+ * per target processor in tlb_targets; each target flushes and clears
+ * its bit. tlb_pages 0 means the whole TLB. */
+static struct spinlock tlb_lock;
+static volatile unsigned int tlb_targets = 0;
+static volatile unsigned int tlb_start = 0;
+static volatile unsigned int tlb_pages = 0;
+
+/** atomic_inc:
+ *  Locked increment, for counters shared with other processors
+ */
+static void atomic_inc(volatile unsigned int *value)
+{
+    __asm__ volatile("lock incl %0" : "+m"(*value) : : "memory");
+}
+
+/** atomic_or / atomic_and:
+ *  Locked bit set and clear, for masks shared with other processors
+ */
+static void atomic_or(volatile unsigned int *value, unsigned int bits)
+{
+    __asm__ volatile("lock orl %1, %0" : "+m"(*value) : "r"(bits) : "memory");
+}
+
+static void atomic_and(volatile unsigned int *value, unsigned int bits)
+{
+    __asm__ volatile("lock andl %1, %0" : "+m"(*value) : "r"(bits) : "memory");
+}
+
+/** smp_delay_us:
+ *  Busy-waits on the TSC
+ */
+static void smp_delay_us(unsigned int us)
+{
+    unsigned long long end = hw_read_tsc() +
+                             (unsigned long long)us * timer_tsc_per_us();
+
+    while (hw_read_tsc() < end) {
+        __asm__ volatile("pause");
+    }
+}
+
+/** smp_make_name:
+ *  Builds "<prefix><id>", e.g. "idle1"
+ */
+static void smp_make_name(char *name, const char *prefix, unsigned int id)
+{
+    char num[16];
+
+    uint_to_str(id, num);
+    strcpy(name, prefix);
+    strcat(name, num);
+}
+
+/** smp_trampoline_set:
+ *  Stores a value in a variable of the trampoline's low memory copy
+ */
+static void smp_trampoline_set(char *var, unsigned int value)
+{
+    unsigned char *copy = phys_to_virt(SMP_TRAMPOLINE_PHYS);
+
+    *(unsigned int *)(copy + (var - smp_trampoline_start)) = value;
+}
+
+/** smp_ap_main:
+ *  First C code of an AP, called by the trampoline on its idle stack
+ *  with interrupts disabled
+ */
+static void smp_ap_main(void)
+{
+    struct cpu *cpu = booting_cpu;
+
+    gdt_install(cpu);
+    idt_load();
+    paging_init_cpu();
+    hw_init_fpu();
+    apic_init_cpu();
+    exception_init_cpu();
+    thread_init_cpu(cpu->idle_name);
+
+    if (cpu->idle) {
+        cpu->online = 1;
+        atomic_inc(&online_count);
+    }
+    booting_done = 1;
+
+    if (!cpu->online) {
+        while (1) {
+            __asm__ volatile("cli; hlt");
+        }
+    }
+    thread_idle();
+}
+
+/** smp_start_cpu:
+ *  Allocates an AP's stacks and starts it
+ *
+ *  @return 0 once it is online, -1 if it didn't come up
+ */
+static int smp_start_cpu(struct cpu *cpu)
+{
+    struct kstack *idle_stack;
+    struct kstack *irq_stack;
+    unsigned int startup = APIC_IPI_STARTUP | (SMP_TRAMPOLINE_PHYS >> 12);
+    unsigned int waited;
+
+    smp_make_name(cpu->idle_name, "idle", cpu->id);
+    smp_make_name(cpu->irq_name, "irq", cpu->id);
+    idle_stack = kstack_create(cpu->idle_name, KSTACK_SIZE);
+    irq_stack = kstack_create(cpu->irq_name, KSTACK_IRQ_SIZE);
+    if (!idle_stack || !irq_stack) {
+        if (idle_stack) {
+            kstack_destroy(idle_stack);
+        }
+        if (irq_stack) {
+            kstack_destroy(irq_stack);
+        }
+        return -1;
+    }
+    cpu->irq_stack_top = kstack_top(irq_stack);
+
+    smp_trampoline_set(smp_trampoline_cr3, virt_to_phys(paging_kernel_directory()));
+    smp_trampoline_set(smp_trampoline_stack, kstack_top(idle_stack));
+    smp_trampoline_set(smp_trampoline_entry, (unsigned int)smp_ap_main);
+    booting_cpu = cpu;
+    booting_done = 0;
+
+    /* The MP specification's sequence: INIT, wait, then two SIPIs */
+    apic_send_ipi(cpu->apic_id, APIC_IPI_INIT);
+    smp_delay_us(SMP_INIT_DELAY_US);
+    apic_send_ipi(cpu->apic_id, startup);
+    smp_delay_us(SMP_SIPI_DELAY_US);
+    if (!booting_done) {
+        apic_send_ipi(cpu->apic_id, startup);
+    }
+
+    for (waited = 0; !booting_done && waited < SMP_START_TIMEOUT_US;
+         waited += SMP_POLL_US) {
+        smp_delay_us(SMP_POLL_US);
+    }
+
+    /* On a timeout the stacks stay allocated: the AP may still be
+     * starting on them */
+    return cpu->online ? 0 : -1;
+}
+
+/** smp_reschedule_ipi:
+ *  Nothing to do: the interrupt stub switches threads on the way out if
+ *  need_resched is set, and an idle processor leaves hlt
+ */
+static void smp_reschedule_ipi(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+}
+
+/** smp_tick_ipi:
+ *  The timer tick forwarded by the boot processor
+ */
+static void smp_tick_ipi(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+    thread_tick();
+}
+
+/** smp_tlb_service:
+ *  Does the flush a shootdown asked of this processor, if any. Called
+ *  from the IPI and by processors spinning for tlb_lock, which may have
+ *  interrupts disabled.
+ */
+static void smp_tlb_service(void)
+{
+    unsigned int bit = 1u << cpu_self()->id;
+
+    if (!(tlb_targets & bit)) {
+        return;
+    }
+    if (tlb_pages == 0) {
+        paging_flush_tlb();
+    } else {
+        paging_flush_tlb_range(tlb_start, tlb_pages);
+    }
+    atomic_and(&tlb_targets, ~bit);
+}
+
+/** smp_tlb_ipi:
+ *  A shootdown from another processor
+ */
+static void smp_tlb_ipi(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+    smp_tlb_service();
+}
+
+/** cpu_self */
+struct cpu *cpu_self(void)
+{
+    struct cpu *cpu;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/** smp_init */
+unsigned int smp_init(void)
+{
+    unsigned int count = apic_get_cpu_count();
+    unsigned int boot_apic_id = apic_get_id();
+    unsigned int next = 1;
+    unsigned int i;
+
+    cpus[0].apic_id = boot_apic_id;
+    irq_register(IPI_RESCHEDULE_VECTOR, smp_reschedule_ipi, 0);
+    irq_register(IPI_TICK_VECTOR, smp_tick_ipi, 0);
+    irq_register(IPI_TLB_VECTOR, smp_tlb_ipi, 0);
+
+    if (!apic_is_enabled() || count < 2) {
+        return online_count;
+    }
+
+    memcpy(phys_to_virt(SMP_TRAMPOLINE_PHYS), smp_trampoline_start,
+           smp_trampoline_end - smp_trampoline_start);
+    paging_set_low_identity(1);
+
+    for (i = 0; i < count && next < SMP_MAX_CPUS; i++) {
+        unsigned int apic_id = apic_get_cpu_apic_id(i);
+
+        if (apic_id == boot_apic_id) {
+            continue;
+        }
+        cpus[next].id = next;
+        cpus[next].apic_id = apic_id;
+        if (smp_start_cpu(&cpus[next]) != 0) {
+            break;
+        }
+        next++;
+    }
+
+    paging_set_low_identity(0);
+    smp_flush_tlb();
+    return online_count;
+}
+
+/** smp_get_online_count */
+unsigned int smp_get_online_count(void)
+{
+    return online_count;
+}
+
+/** smp_send_reschedule */
+void smp_send_reschedule(struct cpu *cpu)
+{
+    apic_send_ipi(cpu->apic_id, APIC_IPI_FIXED | IPI_RESCHEDULE_VECTOR);
+}
+
+/** smp_send_tick */
+void smp_send_tick(void)
+{
+    unsigned int i;
+
+    if (online_count < 2) {
+        return;
+    }
+    for (i = 1; i < SMP_MAX_CPUS; i++) {
+        if (cpus[i].online) {
+            apic_send_ipi(cpus[i].apic_id, APIC_IPI_FIXED | IPI_TICK_VECTOR);
+        }
+    }
+}
+
+/** smp_flush_tlb_range */
+void smp_flush_tlb_range(unsigned int virt, unsigned int pages)
+{
+    struct cpu *self;
+    unsigned int targets = 0;
+    unsigned int i;
+
+    if (online_count < 2) {
+        return;
+    }
+
+    preempt_disable();
+    /* Whoever holds the lock may be waiting on us, and with interrupts
+     * off its IPI can't get through */
+    while (!spin_trylock(&tlb_lock)) {
+        smp_tlb_service();
+        __asm__ volatile("pause");
+    }
+    self = cpu_self();
+    tlb_start = virt;
+    tlb_pages = pages;
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        if (cpus[i].online && &cpus[i] != self) {
+            targets |= 1u << i;
+        }
+    }
+    atomic_or(&tlb_targets, targets);
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        if (targets & (1u << i)) {
+            apic_send_ipi(cpus[i].apic_id, APIC_IPI_FIXED | IPI_TLB_VECTOR);
+        }
+    }
+    while (tlb_targets) {
+        __asm__ volatile("pause");
+    }
+    spin_unlock(&tlb_lock);
+    preempt_enable();
+}
+
+/** smp_flush_tlb */
+void smp_flush_tlb(void)
+{
+    smp_flush_tlb_range(0, 0);
+}
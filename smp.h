@@ -0,0 +1,92 @@
+#ifndef INCLUDE_SMP_H
+#define INCLUDE_SMP_H
+
+#include "apic.h"
+
+#define SMP_MAX_CPUS            APIC_MAX_CPUS
+
+/* Physical page the application processors start in; below 1 MB,
+ * where the PMM never hands out frames
+ */
+#define SMP_TRAMPOLINE_PHYS     0x8000
+
+struct thread;
+
+/** Per-CPU data. GS addresses the running processor's copy (see
+ *  gdt_install); the offsets of the first four fields are also used by
+ *  the interrupt stub in idt_asm.s.
+ */
+struct cpu {
+    struct cpu *self;               /* 0: for cpu_self */
+    unsigned int irq_stack_top;     /* 4: top of the interrupt stack, or 0 */
+    unsigned int irq_nesting;       /* 8: interrupt nesting depth */
+    volatile unsigned int need_resched; /* 12: see thread_preempt */
+    unsigned int id;                /* Index in cpus[] */
+    unsigned int apic_id;
+    volatile int online;            /* Running and taking threads */
+    struct thread *current;         /* Running thread */
+    struct thread *idle;            /* Runs when no thread is ready */
+    char idle_name[8];              /* Names of the idle thread and the */
+    char irq_name[8];               /* interrupt stack of an AP */
+};
+
+/* Every processor; cpus[0] is the boot processor */
+extern struct cpu cpus[SMP_MAX_CPUS];
+
+/** cpu_self:
+ *  Gets the data of the running processor. The caller must not migrate
+ *  while using it: hold interrupts or preemption off.
+ *
+ *  @return The processor's struct cpu
+ */
+struct cpu *cpu_self(void);
+
+/** smp_init:
+ *  Starts every application processor listed in the ACPI MADT with
+ *  INIT-SIPI-SIPI. Each one joins the scheduler as soon as it is up.
+ *  Needs the APIC, the timer and the thread system, with interrupts
+ *  enabled.
+ *
+ *  @return The number of processors online, the boot processor included
+ */
+unsigned int smp_init(void);
+
+/** smp_get_online_count:
+ *  Gets the number of processors taking threads
+ *
+ *  @return The count, at least 1
+ */
+unsigned int smp_get_online_count(void);
+
+/** smp_send_reschedule:
+ *  Interrupts a processor so that it checks need_resched
+ *
+ *  @param cpu  The processor, not the caller's
+ */
+void smp_send_reschedule(struct cpu *cpu);
+
+/** smp_send_tick:
+ *  Forwards the timer tick to the other processors, which have no timer
+ *  of their own. Called from the timer interrupt.
+ */
+void smp_send_tick(void);
+
+/** smp_flush_tlb_range:
+ *  Flushes a range of pages from the TLB of every other processor and
+ *  waits until they are done. Needed after a kernel mapping is removed
+ *  or changed; batch the pages and shoot them down once. Works with
+ *  interrupts disabled, but not while holding a spinlock that another
+ *  processor may spin on with interrupts disabled.
+ *
+ *  @param virt   The first page
+ *  @param pages  The number of pages, 0 for the whole TLB
+ */
+void smp_flush_tlb_range(unsigned int virt, unsigned int pages);
+
+/** smp_flush_tlb:
+ *  Flushes the whole TLB of every other processor, global pages
+ *  included, like smp_flush_tlb_range(0, 0)
+ */
+void smp_flush_tlb(void);
+
+#endif /* INCLUDE_SMP_H */
@@ -0,0 +1,88 @@
+; smp_asm.s - Application processor startup trampoline
+; Copied by smp.c to SMP_TRAMPOLINE_PHYS (0x8000), where the startup IPI
+; points each AP. The AP starts in real mode at CS:IP = 0800:0000, so the
+; code uses addresses relative to that copy, not where it is linked.
+; smp.c fills in the page directory, stack and entry point before every
+; start; the page directory maps the trampoline page 1:1 while it runs.
+
+TRAMPOLINE_BASE equ 0x8000
+
+; Address of a trampoline label in the copy
+%define TRAMP(label) (TRAMPOLINE_BASE + (label) - smp_trampoline_start)
+
+CR0_PE  equ 0x00000001
+CR0_WP  equ 0x00010000
+CR0_PG  equ 0x80000000
+CR4_PSE equ 0x00000010
+
+section .text
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_trampoline_cr3
+global smp_trampoline_stack
+global smp_trampoline_entry
+
+bits 16
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMP(tramp_gdtr)]
+    mov eax, cr0
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMP(tramp_protected)
+
+bits 32
+tramp_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+    xor ax, ax
+    mov fs, ax
+    mov gs, ax
+
+    ; Same paging setup as the boot processor: 4 MB pages, then the
+    ; kernel page directory
+    mov eax, cr4
+    or eax, CR4_PSE
+    mov cr4, eax
+    mov eax, [TRAMP(smp_trampoline_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, CR0_PG | CR0_WP
+    mov cr0, eax
+
+    ; Into the higher half, on the stack smp.c allocated
+    mov esp, [TRAMP(smp_trampoline_stack)]
+    xor ebp, ebp                ; end of the backtrace chain
+    mov eax, [TRAMP(smp_trampoline_entry)]
+    call eax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; Flat code and data segments, only until the AP loads its own GDT
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF       ; 0x08: code, base 0, limit 4 GB
+    dq 0x00CF92000000FFFF       ; 0x10: data, base 0, limit 4 GB
+tramp_gdtr:
+    dw 3 * 8 - 1
+    dd TRAMP(tramp_gdt)
+
+; Filled in by smp.c
+align 4
+smp_trampoline_cr3:
+    dd 0
+smp_trampoline_stack:
+    dd 0
+smp_trampoline_entry:
+    dd 0
+
+smp_trampoline_end:
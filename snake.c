@@ -1,6 +1,8 @@
 #include "snake.h"
 #include "fb.h"
-#include "keyboard.h"
+#include "input.h"
+#include "timer.h"
+#include "kstring.h"
 
 #define GAME_WIDTH 40
 #define GAME_HEIGHT 20
@@ -30,6 +32,7 @@ static int game_started;
 
 /* Forward declarations */
 void draw_snake(void);
+void draw_snake_head(void);
 void draw_food(void);
 
 /* Simple random number generator */
@@ -44,68 +47,15 @@ void srand(unsigned int s) {
     seed = s;
 }
 
-/* Delay function */
-void delay(unsigned int count) {
-    volatile unsigned int i, j;
-    for (i = 0; i < count; i++) {
-        for (j = 0; j < 10000; j++) {
-            /* Just waste time */
-        }
-    }
-}
-
-/* Integer to string conversion */
-void int_to_str(int num, char *str) {
-    int i = 0;
-    int is_negative = 0;
-    
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
-        return;
-    }
-    
-    if (num < 0) {
-        is_negative = 1;
-        num = -num;
-    }
-    
-    while (num > 0) {
-        str[i++] = '0' + (num % 10);
-        num /= 10;
-    }
-    
-    if (is_negative) {
-        str[i++] = '-';
-    }
-    
-    str[i] = '\0';
-    
-    /* Reverse the string */
-    int start = 0;
-    int end = i - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        start++;
-        end--;
-    }
-}
-
 /* Draw a character at a specific position */
 void draw_at(int x, int y, char c) {
     if (x < 0 || x >= GAME_WIDTH || y < 0 || y >= GAME_HEIGHT) {
         return;
     }
     
-    /* Move to the position (top offset of 2 lines for UI) */
-    int pos = (y + 2) * 80 + (x + 20);  /* Center the game on screen */
-    
-    /* Direct framebuffer access */
-    char *fb = (char *) 0x000B8000;
-    fb[pos * 2] = c;
-    fb[pos * 2 + 1] = 0x0F;  /* White on black */
+    /* Top offset of 2 lines for UI, 20 columns to center the game */
+    fb_goto(x + 20, y + 2);
+    fb_putc(c);
 }
 
 /* Draw centered text */
@@ -122,11 +72,11 @@ void draw_centered_text(int y, const char *text) {
 
 /* Clear the game area */
 void clear_game_area(void) {
-    int x, y;
+    int y;
     for (y = 0; y < GAME_HEIGHT; y++) {
-        for (x = 0; x < GAME_WIDTH; x++) {
-            draw_at(x, y, ' ');
-        }
+        /* Nothing is drawn right of the game: erase to end of line */
+        fb_goto(20, y + 2);
+        fb_puts("\033[K");
     }
 }
 
@@ -134,6 +84,8 @@ void clear_game_area(void) {
 void draw_border(void) {
     int i;
     
+    fb_set_color(FB_DARK_GREY, FB_BLACK);
+    
     /* Top and bottom borders */
     for (i = 0; i < GAME_WIDTH; i++) {
         draw_at(i, 0, '#');
@@ -145,6 +97,8 @@ void draw_border(void) {
         draw_at(0, i, '#');
         draw_at(GAME_WIDTH - 1, i, '#');
     }
+    
+    fb_puts("\033[0m");
 }
 
 /* Generate new food position */
@@ -167,14 +121,14 @@ void generate_food(void) {
     } while (!valid);
 }
 
-/* Calculate delay based on score */
+/* Calculate frame time in milliseconds based on score */
 int calculate_delay(void) {
-    int base_delay = 50;
+    int base_delay = 150;
     int speed_increase = score / 50;  /* Increase speed every 50 points */
-    int new_delay = base_delay - (speed_increase * 5);
+    int new_delay = base_delay - (speed_increase * 10);
     
-    if (new_delay < 10) {
-        new_delay = 10;  /* Minimum delay to keep game playable */
+    if (new_delay < 50) {
+        new_delay = 50;  /* Minimum delay to keep game playable */
     }
     
     return new_delay;
@@ -216,9 +170,7 @@ void init_game(void) {
     draw_centered_text(GAME_HEIGHT / 2 - 1, "Press any key to START");
     
     /* Wait for key press to start */
-    while (keyboard_get_char() == 0) {
-        /* Wait */
-    }
+    input_read_blocking();
     
     /* Clear the start message and draw game */
     clear_game_area();
@@ -231,26 +183,17 @@ void init_game(void) {
 /* Update the score display */
 void update_score(void) {
     char score_str[20];
-    char *fb = (char *) 0x000B8000;
-    int i;
-    
-    /* Clear the score line */
-    for (i = 0; i < 20; i++) {
-        fb[(1 * 80 + 7 + i) * 2] = ' ';
-    }
     
-    /* Write new score */
     int_to_str(score, score_str);
-    i = 0;
-    while (score_str[i] != '\0') {
-        fb[(1 * 80 + 7 + i) * 2] = score_str[i];
-        i++;
-    }
+    fb_goto(7, 1);
+    fb_puts(score_str);
+    fb_puts("\033[K");
 }
 
 /* Draw the snake */
 void draw_snake(void) {
     int i;
+    fb_set_color(FB_LIGHT_GREEN, FB_BLACK);
     for (i = 0; i < snake_length; i++) {
         if (i == 0) {
             draw_at(snake[i].x, snake[i].y, 'O');  /* Head */
@@ -258,11 +201,24 @@ void draw_snake(void) {
             draw_at(snake[i].x, snake[i].y, 'o');  /* Body */
         }
     }
+    fb_puts("\033[0m");
+}
+
+/* Draw the snake after a move: only the head and the old head change */
+void draw_snake_head(void) {
+    fb_set_color(FB_LIGHT_GREEN, FB_BLACK);
+    draw_at(snake[0].x, snake[0].y, 'O');
+    if (snake_length > 1) {
+        draw_at(snake[1].x, snake[1].y, 'o');
+    }
+    fb_puts("\033[0m");
 }
 
 /* Draw the food */
 void draw_food(void) {
+    fb_set_color(FB_LIGHT_RED, FB_BLACK);
     draw_at(food.x, food.y, '*');
+    fb_puts("\033[0m");
 }
 
 /* Check collision with walls or self */
@@ -354,7 +310,7 @@ void update_game(void) {
 
 /* Process input */
 void process_input(void) {
-    char c = keyboard_get_char();
+    char c = input_poll(0);
     
     if (c != 0) {
         switch (c) {
@@ -397,12 +353,12 @@ void snake_game(void) {
             /* Update game state */
             update_game();
             
-            /* Draw everything */
-            draw_snake();
+            /* Draw what moved; the tail was erased by update_game */
+            draw_snake_head();
             draw_food();
             
-            /* Delay for game speed (increases with score) */
-            delay(calculate_delay());
+            /* Sleep for game speed (increases with score) */
+            timer_sleep(calculate_delay());
         }
         
         /* Game over screen */
@@ -417,10 +373,7 @@ void snake_game(void) {
             fb_puts("\n\nPress any key to restart or Q to quit...\n");
             
             /* Wait for key press */
-            char c = 0;
-            while (c == 0) {
-                c = keyboard_get_char();
-            }
+            char c = input_read_blocking();
             
             if (c == 'q' || c == 'Q') {
                 quit_game = 1;
@@ -0,0 +1,212 @@
+/**
+ * softirq.c - Deferred interrupt work (bottom halves)
+ *
+ * Interrupt handlers only acknowledge the device, stash what they read and
+ * raise a softirq. The softirq handlers do the real work with interrupts
+ * enabled, either on the way out of the interrupt or from the idle loop,
+ * which keeps the time spent with interrupts disabled short.
+ */
+
+#include "softirq.h"
+#include "hardware.h"
+#include "thread.h"
+#include "spinlock.h"
+
+/* Bail out to the idle loop after this many passes over pending work */
+#define MAX_SOFTIRQ_RESTART 10
+
+static softirq_handler_t softirq_handlers[NR_SOFTIRQS];
+static unsigned int softirq_counts[NR_SOFTIRQS];
+static volatile unsigned int softirq_pending = 0;
+static volatile int softirq_active = 0;
+
+/* FPU/SSE state of the interrupted code. Softirq handlers may use SSE
+ * (memcpy does for large copies), so the state is saved eagerly around
+ * them. Softirqs never nest, so one area is enough. Top halves must not
+ * touch the FPU.
+ */
+static unsigned char fpu_state[512] __attribute__((aligned(16)));
+static int save_fpu = 0;
+
+/* Tasklets waiting to run, in scheduling order */
+static struct tasklet *tasklet_head = 0;
+static struct tasklet *tasklet_tail = 0;
+
+/* Guards the pending mask, softirq_active and the tasklet list: threads
+ * on any processor may raise softirqs, schedule tasklets or run them
+ */
+static struct spinlock softirq_spinlock;
+
+/** softirq_lock:
+ *  Disables interrupts and takes the softirq lock, returning the
+ *  previous EFLAGS
+ */
+static unsigned int softirq_lock(void)
+{
+    return spin_lock_irqsave(&softirq_spinlock);
+}
+
+/** softirq_unlock:
+ *  Releases the lock and restores the interrupt flag saved by
+ *  softirq_lock
+ */
+static void softirq_unlock(unsigned int flags)
+{
+    spin_unlock_irqrestore(&softirq_spinlock, flags);
+}
+
+/** tasklet_action:
+ *  Softirq handler running every queued tasklet
+ */
+static void tasklet_action(void)
+{
+    struct tasklet *list;
+    unsigned int flags;
+
+    flags = softirq_lock();
+    list = tasklet_head;
+    tasklet_head = 0;
+    tasklet_tail = 0;
+    softirq_unlock(flags);
+
+    while (list != 0) {
+        struct tasklet *t = list;
+        list = t->next;
+
+        t->next = 0;
+        t->scheduled = 0;
+        t->func(t->data);
+    }
+}
+
+/** softirq_init */
+void softirq_init(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NR_SOFTIRQS; i++) {
+        softirq_handlers[i] = 0;
+        softirq_counts[i] = 0;
+    }
+    softirq_pending = 0;
+    softirq_active = 0;
+    save_fpu = (hw_fpu_enabled() & HW_FPU_SSE) != 0;
+
+    softirq_register(SOFTIRQ_TASKLET, tasklet_action);
+}
+
+/** softirq_register */
+void softirq_register(unsigned int nr, softirq_handler_t handler)
+{
+    if (nr < NR_SOFTIRQS) {
+        softirq_handlers[nr] = handler;
+    }
+}
+
+/** softirq_raise */
+void softirq_raise(unsigned int nr)
+{
+    unsigned int flags;
+
+    if (nr >= NR_SOFTIRQS) {
+        return;
+    }
+
+    flags = softirq_lock();
+    softirq_pending |= 1u << nr;
+    softirq_unlock(flags);
+}
+
+/** softirq_run */
+void softirq_run(void)
+{
+    unsigned int flags;
+    unsigned int pending;
+    int restart = MAX_SOFTIRQ_RESTART;
+
+    flags = softirq_lock();
+
+    if (softirq_active || softirq_pending == 0) {
+        softirq_unlock(flags);
+        return;
+    }
+    softirq_active = 1;
+
+    /* Run from a thread, the pending work must not wait for it to be
+     * scheduled again
+     */
+    preempt_disable();
+
+    if (save_fpu) {
+        __asm__ volatile("fxsave %0" : "=m"(fpu_state));
+    }
+
+    do {
+        unsigned int nr;
+
+        pending = softirq_pending;
+        softirq_pending = 0;
+
+        /* Handlers run with interrupts enabled, unlocked: softirq_active
+         * keeps other processors from running them at the same time
+         */
+        spin_unlock(&softirq_spinlock);
+        __asm__ volatile("sti" : : : "memory");
+
+        for (nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if ((pending & (1u << nr)) && softirq_handlers[nr] != 0) {
+                softirq_handlers[nr]();
+                softirq_counts[nr]++;
+            }
+        }
+
+        __asm__ volatile("cli" : : : "memory");
+        spin_lock(&softirq_spinlock);
+    } while (softirq_pending != 0 && --restart > 0);
+
+    if (save_fpu) {
+        __asm__ volatile("fxrstor %0" : : "m"(fpu_state));
+    }
+
+    softirq_active = 0;
+    softirq_unlock(flags);
+    preempt_enable();
+}
+
+/** softirq_get_count */
+unsigned int softirq_get_count(unsigned int nr)
+{
+    if (nr >= NR_SOFTIRQS) {
+        return 0;
+    }
+    return softirq_counts[nr];
+}
+
+/** tasklet_init */
+void tasklet_init(struct tasklet *t, void (*func)(void *data), void *data)
+{
+    t->next = 0;
+    t->func = func;
+    t->data = data;
+    t->scheduled = 0;
+}
+
+/** tasklet_schedule */
+void tasklet_schedule(struct tasklet *t)
+{
+    unsigned int flags;
+
+    flags = softirq_lock();
+    if (!t->scheduled) {
+        t->scheduled = 1;
+        t->next = 0;
+        if (tasklet_tail != 0) {
+            tasklet_tail->next = t;
+        } else {
+            tasklet_head = t;
+        }
+        tasklet_tail = t;
+        softirq_pending |= 1u << SOFTIRQ_TASKLET;
+    }
+    softirq_unlock(flags);
+}
@@ -0,0 +1,78 @@
+#ifndef INCLUDE_SOFTIRQ_H
+#define INCLUDE_SOFTIRQ_H
+
+/* Softirq numbers, lower numbers run first */
+#define SOFTIRQ_KEYBOARD    0
+#define SOFTIRQ_SERIAL      1
+#define SOFTIRQ_TIMER       2
+#define SOFTIRQ_TASKLET     3
+
+#define NR_SOFTIRQS         8
+
+/** softirq_handler_t:
+ *  A deferred (bottom half) handler. Runs with interrupts enabled.
+ */
+typedef void (*softirq_handler_t)(void);
+
+/* A one-shot deferred function, queued with tasklet_schedule */
+struct tasklet {
+    struct tasklet *next;
+    void (*func)(void *data);
+    void *data;
+    int scheduled;
+};
+
+/** softirq_init:
+ *  Initializes the softirq layer and the tasklet softirq
+ */
+void softirq_init(void);
+
+/** softirq_register:
+ *  Installs the bottom half handler for a softirq number
+ *
+ *  @param nr       The softirq number (0 to NR_SOFTIRQS - 1)
+ *  @param handler  The handler
+ */
+void softirq_register(unsigned int nr, softirq_handler_t handler);
+
+/** softirq_raise:
+ *  Marks a softirq as pending. Safe to call from interrupt handlers; the
+ *  handler runs on the way out of the interrupt or from the idle loop.
+ *
+ *  @param nr  The softirq number
+ */
+void softirq_raise(unsigned int nr);
+
+/** softirq_run:
+ *  Runs all pending softirqs with interrupts enabled. Does nothing when
+ *  called while softirqs are already running (nested interrupt), the
+ *  outer invocation picks up whatever was raised meanwhile.
+ */
+void softirq_run(void);
+
+/** softirq_get_count:
+ *  Gets how many times a softirq handler has run
+ *
+ *  @param nr  The softirq number
+ *  @return    The number of runs
+ */
+unsigned int softirq_get_count(unsigned int nr);
+
+/** tasklet_init:
+ *  Initializes a tasklet
+ *
+ *  @param t     The tasklet
+ *  @param func  The function to run
+ *  @param data  Argument passed to func
+ */
+void tasklet_init(struct tasklet *t, void (*func)(void *data), void *data);
+
+/** tasklet_schedule:
+ *  Queues a tasklet to run once from softirq context. Scheduling a
+ *  tasklet that is already queued does nothing.
+ *
+ *  @param t  The tasklet
+ */
+void tasklet_schedule(struct tasklet *t);
+
+#endif /* INCLUDE_SOFTIRQ_H */
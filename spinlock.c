@@ -0,0 +1,60 @@
+/**
+ * spinlock.c - Locks between processors
+ *
+ * xchg with a memory operand is locked implicitly, so taking the lock
+ * is one atomic exchange. Waiters spin on a plain read with pause until
+ * the lock looks free, so they don't keep pulling the cache line away
+ * from the holder.
+ */
+
+#include "spinlock.h"
+
+/** spin_xchg:
+ *  Atomically stores 1 in the lock, returning the old value
+ */
+static unsigned int spin_xchg(struct spinlock *lock)
+{
+    unsigned int old = 1;
+    __asm__ volatile("xchg %0, %1" : "+r"(old), "+m"(lock->locked) : : "memory");
+    return old;
+}
+
+/** spin_lock */
+void spin_lock(struct spinlock *lock)
+{
+    while (spin_xchg(lock)) {
+        while (lock->locked) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+/** spin_trylock */
+int spin_trylock(struct spinlock *lock)
+{
+    return spin_xchg(lock) == 0;
+}
+
+/** spin_unlock */
+void spin_unlock(struct spinlock *lock)
+{
+    /* x86 doesn't reorder a store with earlier loads or stores */
+    __asm__ volatile("" : : : "memory");
+    lock->locked = 0;
+}
+
+/** spin_lock_irqsave */
+unsigned int spin_lock_irqsave(struct spinlock *lock)
+{
+    unsigned int flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    spin_lock(lock);
+    return flags;
+}
+
+/** spin_unlock_irqrestore */
+void spin_unlock_irqrestore(struct spinlock *lock, unsigned int flags)
+{
+    spin_unlock(lock);
+    __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
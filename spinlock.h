@@ -0,0 +1,51 @@
+#ifndef INCLUDE_SPINLOCK_H
+#define INCLUDE_SPINLOCK_H
+
+/** A busy-waiting lock between processors. Zero is unlocked, so static
+ *  locks need no initialisation.
+ */
+struct spinlock {
+    volatile unsigned int locked;
+};
+
+/** spin_lock:
+ *  Takes a lock, spinning while another processor holds it. Leaves the
+ *  interrupt flag alone: hold it with preemption or interrupts disabled.
+ *
+ *  @param lock  The lock
+ */
+void spin_lock(struct spinlock *lock);
+
+/** spin_trylock:
+ *  Takes a lock if it is free
+ *
+ *  @param lock  The lock
+ *  @return      1 if it was taken, 0 if another holder has it
+ */
+int spin_trylock(struct spinlock *lock);
+
+/** spin_unlock:
+ *  Releases a lock taken with spin_lock or spin_trylock
+ *
+ *  @param lock  The lock
+ */
+void spin_unlock(struct spinlock *lock);
+
+/** spin_lock_irqsave:
+ *  Disables interrupts on this processor, then takes a lock. For data
+ *  that interrupt handlers also touch.
+ *
+ *  @param lock  The lock
+ *  @return      The old EFLAGS, for spin_unlock_irqrestore
+ */
+unsigned int spin_lock_irqsave(struct spinlock *lock);
+
+/** spin_unlock_irqrestore:
+ *  Releases a lock and restores the EFLAGS saved by spin_lock_irqsave
+ *
+ *  @param lock   The lock
+ *  @param flags  The saved EFLAGS
+ */
+void spin_unlock_irqrestore(struct spinlock *lock, unsigned int flags);
+
+#endif /* INCLUDE_SPINLOCK_H */
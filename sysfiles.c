@@ -5,61 +5,61 @@
 #include "sysfiles.h"
 #include "filesystem.h"
 #include "hardware.h"
+#include "meminfo.h"
+#include "idt.h"
+#include "softirq.h"
+#include "apic.h"
+#include "timer.h"
+#include "kstring.h"
+#include "slab.h"
+#include "kstack.h"
+#include "thread.h"
+#include "keyboard.h"
 
-/** Helper to convert int to string */
-static void int_to_str(int num, char *str)
+/* Generated file size; buffers hold one more byte for the terminator */
+#define SYSFILES_BUF_SIZE   2048
+
+/* How often the procfs thread regenerates /proc */
+#define SYSFILES_REFRESH_MS 1000
+
+/** Helper to append string to buffer */
+static void append_str(char *dest, const char *src, int *pos)
 {
-    int i = 0;
-    int is_negative = 0;
-    
-    if (num == 0) {
-        str[0] = '0';
-        str[1] = '\0';
-        return;
-    }
-    
-    if (num < 0) {
-        is_negative = 1;
-        num = -num;
-    }
-    
-    while (num > 0) {
-        str[i++] = '0' + (num % 10);
-        num /= 10;
-    }
-    
-    if (is_negative) {
-        str[i++] = '-';
+    while (*src && *pos < SYSFILES_BUF_SIZE) {
+        dest[(*pos)++] = *src++;
     }
+}
+
+/** Helper to append a number right-aligned in a column of the given width */
+static void append_num_padded(char *dest, unsigned int num, int width, int *pos)
+{
+    char num_str[32];
+    int len = uint_to_str(num, num_str);
     
-    str[i] = '\0';
-    
-    /* Reverse */
-    int start = 0;
-    int end = i - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        start++;
-        end--;
+    while (width-- > len && *pos < SYSFILES_BUF_SIZE) {
+        dest[(*pos)++] = ' ';
     }
+    append_str(dest, num_str, pos);
 }
 
-/** Helper to append string to buffer */
-static void append_str(char *dest, const char *src, int *pos)
+/** Helper to append a "Label:   N kB" line of /proc/meminfo */
+static void append_kb(char *dest, const char *label, unsigned int kb, int *pos)
 {
-    while (*src && *pos < 2048) {
-        dest[(*pos)++] = *src++;
-    }
+    append_str(dest, label, pos);
+    append_num_padded(dest, kb, 8, pos);
+    append_str(dest, " kB\n", pos);
 }
 
 /** sysfiles_populate_etc */
 void sysfiles_populate_etc(void)
 {
-    char buffer[2048];
+    char *buffer = kmalloc(SYSFILES_BUF_SIZE + 1);
     int pos;
     
+    if (!buffer) {
+        return;
+    }
+    
     /* /etc/os-release */
     pos = 0;
     append_str(buffer, "NAME=\"polyfdOS\"\n", &pos);
@@ -111,18 +111,24 @@ void sysfiles_populate_etc(void)
     append_str(buffer, "Type 'help' for available commands\n", &pos);
     buffer[pos] = '\0';
     fs_create("/etc/motd", buffer, pos);
+    
+    kfree(buffer);
 }
 
 /** sysfiles_populate_proc */
 void sysfiles_populate_proc(void)
 {
-    char buffer[2048];
+    char *buffer = kmalloc(SYSFILES_BUF_SIZE + 1);
     char num_str[32];
     int pos;
     unsigned int cpu_family, cpu_model, cpu_stepping;
     unsigned int feat_edx, feat_ecx;
     char vendor[13];
     
+    if (!buffer) {
+        return;
+    }
+    
     /* /proc/cpuinfo */
     pos = 0;
     hw_get_cpu_info(vendor, &cpu_family, &cpu_model, &cpu_stepping);
@@ -161,23 +167,23 @@ void sysfiles_populate_proc(void)
     
     /* /proc/meminfo */
     pos = 0;
-    unsigned int mem = hw_detect_memory();
-    unsigned int mem_kb = mem * 1024;
-    
-    append_str(buffer, "MemTotal:       ", &pos);
-    int_to_str(mem_kb, num_str);
-    append_str(buffer, num_str, &pos);
-    append_str(buffer, " kB\n", &pos);
-    
-    append_str(buffer, "MemFree:        ", &pos);
-    int_to_str(mem_kb - 2048, num_str);
-    append_str(buffer, num_str, &pos);
-    append_str(buffer, " kB\n", &pos);
-    
-    append_str(buffer, "MemAvailable:   ", &pos);
-    int_to_str(mem_kb - 2048, num_str);
-    append_str(buffer, num_str, &pos);
-    append_str(buffer, " kB\n", &pos);
+    struct meminfo info;
+    meminfo_get(&info);
+    
+    append_kb(buffer, "MemTotal:       ", info.total, &pos);
+    append_kb(buffer, "MemFree:        ", info.free, &pos);
+    append_kb(buffer, "MemAvailable:   ", info.free, &pos);
+    append_kb(buffer, "MemUsed:        ", info.used, &pos);
+    append_kb(buffer, "Cached:         ", info.cached, &pos);
+    append_kb(buffer, "FileData:       ", info.file_data, &pos);
+    append_kb(buffer, "Slab:           ", info.slab, &pos);
+    append_kb(buffer, "SlabActive:     ", info.slab_active, &pos);
+    append_kb(buffer, "HeapLarge:      ", info.heap_large, &pos);
+    append_kb(buffer, "KernelStack:    ", info.kernel_stack, &pos);
+    append_kb(buffer, "PageTables:     ", info.page_tables, &pos);
+    append_kb(buffer, "KernelImage:    ", info.kernel, &pos);
+    append_kb(buffer, "Reserved:       ", info.reserved, &pos);
+    append_kb(buffer, "Other:          ", info.other, &pos);
     
     buffer[pos] = '\0';
     fs_create("/proc/meminfo", buffer, pos);
@@ -190,11 +196,140 @@ void sysfiles_populate_proc(void)
     buffer[pos] = '\0';
     fs_create("/proc/version", buffer, pos);
     
+    /* /proc/interrupts - per-vector dispatch statistics */
+    pos = 0;
+    if (apic_is_enabled()) {
+        append_str(buffer, "Controller: IO-APIC + local APIC\n", &pos);
+    } else {
+        append_str(buffer, "Controller: 8259 PIC\n", &pos);
+    }
+    append_str(buffer, " VEC       CALLS  AVG CYCLES  MAX CYCLES  NAME\n", &pos);
+    unsigned int vector;
+    for (vector = 0; vector < IDT_NUM_VECTORS; vector++) {
+        struct irq_stats stats;
+        int registered = irq_get_stats(vector, &stats);
+        
+        if (!registered && stats.calls == 0) {
+            continue;
+        }
+        
+        append_num_padded(buffer, vector, 4, &pos);
+        append_num_padded(buffer, stats.calls, 12, &pos);
+        append_num_padded(buffer, stats.avg_cycles, 12, &pos);
+        append_num_padded(buffer, stats.max_cycles, 12, &pos);
+        append_str(buffer, "  ", &pos);
+        append_str(buffer, irq_get_name(vector), &pos);
+        if (!registered) {
+            append_str(buffer, " (no handler)", &pos);
+        }
+        append_str(buffer, "\n", &pos);
+    }
+    buffer[pos] = '\0';
+    fs_create("/proc/interrupts", buffer, pos);
+    
+    /* /proc/softirqs - bottom half run counts */
+    pos = 0;
+    append_str(buffer, "KEYBOARD: ", &pos);
+    append_num_padded(buffer, softirq_get_count(SOFTIRQ_KEYBOARD), 10, &pos);
+    append_str(buffer, "\nSERIAL:   ", &pos);
+    append_num_padded(buffer, softirq_get_count(SOFTIRQ_SERIAL), 10, &pos);
+    append_str(buffer, "\nTIMER:    ", &pos);
+    append_num_padded(buffer, softirq_get_count(SOFTIRQ_TIMER), 10, &pos);
+    append_str(buffer, "\nTASKLET:  ", &pos);
+    append_num_padded(buffer, softirq_get_count(SOFTIRQ_TASKLET), 10, &pos);
+    append_str(buffer, "\n", &pos);
+    buffer[pos] = '\0';
+    fs_create("/proc/softirqs", buffer, pos);
+    
+    /* /proc/keyboard - input lost to full queues */
+    pos = 0;
+    {
+        unsigned int scan_codes, events;
+        
+        keyboard_get_dropped(&scan_codes, &events);
+        append_str(buffer, "Scan codes dropped: ", &pos);
+        append_num_padded(buffer, scan_codes, 0, &pos);
+        append_str(buffer, "\nEvents dropped:     ", &pos);
+        append_num_padded(buffer, events, 0, &pos);
+        append_str(buffer, "\n", &pos);
+    }
+    buffer[pos] = '\0';
+    fs_create("/proc/keyboard", buffer, pos);
+    
     /* /proc/uptime */
     pos = 0;
-    append_str(buffer, "0.00 0.00\n", &pos);  /* Will be updated dynamically */
+    {
+        unsigned int ticks = timer_get_ticks();
+        unsigned int hundredths = (ticks % TIMER_HZ) * (100 / TIMER_HZ);
+        
+        int_to_str(ticks / TIMER_HZ, num_str);
+        append_str(buffer, num_str, &pos);
+        append_str(buffer, hundredths < 10 ? ".0" : ".", &pos);
+        int_to_str(hundredths, num_str);
+        append_str(buffer, num_str, &pos);
+        append_str(buffer, " 0.00\n", &pos);
+    }
     buffer[pos] = '\0';
     fs_create("/proc/uptime", buffer, pos);
+    
+    /* /proc/slabinfo - slab cache utilisation */
+    pos = 0;
+    append_str(buffer, "NAME            ACTIVE   TOTAL  OBJSIZE  PERSLAB  SLABS\n", &pos);
+    {
+        const struct kmem_cache *cache;
+        unsigned int allocs, frames;
+        
+        for (cache = kmem_cache_list(); cache; cache = cache->next) {
+            int len = strlen(cache->name);
+            
+            append_str(buffer, cache->name, &pos);
+            while (len++ < 12 && pos < SYSFILES_BUF_SIZE) {
+                buffer[pos++] = ' ';
+            }
+            append_num_padded(buffer, cache->active_objects, 10, &pos);
+            append_num_padded(buffer, cache->total_objects, 8, &pos);
+            append_num_padded(buffer, cache->object_size, 9, &pos);
+            append_num_padded(buffer, cache->objects_per_slab, 9, &pos);
+            append_num_padded(buffer, cache->num_slabs, 7, &pos);
+            append_str(buffer, "\n", &pos);
+        }
+        
+        kmalloc_large_stats(&allocs, &frames);
+        append_str(buffer, "large allocations: ", &pos);
+        int_to_str(allocs, num_str);
+        append_str(buffer, num_str, &pos);
+        append_str(buffer, " (", &pos);
+        int_to_str(frames, num_str);
+        append_str(buffer, num_str, &pos);
+        append_str(buffer, " frames)\n", &pos);
+    }
+    buffer[pos] = '\0';
+    fs_create("/proc/slabinfo", buffer, pos);
+    
+    /* /proc/stacks - kernel stack high-water marks */
+    pos = 0;
+    append_str(buffer, "NAME            SIZE    PEAK  PEAK%\n", &pos);
+    {
+        const struct kstack *stack;
+        
+        for (stack = kstack_list(); stack; stack = stack->next) {
+            unsigned int peak = kstack_high_water(stack);
+            int len = strlen(stack->name);
+            
+            append_str(buffer, stack->name, &pos);
+            while (len++ < 12 && pos < SYSFILES_BUF_SIZE) {
+                buffer[pos++] = ' ';
+            }
+            append_num_padded(buffer, stack->size, 8, &pos);
+            append_num_padded(buffer, peak, 8, &pos);
+            append_num_padded(buffer, peak * 100 / stack->size, 6, &pos);
+            append_str(buffer, "%\n", &pos);
+        }
+    }
+    buffer[pos] = '\0';
+    fs_create("/proc/stacks", buffer, pos);
+    
+    kfree(buffer);
 }
 
 /** sysfiles_populate_dev */
@@ -249,6 +384,31 @@ void sysfiles_update_proc(void)
     sysfiles_populate_proc();
 }
 
+/** sysfiles_refresh_thread:
+ *  Keeps /proc current in the background
+ */
+static void sysfiles_refresh_thread(void *arg)
+{
+    (void)arg;
+    
+    while (1) {
+        timer_sleep(SYSFILES_REFRESH_MS);
+        sysfiles_update_proc();
+    }
+}
+
+/** sysfiles_start_refresh */
+int sysfiles_start_refresh(void)
+{
+    struct thread *t = thread_create("procfs", sysfiles_refresh_thread, 0,
+                                     THREAD_PRIO_LOW, KSTACK_SIZE);
+    
+    if (!t) {
+        return -1;
+    }
+    return 0;
+}
+
 /** sysfiles_init */
 void sysfiles_init(void)
 {
@@ -22,6 +22,14 @@ void sysfiles_init(void);
  */
 void sysfiles_update_proc(void);
 
+/** sysfiles_start_refresh:
+ *  Start the "procfs" thread, which calls sysfiles_update_proc every
+ *  second. Needs thread_init and the timer.
+ *
+ *  @return 0 on success, -1 if the thread couldn't be created
+ */
+int sysfiles_start_refresh(void);
+
 /** sysfiles_populate_etc:
  *  Create all /etc configuration files
  *  - os-release (OS information)
@@ -35,7 +43,11 @@ void sysfiles_populate_etc(void);
  *  Create all /proc files (dynamic system info)
  *  - cpuinfo (CPU information)
  *  - meminfo (memory information)
+ *  - interrupts (per-vector call counts and handler cycles)
+ *  - softirqs (deferred handler run counts)
  *  - uptime (system uptime)
+ *  - slabinfo (slab cache utilisation)
+ *  - stacks (kernel stack high-water marks)
  *  - version (kernel version)
  */
 void sysfiles_populate_proc(void);
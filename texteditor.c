@@ -1,8 +1,11 @@
 #include "texteditor.h"
 #include "fb.h"
-#include "keyboard.h"
+#include "input.h"
 #include "serial.h"
 #include "filesystem.h"
+#include "memory.h"
+#include "kstring.h"
+#include "paging.h"
 
 #define MAX_LINES 15
 #define MAX_LINE_LENGTH 75
@@ -18,18 +21,20 @@ static int modified = 0;
 /** clear_buffer */
 static void clear_buffer(void)
 {
-    int i, j;
-    for (i = 0; i < MAX_LINES; i++) {
-        for (j = 0; j < MAX_LINE_LENGTH; j++) {
-            text_buffer[i][j] = '\0';
-        }
-    }
+    memset(text_buffer, 0, sizeof(text_buffer));
     current_line = 0;
     current_col = 0;
     num_lines = 1;
     modified = 0;
 }
 
+/* Screen layout */
+#define FILE_ROW        3
+#define TEXT_ROW        5
+#define TEXT_ROWS       13
+#define STATUS_ROW      21
+#define TEXT_COL        5   /* After the "NN | " line number */
+
 /** draw_line_num */
 static void draw_line_num(int line_num)
 {
@@ -43,71 +48,100 @@ static void draw_line_num(int line_num)
     fb_puts(" | ");
 }
 
+/** draw_number - Two digit number without padding */
+static void draw_number(int num)
+{
+    if (num < 10) {
+        fb_putc('0' + num);
+    } else {
+        fb_putc('0' + (num / 10));
+        fb_putc('0' + (num % 10));
+    }
+}
+
+/** draw_file_name - Redraw the file name row */
+static void draw_file_name(void)
+{
+    fb_goto(0, FILE_ROW);
+    fb_puts("File: ");
+    if (current_filename[0] != '\0') {
+        fb_puts(current_filename);
+    } else {
+        fb_puts("<new file>");
+    }
+    if (modified) {
+        fb_set_color(FB_LIGHT_BROWN, FB_BLACK);
+        fb_puts(" [Modified]");
+        fb_puts("\033[0m");
+    }
+    fb_puts("\033[K");
+}
+
+/** draw_text_line - Redraw one row of the text area */
+static void draw_text_line(int i)
+{
+    fb_goto(0, TEXT_ROW + i);
+    draw_line_num(i + 1);
+    if (i < num_lines) {
+        fb_puts(text_buffer[i]);
+    }
+    fb_puts("\033[K");
+}
+
+/** draw_status - Redraw the cursor position and park the cursor */
+static void draw_status(void)
+{
+    fb_goto(0, STATUS_ROW);
+    fb_puts("Line: ");
+    draw_number(current_line + 1);
+    fb_puts("/");
+    draw_number(num_lines);
+    fb_puts("  Col: ");
+    draw_number(current_col + 1);
+    fb_puts("\033[K");
+    
+    /* Leave the hardware cursor where the next character goes */
+    fb_goto(TEXT_COL + current_col, TEXT_ROW + current_line);
+}
+
+/** redraw_current_line - Update after an edit within one line */
+static void redraw_current_line(void)
+{
+    draw_file_name();
+    draw_text_line(current_line);
+    draw_status();
+}
+
 /** draw_editor */
 static void draw_editor(void)
 {
     fb_clear();
     
     /* Title */
+    fb_set_color(FB_LIGHT_CYAN, FB_BLACK);
     fb_puts("================================================================\n");
     fb_puts("              TextEditor v1.0 - polyfdOS\n");
     fb_puts("================================================================\n");
+    fb_puts("\033[0m");
     
-    if (current_filename[0] != '\0') {
-        fb_puts("File: ");
-        fb_puts(current_filename);
-        if (modified) fb_puts(" [Modified]");
-        fb_puts("\n");
-    } else {
-        fb_puts("File: <new file>");
-        if (modified) fb_puts(" [Modified]");
-        fb_puts("\n");
-    }
+    draw_file_name();
     
+    fb_goto(0, FILE_ROW + 1);
     fb_puts("----------------------------------------------------------------\n");
     
     /* Display text buffer */
     int i;
-    for (i = 0; i < 13; i++) {
-        draw_line_num(i + 1);
-        if (i < num_lines) {
-            fb_puts(text_buffer[i]);
-        }
-        fb_puts("\n");
+    for (i = 0; i < TEXT_ROWS; i++) {
+        draw_text_line(i);
     }
     
     /* Status bar */
+    fb_goto(0, TEXT_ROW + TEXT_ROWS);
     fb_puts("----------------------------------------------------------------\n");
     fb_puts("ESC/X=Exit Enter=NewLine Backspace=Delete 'r'=Remove line\n");
     fb_puts("'n'=New line 's'=Save 'c'=Clear all\n");
-    fb_puts("Line: ");
     
-    if (current_line + 1 < 10) {
-        fb_putc('0' + (current_line + 1));
-    } else {
-        fb_putc('0' + ((current_line + 1) / 10));
-        fb_putc('0' + ((current_line + 1) % 10));
-    }
-    
-    fb_puts("/");
-    
-    if (num_lines < 10) {
-        fb_putc('0' + num_lines);
-    } else {
-        fb_putc('0' + (num_lines / 10));
-        fb_putc('0' + (num_lines % 10));
-    }
-    
-    fb_puts("  Col: ");
-    
-    if (current_col + 1 < 10) {
-        fb_putc('0' + (current_col + 1));
-    } else {
-        fb_putc('0' + ((current_col + 1) / 10));
-        fb_putc('0' + ((current_col + 1) % 10));
-    }
-    
-    fb_puts("\n");
+    draw_status();
 }
 
 /** save_file */
@@ -121,7 +155,7 @@ static void save_file(void)
         int i = 0;
         
         while (1) {
-            char c = keyboard_get_char();
+            char c = input_read_blocking();
             if (c != 0) {
                 if (c == '\n') {
                     filename[i] = '\0';
@@ -151,26 +185,45 @@ static void save_file(void)
     fb_puts(current_filename);
     fb_puts("\n\n");
     
-    /* Build file content from text_buffer */
-    char file_content[MAX_FILE_CONTENT];
-    int content_pos = 0;
+    /* Size the file for the lines plus newlines, then write them in
+     * place through a shared mapping
+     */
+    int content_size = 0;
+    int result = -1;
     int i, j;
     
-    for (i = 0; i < num_lines && content_pos < MAX_FILE_CONTENT - 1; i++) {
-        /* Copy line */
-        j = 0;
-        while (text_buffer[i][j] != '\0' && content_pos < MAX_FILE_CONTENT - 1) {
-            file_content[content_pos++] = text_buffer[i][j++];
-        }
-        /* Add newline */
-        if (content_pos < MAX_FILE_CONTENT - 1) {
-            file_content[content_pos++] = '\n';
-        }
+    for (i = 0; i < num_lines; i++) {
+        content_size += strlen(text_buffer[i]) + 1;
+    }
+    if (content_size > MAX_FILE_CONTENT) {
+        content_size = MAX_FILE_CONTENT;
     }
-    file_content[content_pos] = '\0';
     
-    /* Actually save to filesystem */
-    int result = fs_create(current_filename, file_content, content_pos);
+    if (!fs_exists(current_filename)) {
+        fs_create(current_filename, "", 0);
+    }
+    if (fs_truncate(current_filename, content_size) == 0) {
+        char *file_content = fs_mmap(paging_kernel_directory(), 0,
+                                     current_filename, FS_MAP_SHARED);
+        
+        if (file_content) {
+            int content_pos = 0;
+            
+            for (i = 0; i < num_lines && content_pos < content_size; i++) {
+                /* Copy line */
+                j = 0;
+                while (text_buffer[i][j] != '\0' && content_pos < content_size) {
+                    file_content[content_pos++] = text_buffer[i][j++];
+                }
+                /* Add newline */
+                if (content_pos < content_size) {
+                    file_content[content_pos++] = '\n';
+                }
+            }
+            fs_munmap(file_content);
+            result = 0;
+        }
+    }
     
     /* Show content preview */
     for (i = 0; i < num_lines && i < 10; i++) {
@@ -189,7 +242,7 @@ static void save_file(void)
     modified = 0;
     
     /* Wait for key */
-    while (keyboard_get_char() == 0);
+    input_read_blocking();
     
     draw_editor();
 }
@@ -199,24 +252,15 @@ static void delete_line(void)
 {
     if (num_lines <= 1) {
         /* Clear the only line */
-        int i;
-        for (i = 0; i < MAX_LINE_LENGTH; i++) {
-            text_buffer[0][i] = '\0';
-        }
+        memset(text_buffer[0], 0, MAX_LINE_LENGTH);
         current_col = 0;
     } else {
         /* Shift all lines up */
-        int i, j;
-        for (i = current_line; i < num_lines - 1; i++) {
-            for (j = 0; j < MAX_LINE_LENGTH; j++) {
-                text_buffer[i][j] = text_buffer[i + 1][j];
-            }
-        }
+        memmove(text_buffer[current_line], text_buffer[current_line + 1],
+                (num_lines - 1 - current_line) * MAX_LINE_LENGTH);
         
         /* Clear the last line */
-        for (j = 0; j < MAX_LINE_LENGTH; j++) {
-            text_buffer[num_lines - 1][j] = '\0';
-        }
+        memset(text_buffer[num_lines - 1], 0, MAX_LINE_LENGTH);
         
         num_lines--;
         
@@ -239,17 +283,11 @@ static void insert_line(void)
     }
     
     /* Shift all lines down */
-    int i, j;
-    for (i = num_lines; i > current_line + 1; i--) {
-        for (j = 0; j < MAX_LINE_LENGTH; j++) {
-            text_buffer[i][j] = text_buffer[i - 1][j];
-        }
-    }
+    memmove(text_buffer[current_line + 2], text_buffer[current_line + 1],
+            (num_lines - 1 - current_line) * MAX_LINE_LENGTH);
     
     /* Clear the new line */
-    for (j = 0; j < MAX_LINE_LENGTH; j++) {
-        text_buffer[current_line + 1][j] = '\0';
-    }
+    memset(text_buffer[current_line + 1], 0, MAX_LINE_LENGTH);
     
     num_lines++;
     current_line++;
@@ -265,7 +303,7 @@ static void clear_all(void)
     fb_puts("\n\nClear all text? (y/n): ");
     
     while (1) {
-        char c = keyboard_get_char();
+        char c = input_read_blocking();
         if (c == 'y' || c == 'Y') {
             clear_buffer();
             current_filename[0] = '\0';
@@ -296,16 +334,11 @@ static void delete_word(void)
     /* Shift characters left */
     int shift = end - current_col;
     if (shift > 0) {
-        int i;
-        for (i = current_col; i < line_len; i++) {
-            if (i + shift < line_len) {
-                text_buffer[current_line][i] = text_buffer[current_line][i + shift];
-            } else {
-                text_buffer[current_line][i] = '\0';
-            }
-        }
+        char *line = text_buffer[current_line];
+        memmove(line + current_col, line + end, line_len - end);
+        memset(line + line_len - shift, 0, shift);
         modified = 1;
-        draw_editor();
+        redraw_current_line();
     }
 }
 
@@ -338,13 +371,17 @@ void texteditor_open(const char *filename, const char *current_dir)
         }
         current_filename[i] = '\0';
         
-        /* Try to load existing file from filesystem */
-        char file_content[MAX_FILE_CONTENT];
-        int bytes_read = fs_read(current_filename, file_content, MAX_FILE_CONTENT - 1);
+        /* Try to load existing file from filesystem, reading it in place */
+        int bytes_read = fs_get_size(current_filename);
+        char *file_content = 0;
+        
+        if (bytes_read > 0 && !fs_is_directory(current_filename)) {
+            file_content = fs_mmap(paging_kernel_directory(), 0,
+                                   current_filename, FS_MAP_READ);
+        }
         
-        if (bytes_read > 0) {
+        if (file_content) {
             /* File exists! Load its content */
-            file_content[bytes_read] = '\0';
             int line = 0;
             int col = 0;
             
@@ -364,6 +401,7 @@ void texteditor_open(const char *filename, const char *current_dir)
             }
             
             num_lines = line > 0 ? line : 1;
+            fs_munmap(file_content);
         } else {
             /* New file - show sample content */
             char *msg = "Welcome to TextEditor!\nType to edit...\n";
@@ -404,14 +442,14 @@ void texteditor_open(const char *filename, const char *current_dir)
     fb_puts("Press any key to start editing...\n");
     
     /* Wait for key */
-    while (keyboard_get_char() == 0);
+    input_read_blocking();
     
     draw_editor();
     
     /* Editor main loop */
     int running = 1;
     while (running) {
-        char c = keyboard_get_char();
+        char c = input_read_blocking();
         
         if (c != 0) {
             if (c == 27 || c == 'x' || c == 'X') {  /* ESC or X key - Exit */
@@ -423,7 +461,7 @@ void texteditor_open(const char *filename, const char *current_dir)
                     fb_puts("Press any other key to cancel\n");
                     
                     while (1) {
-                        char confirm = keyboard_get_char();
+                        char confirm = input_read_blocking();
                         if (confirm == 's' || confirm == 'S') {
                             save_file();
                             running = 0;
@@ -462,13 +500,16 @@ void texteditor_open(const char *filename, const char *current_dir)
             } else if (c == '\b') {  /* Backspace */
                 if (current_col > 0) {
                     current_col--;
-                    /* Shift characters left */
-                    int i;
-                    for (i = current_col; text_buffer[current_line][i] != '\0'; i++) {
-                        text_buffer[current_line][i] = text_buffer[current_line][i + 1];
+                    /* Shift characters left, with the terminator */
+                    char *line = text_buffer[current_line];
+                    int line_len = current_col + 1;
+                    while (line[line_len] != '\0') {
+                        line_len++;
                     }
+                    memmove(line + current_col, line + current_col + 1,
+                            line_len - current_col);
                     modified = 1;
-                    draw_editor();
+                    redraw_current_line();
                 } else if (current_line > 0) {
                     /* Backspace at start of line */
                     current_line--;
@@ -477,12 +518,11 @@ void texteditor_open(const char *filename, const char *current_dir)
                            current_col < MAX_LINE_LENGTH - 1) {
                         current_col++;
                     }
-                    draw_editor();
+                    draw_status();
                 }
             } else if (c >= 32 && c <= 126) {  /* Printable characters */
                 if (current_col < MAX_LINE_LENGTH - 1) {
                     /* Insert character */
-                    int i;
                     int line_len = 0;
                     while (text_buffer[current_line][line_len] != '\0' && 
                            line_len < MAX_LINE_LENGTH - 1) {
@@ -491,14 +531,14 @@ void texteditor_open(const char *filename, const char *current_dir)
                     
                     /* Shift characters right */
                     if (line_len < MAX_LINE_LENGTH - 1) {
-                        for (i = line_len; i > current_col; i--) {
-                            text_buffer[current_line][i] = text_buffer[current_line][i - 1];
-                        }
+                        memmove(&text_buffer[current_line][current_col + 1],
+                                &text_buffer[current_line][current_col],
+                                line_len - current_col);
                         text_buffer[current_line][current_col] = c;
                         text_buffer[current_line][line_len + 1] = '\0';
                         current_col++;
                         modified = 1;
-                        draw_editor();
+                        redraw_current_line();
                     }
                 }
             }
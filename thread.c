@@ -0,0 +1,954 @@
+/**
+ * thread.c - Kernel threads and the preemptive priority scheduler
+ *
+ * Each thread has its own guarded stack from kstack_create. There is a
+ * FIFO run queue per priority, shared by all processors; a processor
+ * takes the first thread of the highest non-empty one that its affinity
+ * mask allows, and thread_switch (thread_asm.s) swaps the stacks. The
+ * x87/SSE state is saved and restored on every switch, since memcpy may
+ * use SSE.
+ *
+ * Threads switch when they yield, block or exit, and are preempted when
+ * their time slice ends while an equal or higher priority thread is
+ * ready, or at once when a higher priority one wakes. Preemption only
+ * sets need_resched of the processor (struct cpu, smp.h); the switch
+ * happens in thread_preempt, which the interrupt stub calls once it is
+ * back on the interrupted thread's stack, never on the interrupt stack.
+ * preempt_disable holds it off around code that isn't safe to
+ * interleave. A thread made ready goes to an idle processor first,
+ * which is woken with a reschedule IPI.
+ *
+ * sched_lock guards the queues and thread states. It is held across
+ * thread_switch and released by the thread switched to, so no other
+ * processor can pick up the previous thread before its stack is free.
+ *
+ * Blocking is tied to wait queues: a thread in wait_sleep blocks on the
+ * queue's list of waiters, and wake_up makes those threads ready to
+ * check their condition again. Timed waits are also on the timed list,
+ * which the timer softirq checks for passed deadlines. Every processor
+ * has an idle thread that runs when nothing else is ready: it frees
+ * exited threads and halts.
+ */
+
+#include "thread.h"
+#include "hardware.h"
+#include "slab.h"
+#include "softirq.h"
+#include "memory.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "waitqueue.h"
+#include "timer.h"
+
+/* Interrupts disabled, for new threads; thread_start enables them */
+#define THREAD_INITIAL_EFLAGS   0x002
+
+#define EFLAGS_IF               0x200
+
+/* From thread_asm.s */
+void thread_switch(unsigned int *save_esp, unsigned int load_esp);
+void thread_fpu_save(void *area, unsigned int fxsr);
+void thread_fpu_restore(const void *area, unsigned int fxsr);
+
+static struct thread main_thread;
+static struct thread *all_threads = 0;
+
+/* Time slice per priority, in timer ticks: short for interactive
+ * threads, long for batch work so it switches less
+ */
+static const unsigned int slice_ticks[THREAD_PRIORITIES] = { 5, 10, 20 };
+
+static struct spinlock sched_lock;
+static struct thread *run_head[THREAD_PRIORITIES];
+static struct thread *run_tail[THREAD_PRIORITIES];
+static struct thread *timed_list = 0;      /* Blocked with a deadline */
+static struct thread *dead_list = 0;
+
+/* Guards all_threads; see thread_list_lock */
+static struct spinlock list_lock;
+
+static unsigned int next_id = 0;
+
+/* Which FPU state exists; see thread_fpu_save */
+static unsigned int fpu_present = 0;
+static unsigned int fpu_fxsr = 0;
+
+/* Clean FPU state given to new threads */
+static unsigned char fpu_initial[THREAD_FPU_STATE_SIZE] __attribute__((aligned(16)));
+static unsigned char main_fpu_state[THREAD_FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+static struct kmem_cache thread_cache;
+
+/** thread_lock:
+ *  Disables interrupts and takes sched_lock, returning the old EFLAGS
+ */
+static unsigned int thread_lock(void)
+{
+    return spin_lock_irqsave(&sched_lock);
+}
+
+/** thread_unlock:
+ *  Releases sched_lock and restores the EFLAGS saved by thread_lock
+ */
+static void thread_unlock(unsigned int flags)
+{
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+/** irq_save:
+ *  Disables interrupts, returning the old EFLAGS, so the caller stays on
+ *  its processor
+ */
+static unsigned int irq_save(void)
+{
+    unsigned int flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/** irq_restore:
+ *  Restores the EFLAGS saved by irq_save
+ */
+static void irq_restore(unsigned int flags)
+{
+    __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+/** thread_check_preemptible:
+ *  Stops the kernel if the current thread is about to give up the
+ *  processor with preemption disabled. It would stay disabled for as
+ *  long as the thread is switched out. ud2 raises an invalid opcode
+ *  exception, whose report shows the caller in the backtrace.
+ */
+static void thread_check_preemptible(void)
+{
+    unsigned int flags = irq_save();
+    struct thread *self = cpu_self()->current;
+
+    if (self && self->preempt_count) {
+        __asm__ volatile("ud2");
+    }
+    irq_restore(flags);
+}
+
+/** thread_allowed:
+ *  Checks whether a thread may run on a processor
+ */
+static int thread_allowed(const struct thread *thread, const struct cpu *cpu)
+{
+    return (thread->cpu_mask >> cpu->id) & 1;
+}
+
+/** cpu_resched:
+ *  Asks a processor to switch threads, interrupting it if it isn't the
+ *  caller
+ */
+static void cpu_resched(struct cpu *cpu)
+{
+    cpu->need_resched = 1;
+    if (cpu != cpu_self()) {
+        smp_send_reschedule(cpu);
+    }
+}
+
+/** run_queue_append:
+ *  Appends a thread to the run queue of its priority
+ */
+static void run_queue_append(struct thread *thread)
+{
+    int prio = thread->priority;
+
+    thread->state = THREAD_READY;
+    thread->next = 0;
+    if (run_tail[prio]) {
+        run_tail[prio]->next = thread;
+    } else {
+        run_head[prio] = thread;
+    }
+    run_tail[prio] = thread;
+}
+
+/** run_queue_kick:
+ *  Finds a processor for a thread that just became ready: an idle one
+ *  if possible, else one running a lower priority thread
+ */
+static void run_queue_kick(struct thread *thread)
+{
+    unsigned int i;
+
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        struct cpu *cpu = &cpus[i];
+
+        if (cpu->online && cpu->current == cpu->idle && !cpu->need_resched &&
+            thread_allowed(thread, cpu)) {
+            cpu_resched(cpu);
+            return;
+        }
+    }
+
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        struct cpu *cpu = &cpus[i];
+
+        if (cpu->online && cpu->current && thread_allowed(thread, cpu) &&
+            thread->priority < cpu->current->priority) {
+            cpu_resched(cpu);
+            return;
+        }
+    }
+}
+
+/** run_queue_add:
+ *  Makes a thread ready and finds it a processor
+ */
+static void run_queue_add(struct thread *thread)
+{
+    run_queue_append(thread);
+    run_queue_kick(thread);
+}
+
+/** run_queue_first:
+ *  Gets the highest priority with a thread ready to run on a processor
+ *
+ *  @return The priority, or -1 if none is ready
+ */
+static int run_queue_first(const struct cpu *cpu)
+{
+    int prio;
+
+    for (prio = 0; prio < THREAD_PRIORITIES; prio++) {
+        struct thread *t;
+
+        for (t = run_head[prio]; t; t = t->next) {
+            if (thread_allowed(t, cpu)) {
+                return prio;
+            }
+        }
+    }
+    return -1;
+}
+
+/** run_queue_remove:
+ *  Unlinks a ready thread from its run queue
+ */
+static void run_queue_remove(struct thread *thread)
+{
+    int prio = thread->priority;
+    struct thread **link;
+    struct thread *prev = 0;
+
+    for (link = &run_head[prio]; *link != thread; link = &(*link)->next) {
+        prev = *link;
+    }
+    *link = thread->next;
+    if (run_tail[prio] == thread) {
+        run_tail[prio] = prev;
+    }
+    thread->next = 0;
+}
+
+/** run_queue_take:
+ *  Removes the first thread of the highest priority that may run on a
+ *  processor
+ *
+ *  @return The thread, or 0 if none is ready
+ */
+static struct thread *run_queue_take(const struct cpu *cpu)
+{
+    int prio;
+
+    for (prio = 0; prio < THREAD_PRIORITIES; prio++) {
+        struct thread *t;
+
+        for (t = run_head[prio]; t; t = t->next) {
+            if (thread_allowed(t, cpu)) {
+                run_queue_remove(t);
+                return t;
+            }
+        }
+    }
+    return 0;
+}
+
+/** thread_reap:
+ *  Frees the threads that exited. Runs in the idle threads, unlocked,
+ *  since freeing a stack flushes the other processors' TLBs. Skipped
+ *  while thread_list_lock is held.
+ */
+static void thread_reap(void)
+{
+    unsigned int flags;
+    struct thread *dead;
+
+    if (!dead_list) {
+        return;
+    }
+    preempt_disable();
+    if (!spin_trylock(&list_lock)) {
+        preempt_enable();
+        return;
+    }
+
+    flags = thread_lock();
+    dead = dead_list;
+    dead_list = 0;
+    thread_unlock(flags);
+
+    while (dead) {
+        struct thread *thread = dead;
+        struct thread **all;
+
+        dead = thread->next;
+        for (all = &all_threads; *all; all = &(*all)->all_next) {
+            if (*all == thread) {
+                *all = thread->all_next;
+                break;
+            }
+        }
+        kstack_destroy(thread->stack);
+        kfree(thread->fpu_state);
+        kmem_cache_free(&thread_cache, thread);
+    }
+    thread_list_unlock();
+}
+
+/** thread_schedule:
+ *  Switches to the next thread that may run on this processor, putting
+ *  the current one back on the run queue if it is still running, or to
+ *  the idle thread when none is ready. Called with interrupts disabled
+ *  and sched_lock held; returns, possibly much later, the same way.
+ */
+static void thread_schedule(void)
+{
+    struct cpu *cpu = cpu_self();
+    struct thread *prev = cpu->current;
+    struct thread *next;
+
+    if (prev->state == THREAD_RUNNING && prev != cpu->idle) {
+        run_queue_append(prev);
+        if (!thread_allowed(prev, cpu)) {
+            run_queue_kick(prev);
+        }
+    }
+
+    cpu->need_resched = 0;
+    next = run_queue_take(cpu);
+    if (!next) {
+        next = cpu->idle;
+    }
+    if (prev == cpu->idle && next != prev) {
+        prev->state = THREAD_READY;
+    }
+    next->state = THREAD_RUNNING;
+    next->cpu = cpu->id;
+    next->slice = slice_ticks[next->priority];
+    if (next == prev) {
+        return;
+    }
+    next->switches++;
+
+    if (fpu_present) {
+        thread_fpu_save(prev->fpu_state, fpu_fxsr);
+        thread_fpu_restore(next->fpu_state, fpu_fxsr);
+    }
+
+    cpu->current = next;
+    thread_switch(&prev->esp, next->esp);
+}
+
+/** thread_start:
+ *  First code of a new thread, reached by thread_switch's ret. Releases
+ *  the sched_lock the previous thread switched with.
+ */
+static void thread_start(void)
+{
+    struct thread *self = cpu_self()->current;
+
+    spin_unlock(&sched_lock);
+    __asm__ volatile("sti");
+    self->entry(self->arg);
+    thread_exit();
+}
+
+/** thread_alloc:
+ *  Allocates a thread and its stack and builds the frame thread_switch
+ *  pops to start it. Doesn't make it ready.
+ */
+static struct thread *thread_alloc(const char *name, void (*entry)(void *arg), void *arg,
+                                   int priority, unsigned int stack_size)
+{
+    struct thread *thread;
+    unsigned int *sp;
+
+    thread = kmem_cache_alloc(&thread_cache);
+    if (!thread) {
+        return 0;
+    }
+
+    /* kmalloc-512 objects are 16-byte aligned, as fxsave needs */
+    thread->fpu_state = kmalloc(THREAD_FPU_STATE_SIZE);
+    thread->stack = kstack_create(name, stack_size);
+    if (!thread->fpu_state || !thread->stack) {
+        kfree(thread->fpu_state);
+        if (thread->stack) {
+            kstack_destroy(thread->stack);
+        }
+        kmem_cache_free(&thread_cache, thread);
+        return 0;
+    }
+    memcpy(thread->fpu_state, fpu_initial, THREAD_FPU_STATE_SIZE);
+
+    /* The frame thread_switch pops, returning into thread_start */
+    sp = (unsigned int *)kstack_top(thread->stack);
+    *--sp = 0;                          /* thread_start's return address */
+    *--sp = (unsigned int)thread_start;
+    *--sp = 0;                          /* ebp, ends the backtrace */
+    *--sp = 0;                          /* ebx */
+    *--sp = 0;                          /* esi */
+    *--sp = 0;                          /* edi */
+    *--sp = THREAD_INITIAL_EFLAGS;
+
+    thread->esp = (unsigned int)sp;
+    thread->name = name;
+    thread->state = THREAD_READY;
+    thread->priority = priority;
+    thread->slice = 0;
+    thread->cpu_ticks = 0;
+    thread->switches = 0;
+    thread->cpu_mask = THREAD_CPUS_ALL;
+    thread->cpu = 0;
+    thread->wake_pending = 0;
+    thread->preempt_count = 0;
+    thread->wait = 0;
+    thread->timed = 0;
+    thread->timed_next = 0;
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->next = 0;
+    return thread;
+}
+
+/** thread_register:
+ *  Gives a thread its ID and adds it to the list of all threads
+ */
+static void thread_register(struct thread *thread)
+{
+    unsigned int flags;
+
+    thread_list_lock();
+    flags = thread_lock();
+    thread->id = next_id++;
+    thread->all_next = all_threads;
+    all_threads = thread;
+    thread_unlock(flags);
+    thread_list_unlock();
+}
+
+/** idle_thread:
+ *  The boot processor's idle thread
+ */
+static void idle_thread(void *arg)
+{
+    (void)arg;
+    thread_idle();
+}
+
+/** thread_init */
+void thread_init(void)
+{
+    struct cpu *cpu = cpu_self();
+    unsigned int esp;
+    unsigned int fpu = hw_fpu_enabled();
+
+    kmem_cache_init(&thread_cache, "thread", sizeof(struct thread));
+
+    fpu_present = fpu & HW_FPU_X87;
+    fpu_fxsr = fpu & HW_FPU_SSE;
+    if (fpu_present) {
+        /* fnsave resets the FPU, so restore what was saved */
+        thread_fpu_save(fpu_initial, fpu_fxsr);
+        thread_fpu_restore(fpu_initial, fpu_fxsr);
+    }
+
+    __asm__ volatile("mov %%esp, %0" : "=r"(esp));
+    main_thread.name = "main";
+    main_thread.state = THREAD_RUNNING;
+    main_thread.priority = THREAD_PRIO_NORMAL;
+    main_thread.slice = slice_ticks[THREAD_PRIO_NORMAL];
+    main_thread.cpu_mask = THREAD_CPUS_ALL;
+    main_thread.cpu = cpu->id;
+    main_thread.stack = (struct kstack *)kstack_find(esp);
+    main_thread.fpu_state = main_fpu_state;
+    thread_register(&main_thread);
+
+    /* Never queued: thread_schedule falls back to it */
+    cpu->idle = thread_alloc("idle0", idle_thread, 0, THREAD_PRIO_LOW, KSTACK_SIZE);
+    if (cpu->idle) {
+        cpu->idle->cpu_mask = 1u << cpu->id;
+        thread_register(cpu->idle);
+    }
+
+    cpu->current = &main_thread;
+    cpu->online = 1;
+}
+
+/** thread_init_cpu */
+void thread_init_cpu(const char *name)
+{
+    struct cpu *cpu = cpu_self();
+    struct thread *idle;
+    unsigned int esp;
+
+    idle = kmem_cache_alloc(&thread_cache);
+    if (!idle) {
+        return;
+    }
+    idle->fpu_state = kmalloc(THREAD_FPU_STATE_SIZE);
+    if (!idle->fpu_state) {
+        kmem_cache_free(&thread_cache, idle);
+        return;
+    }
+
+    __asm__ volatile("mov %%esp, %0" : "=r"(esp));
+    idle->name = name;
+    idle->state = THREAD_RUNNING;
+    idle->priority = THREAD_PRIO_LOW;
+    idle->slice = 0;
+    idle->cpu_ticks = 0;
+    idle->switches = 0;
+    idle->cpu_mask = 1u << cpu->id;
+    idle->cpu = cpu->id;
+    idle->wake_pending = 0;
+    idle->preempt_count = 0;
+    idle->wait = 0;
+    idle->timed = 0;
+    idle->timed_next = 0;
+    idle->stack = (struct kstack *)kstack_find(esp);
+    idle->entry = 0;
+    idle->arg = 0;
+    idle->next = 0;
+    thread_register(idle);
+
+    cpu->idle = idle;
+    cpu->current = idle;
+}
+
+/** thread_idle */
+void thread_idle(void)
+{
+    struct cpu *cpu = cpu_self();
+
+    while (1) {
+        thread_reap();
+        softirq_run();
+
+        /* Check for work and halt with interrupts off, so a reschedule
+         * IPI arriving in between still ends the hlt
+         */
+        __asm__ volatile("cli" : : : "memory");
+        spin_lock(&sched_lock);
+        if (run_queue_first(cpu) >= 0) {
+            thread_schedule();
+            spin_unlock(&sched_lock);
+            __asm__ volatile("sti" : : : "memory");
+            continue;
+        }
+        cpu->need_resched = 0;
+        spin_unlock(&sched_lock);
+        __asm__ volatile("sti; hlt" : : : "memory");
+    }
+}
+
+/** thread_create */
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg,
+                             int priority, unsigned int stack_size)
+{
+    struct thread *thread;
+    unsigned int flags;
+
+    if (priority < 0 || priority >= THREAD_PRIORITIES) {
+        return 0;
+    }
+    thread_reap();
+    thread = thread_alloc(name, entry, arg, priority, stack_size);
+    if (!thread) {
+        return 0;
+    }
+
+    thread_register(thread);
+    flags = thread_lock();
+    run_queue_add(thread);
+    thread_unlock(flags);
+
+    return thread;
+}
+
+/** thread_current */
+struct thread *thread_current(void)
+{
+    unsigned int flags = irq_save();
+    struct thread *thread = cpu_self()->current;
+
+    irq_restore(flags);
+    return thread;
+}
+
+/** thread_yield */
+void thread_yield(void)
+{
+    unsigned int flags;
+    struct cpu *cpu;
+
+    thread_check_preemptible();
+    flags = thread_lock();
+    cpu = cpu_self();
+
+    if (cpu->current && !cpu->irq_nesting) {
+        thread_schedule();
+    }
+    thread_unlock(flags);
+}
+
+/** thread_set_priority */
+void thread_set_priority(struct thread *thread, int priority)
+{
+    unsigned int flags = thread_lock();
+    struct cpu *cpu = cpu_self();
+
+    if (priority < 0 || priority >= THREAD_PRIORITIES) {
+        thread_unlock(flags);
+        return;
+    }
+
+    /* A ready thread moves to the queue of its new priority */
+    if (thread->state == THREAD_READY && thread != cpus[thread->cpu].idle) {
+        run_queue_remove(thread);
+        thread->priority = priority;
+        run_queue_add(thread);
+    } else {
+        thread->priority = priority;
+        if (thread == cpu->current) {
+            int first = run_queue_first(cpu);
+
+            if (first >= 0 && first < priority) {
+                cpu->need_resched = 1;
+            }
+        }
+    }
+    thread_unlock(flags);
+}
+
+/** thread_set_affinity */
+void thread_set_affinity(struct thread *thread, unsigned int mask)
+{
+    unsigned int flags = thread_lock();
+    unsigned int online = 0;
+    unsigned int i;
+
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        if (cpus[i].online) {
+            online |= 1u << i;
+        }
+    }
+    if ((mask & online) == 0) {
+        thread_unlock(flags);
+        return;
+    }
+    thread->cpu_mask = mask;
+
+    /* Move it off a processor it may no longer use */
+    if (thread->state == THREAD_RUNNING && !thread_allowed(thread, &cpus[thread->cpu])) {
+        cpu_resched(&cpus[thread->cpu]);
+    } else if (thread->state == THREAD_READY && thread != cpus[thread->cpu].idle) {
+        run_queue_kick(thread);
+    }
+    thread_unlock(flags);
+}
+
+/** thread_prepare_block */
+void thread_prepare_block(struct wait_queue *wq)
+{
+    struct thread *self = cpu_self()->current;
+
+    if (!self) {
+        return;
+    }
+
+    /* Locked, so a waker on another processor sees this before the
+     * caller reads its condition
+     */
+    spin_lock(&sched_lock);
+    self->wait = wq;
+    self->wake_pending = 0;
+    spin_unlock(&sched_lock);
+}
+
+/** thread_block_common:
+ *  Blocks the current thread on a wait queue and, if timed, on the timed
+ *  list, unless it was woken since thread_prepare_block
+ */
+static void thread_block_common(struct wait_queue *wq, int timed, unsigned int deadline)
+{
+    struct thread *self;
+    struct thread **link;
+
+    thread_check_preemptible();
+    spin_lock(&sched_lock);
+    self = cpu_self()->current;
+
+    /* A wake up since thread_prepare_block must not be missed. The
+     * timer softirq checks deadlines under sched_lock after counting
+     * the tick, so a deadline not passed here is still seen there.
+     */
+    if (self->wake_pending || (timed && (int)(deadline - timer_get_ticks()) <= 0)) {
+        self->wake_pending = 0;
+    } else {
+        self->state = THREAD_BLOCKED;
+        self->wait = wq;
+        self->next = 0;
+        link = &wq->waiters;
+        while (*link) {
+            link = &(*link)->next;
+        }
+        *link = self;
+        if (timed) {
+            self->timed = 1;
+            self->deadline = deadline;
+            self->timed_next = timed_list;
+            timed_list = self;
+        }
+        thread_schedule();
+    }
+    spin_unlock(&sched_lock);
+}
+
+/** thread_block */
+void thread_block(struct wait_queue *wq)
+{
+    thread_block_common(wq, 0, 0);
+}
+
+/** thread_block_until */
+void thread_block_until(struct wait_queue *wq, unsigned int deadline)
+{
+    thread_block_common(wq, 1, deadline);
+}
+
+/** thread_finish_block */
+void thread_finish_block(void)
+{
+    struct thread *self = cpu_self()->current;
+
+    if (self) {
+        self->wait = 0;
+    }
+}
+
+/** thread_unblock:
+ *  Takes a blocked thread off its wait queue and the timed list and
+ *  makes it ready. Called with sched_lock held.
+ */
+static void thread_unblock(struct thread *thread)
+{
+    struct thread **link;
+
+    for (link = &thread->wait->waiters; *link; link = &(*link)->next) {
+        if (*link == thread) {
+            *link = thread->next;
+            break;
+        }
+    }
+    if (thread->timed) {
+        for (link = &timed_list; *link; link = &(*link)->timed_next) {
+            if (*link == thread) {
+                *link = thread->timed_next;
+                break;
+            }
+        }
+        thread->timed = 0;
+    }
+    run_queue_add(thread);
+}
+
+/** thread_wake */
+void thread_wake(struct thread *thread)
+{
+    unsigned int flags = thread_lock();
+
+    if (thread->state == THREAD_BLOCKED) {
+        thread_unblock(thread);
+    } else if (thread->state == THREAD_RUNNING) {
+        thread->wake_pending = 1;
+    }
+    thread_unlock(flags);
+}
+
+/** thread_wake_queue */
+void thread_wake_queue(struct wait_queue *wq)
+{
+    unsigned int flags = thread_lock();
+    unsigned int i;
+
+    while (wq->waiters) {
+        thread_unblock(wq->waiters);
+    }
+
+    /* Waiters on other processors may be between checking their
+     * condition and blocking
+     */
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        struct thread *current = cpus[i].current;
+
+        if (cpus[i].online && current && current->wait == wq) {
+            current->wake_pending = 1;
+        }
+    }
+    thread_unlock(flags);
+}
+
+/** thread_wake_timeouts */
+void thread_wake_timeouts(unsigned int now)
+{
+    unsigned int flags;
+    struct thread **link;
+
+    if (!timed_list) {
+        return;
+    }
+
+    flags = thread_lock();
+    link = &timed_list;
+    while (*link) {
+        struct thread *thread = *link;
+
+        if ((int)(now - thread->deadline) >= 0) {
+            thread_unblock(thread);     /* Unlinks it from *link */
+        } else {
+            link = &thread->timed_next;
+        }
+    }
+    thread_unlock(flags);
+}
+
+/** thread_exit */
+void thread_exit(void)
+{
+    struct thread *self;
+
+    thread_lock();
+    self = cpu_self()->current;
+    self->state = THREAD_DEAD;
+    self->next = dead_list;
+    dead_list = self;
+    thread_schedule();
+
+    /* Never scheduled again */
+    while (1) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+/** thread_tick */
+void thread_tick(void)
+{
+    struct cpu *cpu = cpu_self();
+    struct thread *current = cpu->current;
+    int first;
+
+    if (!current) {
+        return;
+    }
+
+    current->cpu_ticks++;
+    if (current == cpu->idle) {
+        return;
+    }
+    if (current->slice > 0) {
+        current->slice--;
+    }
+
+    /* Round robin within a priority; lower ones wait for an idle moment */
+    if (current->slice == 0) {
+        spin_lock(&sched_lock);
+        first = run_queue_first(cpu);
+        if (first >= 0 && first <= current->priority) {
+            cpu->need_resched = 1;
+        }
+        spin_unlock(&sched_lock);
+    }
+}
+
+/** thread_preempt */
+void thread_preempt(void)
+{
+    struct cpu *cpu = cpu_self();
+
+    if (!cpu->current || cpu->current->preempt_count || !cpu->need_resched) {
+        return;
+    }
+    spin_lock(&sched_lock);
+    thread_schedule();
+    spin_unlock(&sched_lock);
+}
+
+/** preempt_disable */
+void preempt_disable(void)
+{
+    unsigned int flags = irq_save();
+    struct thread *self = cpu_self()->current;
+
+    if (self) {
+        self->preempt_count++;
+    }
+    irq_restore(flags);
+}
+
+/** preempt_enable */
+void preempt_enable(void)
+{
+    unsigned int flags = irq_save();
+    struct cpu *cpu = cpu_self();
+
+    if (!cpu->current) {
+        irq_restore(flags);
+        return;
+    }
+    cpu->current->preempt_count--;
+    if ((flags & EFLAGS_IF) && !cpu->irq_nesting) {
+        thread_preempt();
+    }
+    irq_restore(flags);
+}
+
+/** thread_get_idle_ticks */
+unsigned int thread_get_idle_ticks(void)
+{
+    unsigned int ticks = 0;
+    unsigned int i;
+
+    for (i = 0; i < SMP_MAX_CPUS; i++) {
+        if (cpus[i].online && cpus[i].idle) {
+            ticks += cpus[i].idle->cpu_ticks;
+        }
+    }
+    return ticks;
+}
+
+/** thread_list_lock */
+void thread_list_lock(void)
+{
+    preempt_disable();
+    spin_lock(&list_lock);
+}
+
+/** thread_list_unlock */
+void thread_list_unlock(void)
+{
+    spin_unlock(&list_lock);
+    preempt_enable();
+}
+
+/** thread_list */
+const struct thread *thread_list(void)
+{
+    return all_threads;
+}
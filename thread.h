@@ -0,0 +1,239 @@
+#ifndef INCLUDE_THREAD_H
+#define INCLUDE_THREAD_H
+
+#include "kstack.h"
+
+/* Thread states */
+#define THREAD_RUNNING  0   /* On the CPU */
+#define THREAD_READY    1   /* On the run queue */
+#define THREAD_BLOCKED  2   /* Waiting for a wake up */
+#define THREAD_DEAD     3   /* Exited, stack not yet freed */
+
+/* Priorities, highest first. A ready thread always runs before any
+ * thread of a lower priority; equal ones take turns by time slice.
+ */
+#define THREAD_PRIO_HIGH    0   /* Interactive: the shell, input */
+#define THREAD_PRIO_NORMAL  1
+#define THREAD_PRIO_LOW     2   /* Batch and background work */
+#define THREAD_PRIORITIES   3
+
+/* Size of the saved x87/SSE state (fxsave; fnsave needs 108 bytes) */
+#define THREAD_FPU_STATE_SIZE   512
+
+/* cpu_mask of a thread that may run on any processor */
+#define THREAD_CPUS_ALL     0xFFFFFFFF
+
+struct wait_queue;
+
+/** A kernel thread */
+struct thread {
+    unsigned int esp;           /* Saved stack pointer while switched out */
+    unsigned int id;
+    const char *name;
+    int state;
+    int priority;               /* THREAD_PRIO_* */
+    unsigned int slice;         /* Timer ticks left before preemption */
+    unsigned int cpu_ticks;     /* Timer ticks spent running */
+    unsigned int switches;      /* Times switched to */
+    unsigned int cpu_mask;      /* Processors it may run on, bit per cpus[] index */
+    unsigned int cpu;           /* Processor it runs or last ran on */
+    unsigned int preempt_count; /* See preempt_disable; moves with the thread */
+    volatile unsigned int wake_pending; /* Woken while running; see thread_block */
+    struct wait_queue *wait;    /* Queue waited on, from wait_begin to wait_end */
+    unsigned int deadline;      /* Timer tick a timed block ends at */
+    int timed;                  /* Blocked with a deadline, on the timed list */
+    struct thread *timed_next;  /* Timed list */
+    struct kstack *stack;
+    void *fpu_state;            /* THREAD_FPU_STATE_SIZE, 16-byte aligned */
+    void (*entry)(void *arg);
+    void *arg;
+    struct thread *next;        /* Run queue, waiters of a wait queue or dead list */
+    struct thread *all_next;    /* Every thread, for thread_list */
+};
+
+/** thread_init:
+ *  Turns the running flow of control into the "main" thread and creates
+ *  the boot processor's idle thread. Needs kstack_init, hw_init_fpu and
+ *  gdt_install first.
+ */
+void thread_init(void);
+
+/** thread_init_cpu:
+ *  Turns the running flow of control of an application processor into
+ *  its idle thread. thread_idle follows.
+ *
+ *  @param name  The name of the idle thread
+ */
+void thread_init_cpu(const char *name);
+
+/** thread_idle:
+ *  The idle loop: runs whatever becomes ready on this processor, frees
+ *  exited threads and halts in between. Never returns.
+ */
+void thread_idle(void) __attribute__((noreturn));
+
+/** thread_create:
+ *  Creates a thread on its own guarded stack, allowed on every
+ *  processor, and puts it on the run queue
+ *
+ *  @param name        The name, also used for its stack in /proc/stacks
+ *  @param entry       The function to run; returning from it exits the thread
+ *  @param arg         Passed to entry
+ *  @param priority    A THREAD_PRIO_* value, in effect from its first run
+ *  @param stack_size  Its stack size, rounded up to pages; KSTACK_SIZE
+ *                     unless the thread is known to need more or less
+ *  @return            The thread, or 0 if memory is exhausted or the
+ *                     priority is invalid
+ */
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg,
+                             int priority, unsigned int stack_size);
+
+/** thread_current:
+ *  Gets the running thread
+ *
+ *  @return The thread, or 0 before thread_init
+ */
+struct thread *thread_current(void);
+
+/** thread_set_priority:
+ *  Changes the priority of a thread
+ *
+ *  @param thread    The thread
+ *  @param priority  A THREAD_PRIO_* value
+ */
+void thread_set_priority(struct thread *thread, int priority);
+
+/** thread_set_affinity:
+ *  Restricts the processors a thread may run on. A running thread moves
+ *  at its next switch.
+ *
+ *  @param thread  The thread
+ *  @param mask    Bit n allows cpus[n]; ignored unless it names a
+ *                 processor that is online
+ */
+void thread_set_affinity(struct thread *thread, unsigned int mask);
+
+/** thread_yield:
+ *  Lets the other ready threads of the same or a higher priority run,
+ *  then continues. Not for interrupt handlers, nor with preemption
+ *  disabled.
+ */
+void thread_yield(void);
+
+/** thread_prepare_block:
+ *  Starts a wait on a queue, before the caller checks its condition: a
+ *  wake up of the queue from then on makes the next thread_block return
+ *  at once, even if it ran on another processor before this thread
+ *  blocked. Call with interrupts disabled.
+ *
+ *  @param wq  The wait queue
+ */
+void thread_prepare_block(struct wait_queue *wq);
+
+/** thread_block:
+ *  Blocks the current thread on a wait queue until thread_wake or the
+ *  next wake_up of that queue. Wake ups may be spurious: callers check
+ *  their condition again, as wait_event does. The processor runs its
+ *  idle thread while no thread is ready. Call with interrupts disabled
+ *  and preemption enabled; returns with interrupts disabled.
+ *
+ *  @param wq  The wait queue passed to thread_prepare_block
+ */
+void thread_block(struct wait_queue *wq);
+
+/** thread_block_until:
+ *  Like thread_block, but also wakes up once the timer reaches the
+ *  deadline (see thread_wake_timeouts). Returns at once if it passed.
+ *
+ *  @param wq        The wait queue passed to thread_prepare_block
+ *  @param deadline  The timer tick to wake at
+ */
+void thread_block_until(struct wait_queue *wq, unsigned int deadline);
+
+/** thread_finish_block:
+ *  Ends the wait started by thread_prepare_block
+ */
+void thread_finish_block(void);
+
+/** thread_wake:
+ *  Makes a blocked thread ready. Safe from interrupt handlers.
+ *
+ *  @param thread  The thread
+ */
+void thread_wake(struct thread *thread);
+
+/** thread_wake_queue:
+ *  Makes the threads blocked on a wait queue ready; called by wake_up.
+ *  Safe from interrupt handlers.
+ *
+ *  @param wq  The wait queue
+ */
+void thread_wake_queue(struct wait_queue *wq);
+
+/** thread_wake_timeouts:
+ *  Makes the threads whose thread_block_until deadline passed ready.
+ *  Called by the timer softirq.
+ *
+ *  @param now  The current timer tick
+ */
+void thread_wake_timeouts(unsigned int now);
+
+/** thread_exit:
+ *  Ends the current thread. Its stack is freed later by an idle thread.
+ *  Not for the main thread.
+ */
+void thread_exit(void) __attribute__((noreturn));
+
+/** thread_tick:
+ *  Charges the timer tick to the running thread and ends its time slice
+ *  when it runs out. Called from the timer interrupt.
+ */
+void thread_tick(void);
+
+/** thread_preempt:
+ *  Switches threads if need_resched of this processor is set and
+ *  preemption is enabled. Called by the interrupt stub when it returns to a thread,
+ *  with interrupts disabled.
+ */
+void thread_preempt(void);
+
+/** preempt_disable:
+ *  Keeps the current thread on its processor until preempt_enable,
+ *  without disabling interrupts. Calls nest. The count belongs to the
+ *  thread, which must not block or yield until it is back to 0. Other
+ *  processors still run: shared data also needs a spinlock.
+ */
+void preempt_disable(void);
+
+/** preempt_enable:
+ *  Undoes preempt_disable, switching threads if one became due
+ */
+void preempt_enable(void);
+
+/** thread_get_idle_ticks:
+ *  Gets the timer ticks the idle threads of all processors ran
+ *
+ *  @return The tick count
+ */
+unsigned int thread_get_idle_ticks(void);
+
+/** thread_list_lock:
+ *  Keeps threads from being added or freed while walking thread_list.
+ *  Disables preemption; hold it briefly.
+ */
+void thread_list_lock(void);
+
+/** thread_list_unlock:
+ *  Releases thread_list_lock
+ */
+void thread_list_unlock(void);
+
+/** thread_list:
+ *  Gets the first thread; follow ->all_next for the rest. Hold
+ *  thread_list_lock while walking.
+ *
+ *  @return The first thread
+ */
+const struct thread *thread_list(void);
+
+#endif /* INCLUDE_THREAD_H */
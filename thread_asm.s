@@ -0,0 +1,56 @@
+; thread_asm.s - Kernel thread context switch
+; Called from thread.c with interrupts disabled. cdecl.
+
+section .text
+
+; thread_switch: void thread_switch(unsigned int *save_esp, unsigned int load_esp)
+; Pushes the callee-saved registers and EFLAGS, stores ESP in *save_esp,
+; then loads load_esp and pops the same frame from the other stack.
+; Returns in the other thread, from its own call to thread_switch (or
+; into thread_start for a new thread, see thread_create).
+global thread_switch
+thread_switch:
+    mov eax, [esp + 4]          ; save_esp
+    mov edx, [esp + 8]          ; load_esp
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushfd
+    mov [eax], esp
+    mov esp, edx
+    popfd
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; thread_fpu_save: void thread_fpu_save(void *area, unsigned int fxsr)
+; Saves the x87/SSE state: fxsave into a 16-byte aligned 512-byte area
+; when fxsr is non-zero, fnsave (108 bytes) otherwise. fnsave also
+; reinitialises the FPU, which is fine as a restore always follows.
+global thread_fpu_save
+thread_fpu_save:
+    mov eax, [esp + 4]          ; area
+    cmp dword [esp + 8], 0      ; fxsr
+    je .fnsave
+    fxsave [eax]
+    ret
+.fnsave:
+    fnsave [eax]
+    fwait
+    ret
+
+; thread_fpu_restore: void thread_fpu_restore(const void *area, unsigned int fxsr)
+; Loads state saved by thread_fpu_save
+global thread_fpu_restore
+thread_fpu_restore:
+    mov eax, [esp + 4]          ; area
+    cmp dword [esp + 8], 0      ; fxsr
+    je .frstor
+    fxrstor [eax]
+    ret
+.frstor:
+    frstor [eax]
+    ret
@@ -0,0 +1,118 @@
+/**
+ * timer.c - PIT system tick
+ */
+
+#include "timer.h"
+#include "io.h"
+#include "idt.h"
+#include "softirq.h"
+#include "waitqueue.h"
+#include "hardware.h"
+#include "thread.h"
+#include "smp.h"
+
+/* PIT ports and commands */
+#define PIT_CHANNEL0_PORT   0x40
+#define PIT_COMMAND_PORT    0x43
+#define PIT_FREQUENCY       1193182
+
+/* Channel 0, lobyte/hibyte, mode 3 (square wave), binary */
+#define PIT_CMD_CHANNEL0_SQUARE 0x36
+
+#define TIMER_INTERRUPT     IRQ_BASE_VECTOR
+
+static volatile unsigned int ticks = 0;
+
+/* TSC cycles per microsecond, 0 until measured */
+static unsigned int tsc_per_us = 0;
+
+/* Waiters for the next tick */
+static struct wait_queue timer_wait;
+
+/* timer_sleep callers. Nothing wakes the queue: their deadlines do. */
+static struct wait_queue sleep_wait;
+
+/** timer_irq:
+ *  IRQ0 top half: counts the tick and passes it on to the other
+ *  processors
+ */
+static void timer_irq(unsigned int *regs, void *ctx)
+{
+    (void)regs;
+    (void)ctx;
+
+    ticks++;
+    thread_tick();
+    smp_send_tick();
+    softirq_raise(SOFTIRQ_TIMER);
+}
+
+/** timer_bottom_half:
+ *  Timer softirq: wakes the timed waits that are due and the tick waiters
+ */
+static void timer_bottom_half(void)
+{
+    thread_wake_timeouts(ticks);
+    wake_up(&timer_wait);
+}
+
+/** timer_init */
+void timer_init(void)
+{
+    unsigned int divisor = PIT_FREQUENCY / TIMER_HZ;
+
+    ticks = 0;
+    wait_queue_init(&timer_wait);
+    wait_queue_init(&sleep_wait);
+    softirq_register(SOFTIRQ_TIMER, timer_bottom_half);
+    irq_register(TIMER_INTERRUPT, timer_irq, 0);
+
+    outb(PIT_COMMAND_PORT, PIT_CMD_CHANNEL0_SQUARE);
+    outb(PIT_CHANNEL0_PORT, divisor & 0xFF);
+    outb(PIT_CHANNEL0_PORT, (divisor >> 8) & 0xFF);
+}
+
+/** timer_get_ticks */
+unsigned int timer_get_ticks(void)
+{
+    return ticks;
+}
+
+/** timer_ms_to_ticks */
+unsigned int timer_ms_to_ticks(unsigned int ms)
+{
+    return (ms * TIMER_HZ + 999) / 1000;
+}
+
+/** timer_sleep */
+void timer_sleep(unsigned int ms)
+{
+    wait_event_timeout(sleep_wait, 0, timer_ms_to_ticks(ms));
+}
+
+/** timer_tsc_per_us */
+unsigned int timer_tsc_per_us(void)
+{
+    unsigned int start;
+    unsigned long long t0, t1;
+
+    if (tsc_per_us != 0) {
+        return tsc_per_us;
+    }
+
+    /* Start right after a tick so the span is a whole number of ticks */
+    start = ticks;
+    wait_event(timer_wait, ticks != start);
+    start = ticks;
+    t0 = hw_read_tsc();
+
+    wait_event(timer_wait, ticks - start >= TIMER_HZ / 10);
+    t1 = hw_read_tsc();
+
+    /* 100 ms: fits in 32 bits below 40 GHz */
+    tsc_per_us = (unsigned int)(t1 - t0) / 100000;
+    if (tsc_per_us == 0) {
+        tsc_per_us = 1;
+    }
+    return tsc_per_us;
+}
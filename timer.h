@@ -0,0 +1,42 @@
+#ifndef INCLUDE_TIMER_H
+#define INCLUDE_TIMER_H
+
+/* Timer interrupt frequency */
+#define TIMER_HZ 100
+
+/** timer_init:
+ *  Programs PIT channel 0 to interrupt TIMER_HZ times per second
+ */
+void timer_init(void);
+
+/** timer_get_ticks:
+ *  Gets the number of timer interrupts since timer_init
+ *
+ *  @return The tick count
+ */
+unsigned int timer_get_ticks(void);
+
+/** timer_ms_to_ticks:
+ *  Converts milliseconds to timer ticks, rounding up
+ *
+ *  @param ms  The duration in milliseconds
+ *  @return    The duration in ticks
+ */
+unsigned int timer_ms_to_ticks(unsigned int ms);
+
+/** timer_sleep:
+ *  Sleeps for at least the given time
+ *
+ *  @param ms  The duration in milliseconds
+ */
+void timer_sleep(unsigned int ms);
+
+/** timer_tsc_per_us:
+ *  Gets the TSC frequency in cycles per microsecond. Measured against
+ *  the PIT on first use, which sleeps for about 100 ms.
+ *
+ *  @return The cycles per microsecond
+ */
+unsigned int timer_tsc_per_us(void);
+
+#endif /* INCLUDE_TIMER_H */
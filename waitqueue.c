@@ -0,0 +1,93 @@
+/**
+ * waitqueue.c - Sleeping until an interrupt makes progress possible
+ *
+ * Every wake up comes from an interrupt (directly or through its
+ * softirq). Before threads exist sleeping means halting the CPU, and
+ * hlt returns after that interrupt has been handled. Once they do, the
+ * sleeper blocks on the queue's own list of waiters and wake_up makes
+ * just those threads ready again, so other threads run in the meantime.
+ * A timed sleeper is also woken by the timer at its deadline.
+ */
+
+#include "waitqueue.h"
+#include "softirq.h"
+#include "fb.h"
+#include "thread.h"
+#include "smp.h"
+
+/** wait_queue_init */
+void wait_queue_init(struct wait_queue *wq)
+{
+    wq->waiters = 0;
+    wq->wakeups = 0;
+}
+
+/** wake_up */
+void wake_up(struct wait_queue *wq)
+{
+    wq->wakeups++;
+    thread_wake_queue(wq);
+}
+
+/** wait_begin */
+unsigned int wait_begin(struct wait_queue *wq)
+{
+    unsigned int flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    thread_prepare_block(wq);
+    return flags;
+}
+
+/** wait_sleep_common:
+ *  Sleeps until a wake up of the queue or, if timed, the deadline
+ */
+static void wait_sleep_common(struct wait_queue *wq, int timed, unsigned int deadline)
+{
+    unsigned int seen = wq->wakeups;
+
+    /* Deferred work left by a busy interrupt may be what we wait for */
+    softirq_run();
+    if (wq->wakeups != seen) {
+        return;
+    }
+
+    /* Going idle: whoever we wait for should see the latest output.
+     * The console belongs to the boot processor.
+     */
+    if (cpu_self()->id == 0) {
+        fb_flush();
+    }
+
+    if (thread_current()) {
+        if (timed) {
+            thread_block_until(wq, deadline);
+        } else {
+            thread_block(wq);
+        }
+        return;
+    }
+
+    /* sti takes effect after the next instruction, so an interrupt
+     * arriving now still ends the hlt instead of being missed.
+     */
+    __asm__ volatile("sti; hlt; cli" : : : "memory");
+}
+
+/** wait_sleep */
+void wait_sleep(struct wait_queue *wq)
+{
+    wait_sleep_common(wq, 0, 0);
+}
+
+/** wait_sleep_until */
+void wait_sleep_until(struct wait_queue *wq, unsigned int deadline)
+{
+    wait_sleep_common(wq, 1, deadline);
+}
+
+/** wait_end */
+void wait_end(unsigned int flags)
+{
+    thread_finish_block();
+    __asm__ volatile("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
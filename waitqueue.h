@@ -0,0 +1,95 @@
+#ifndef INCLUDE_WAITQUEUE_H
+#define INCLUDE_WAITQUEUE_H
+
+#include "timer.h"
+
+struct thread;
+
+/* Something that code can sleep on until an interrupt signals it.
+ * Producers (usually softirqs) call wake_up after making the awaited
+ * condition true; consumers use wait_event / wait_event_timeout.
+ */
+struct wait_queue {
+    struct thread *waiters;         /* Blocked on it; see thread_block */
+    volatile unsigned int wakeups;  /* Number of wake_up calls */
+};
+
+/** wait_queue_init:
+ *  Initializes a wait queue
+ *
+ *  @param wq  The wait queue
+ */
+void wait_queue_init(struct wait_queue *wq);
+
+/** wake_up:
+ *  Wakes everything sleeping on the queue, and no one else
+ *
+ *  @param wq  The wait queue
+ */
+void wake_up(struct wait_queue *wq);
+
+/** wait_begin:
+ *  Disables interrupts for a condition check. A wake up of the queue from
+ *  then on, even one on another processor, also ends the next wait_sleep.
+ *
+ *  @param wq  The wait queue
+ *  @return    The previous EFLAGS, for wait_end
+ */
+unsigned int wait_begin(struct wait_queue *wq);
+
+/** wait_sleep:
+ *  Sleeps on the queue until the next wake up. Called with interrupts
+ *  disabled after the condition was found false; returns with interrupts
+ *  disabled so the caller can check it again.
+ *
+ *  @param wq  The wait queue
+ */
+void wait_sleep(struct wait_queue *wq);
+
+/** wait_sleep_until:
+ *  Like wait_sleep, but also returns once the timer reaches the deadline
+ *
+ *  @param wq        The wait queue
+ *  @param deadline  The timer tick to give up at
+ */
+void wait_sleep_until(struct wait_queue *wq, unsigned int deadline);
+
+/** wait_end:
+ *  Ends the wait and restores the interrupt state saved by wait_begin
+ *
+ *  @param flags  The value returned by wait_begin
+ */
+void wait_end(unsigned int flags);
+
+/** wait_event:
+ *  Sleeps until condition is true. The condition is evaluated with
+ *  interrupts disabled, so a wake up can't slip between the check and
+ *  the sleep.
+ */
+#define wait_event(wq, condition)                                   \
+    do {                                                            \
+        unsigned int __flags = wait_begin(&(wq));                   \
+        while (!(condition)) {                                      \
+            wait_sleep(&(wq));                                      \
+        }                                                           \
+        wait_end(__flags);                                          \
+    } while (0)
+
+/** wait_event_timeout:
+ *  Like wait_event, but gives up after the given number of timer ticks.
+ *  Evaluates to 1 if the condition became true, 0 on timeout.
+ */
+#define wait_event_timeout(wq, condition, timeout_ticks)            \
+    ({                                                              \
+        unsigned int __flags = wait_begin(&(wq));                   \
+        unsigned int __deadline = timer_get_ticks() + (timeout_ticks); \
+        int __done;                                                 \
+        while (!(__done = (condition)) &&                           \
+               (int)(__deadline - timer_get_ticks()) > 0) {         \
+            wait_sleep_until(&(wq), __deadline);                    \
+        }                                                           \
+        wait_end(__flags);                                          \
+        __done;                                                     \
+    })
+
+#endif /* INCLUDE_WAITQUEUE_H */